@@ -30,8 +30,16 @@
 // #include <seqan/translation.h>
 // #include <seqan/reduced_aminoacid.h>
 
+#include <fstream>
+#include <future>
+#include <limits>
+#include <string>
+
+#include <unistd.h>
+
 #include "mkindex_misc.hpp"
 #include "mkindex_saca.hpp"
+#include "mkindex_external.hpp"
 // #include "shared_misc.hpp"
 // #include "shared_options.hpp"
 // #include "search_output.hpp" //TODO only needed because options are in one file, remove later
@@ -229,28 +237,84 @@ createSuffixArray(TSA & SA,
 // Function indexCreate
 // ----------------------------------------------------------------------------
 
+// Runtimes (in seconds) of the phases of indexCreateProgress().
+struct IndexCreateTimes
+{
+    double saca = 0;
+    double bwt = 0;
+    double sampling = 0;
+};
+
+inline void
+printIndexCreateTimes(IndexCreateTimes const & times)
+{
+    myPrint(/*options, 2,*/ "SA  construction runtime: ", times.saca, "s\n");
+    myPrint(/*options, 2,*/ "BWT construction runtime: ", times.bwt, "s\n");
+    myPrint(/*options, 2,*/ "SA  sampling runtime:     ", times.sampling, "s\n");
+    myPrint(/*options, 1,*/ "\n");
+}
+
+// Estimated peak memory (in bytes) of indexCreateProgress() for one direction, i.e., the temporary suffix array and
+// the LF table (about one byte per character). The text is not counted (both directions share it).
 template <typename TText, typename TSpec, typename TConfig>
-void
-indexCreateProgress(Index<TText, FMIndex<TSpec, TConfig> > & index,
-                    FibreSALF const &)
-                    // LambdaIndexerOptions const & options)
+inline uint64_t
+indexCreateMemory(Index<TText, FMIndex<TSpec, TConfig> > & index)
 {
     typedef Index<TText, FMIndex<TSpec, TConfig> >               TIndex;
     typedef typename Fibre<TIndex, FibreTempSA>::Type            TTempSA;
-    typedef typename Size<TIndex>::Type                          TSize;
-    typedef typename DefaultIndexCreator<TIndex, FibreSA>::Type  TAlgo;
 
-    TText const & text = indexText(index);
+    return lengthSum(indexText(index)) * (sizeof(typename Value<TTempSA>::Type) + 1);
+}
 
-    if (empty(text))
-        return;
+// Memory available for building an index (in bytes), i.e., MemAvailable of /proc/meminfo (the free memory plus the
+// page cache and the other memory that can be reclaimed without swapping). Falls back to the free physical memory if
+// /proc/meminfo does not exist or has no MemAvailable entry (Linux < 3.14).
+inline uint64_t
+indexCreateMemoryBudget()
+{
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    uint64_t kilobytes;
+    while (meminfo >> key >> kilobytes)
+    {
+        if (key == "MemAvailable:")
+            return kilobytes * 1024;
+        meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // unit
+    }
+    return static_cast<uint64_t>(sysconf(_SC_AVPHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+}
 
-    TTempSA tempSA;
-    uint64_t lastPercent = 0;
+// Restores the number of OpenMP threads of the calling thread and waits for the concurrent construction of the reverse
+// index when the construction of the bidirectional index is left, i.e., also if the forward construction throws.
+struct ConcurrentIndexCreateGuard
+{
+    unsigned const threads;
+    std::future<void> & rev;
+
+    ~ConcurrentIndexCreateGuard()
+    {
+        if (rev.valid())
+            rev.wait();
+        omp_set_num_threads(threads);
+    }
+};
+
+// Builds the full suffix array and the LF table (up to 95% of the progress bar), i.e., the first two phases of
+// indexCreateProgress().
+template <typename TText, typename TSpec, typename TConfig, typename TTempSA>
+void
+_indexCreateSALFProgress(Index<TText, FMIndex<TSpec, TConfig> > & index,
+                         TTempSA & tempSA,
+                         IndexCreateTimes & times,
+                         bool const progressBar,
+                         uint64_t & lastPercent)
+{
+    typedef Index<TText, FMIndex<TSpec, TConfig> >               TIndex;
+    typedef typename DefaultIndexCreator<TIndex, FibreSA>::Type  TAlgo;
+
+    TText const & text = indexText(index);
 
     double s = sysTime();
-    myPrint(/*options, 1, */"Generating Index 0%  10%  20%  30%  40%  50%  60%  70%  80%  90%  100%\n"
-                        " Progress:       |");
     // Create the full SA.
     resize(tempSA, lengthSum(text), Exact());
     // if (options.verbosity >= 1)
@@ -258,11 +322,14 @@ indexCreateProgress(Index<TText, FMIndex<TSpec, TConfig> > & index,
         createSuffixArray(tempSA,
                           text,
                           TAlgo(),
-                          [&lastPercent] (uint64_t curPerc)
+                          [&lastPercent, progressBar] (uint64_t curPerc)
                           {
                               // needs locking, because called from multiple threads
-                              SEQAN_OMP_PRAGMA(critical(progressBar))
-                              printProgressBar(lastPercent, curPerc * 0.85); // 85% of progress
+                              if (progressBar)
+                              {
+                                  SEQAN_OMP_PRAGMA(critical(progressBar))
+                                  printProgressBar(lastPercent, curPerc * 0.85); // 85% of progress
+                              }
                           });
     // } else
     // {
@@ -270,9 +337,9 @@ indexCreateProgress(Index<TText, FMIndex<TSpec, TConfig> > & index,
     //                       text,
     //                       TAlgo());
     // }
-    double sacaTime = sysTime() - s;
+    times.saca = sysTime() - s;
 
-    // if (options.verbosity >= 1)
+    if (progressBar)
         printProgressBar(lastPercent, 85);
 
     // Create the LF table.
@@ -282,10 +349,11 @@ indexCreateProgress(Index<TText, FMIndex<TSpec, TConfig> > & index,
         createLFProgress(indexLF(index),
                          text,
                          tempSA,
-                         [&lastPercent] (uint64_t curPerc)
+                         [&lastPercent, progressBar] (uint64_t curPerc)
                          {
                              // doesn't need locking, only writes from one thread
-                             printProgressBar(lastPercent, curPerc * 0.1); // 10% of progress
+                             if (progressBar)
+                                 printProgressBar(lastPercent, curPerc * 0.1); // 10% of progress
                          });
     // } else
     // {
@@ -296,25 +364,259 @@ indexCreateProgress(Index<TText, FMIndex<TSpec, TConfig> > & index,
     // }
     // Set the FMIndex LF as the CompressedSA LF.
     setFibre(indexSA(index), indexLF(index), FibreLF());
-    double bwtTime = sysTime() - s;
+    times.bwt = sysTime() - s;
 
-    // if (options.verbosity >= 1)
+    if (progressBar)
         printProgressBar(lastPercent, 95);
+}
+
+template <typename TText, typename TSpec, typename TConfig>
+void
+indexCreateProgress(Index<TText, FMIndex<TSpec, TConfig> > & index,
+                    FibreSALF const &,
+                    IndexCreateTimes & times,
+                    bool const progressBar)
+                    // LambdaIndexerOptions const & options)
+{
+    typedef Index<TText, FMIndex<TSpec, TConfig> >               TIndex;
+    typedef typename Fibre<TIndex, FibreTempSA>::Type            TTempSA;
+    typedef typename Size<TIndex>::Type                          TSize;
+
+    TText const & text = indexText(index);
+
+    if (empty(text))
+        return;
+
+    TTempSA tempSA;
+    uint64_t lastPercent = 0;
+
+    if (progressBar)
+        myPrint(/*options, 1, */"Generating Index 0%  10%  20%  30%  40%  50%  60%  70%  80%  90%  100%\n"
+                            " Progress:       |");
+    _indexCreateSALFProgress(index, tempSA, times, progressBar, lastPercent);
 
     // Create the sampled SA.
-    s = sysTime();
+    double const s = sysTime();
     TSize numSentinel = countSequences(text);
     createCompressedSa(indexSA(index), tempSA, numSentinel);
-    double sampleTime = sysTime() - s;
+    times.sampling = sysTime() - s;
 
-    // if (options.verbosity >= 1)
+    if (progressBar)
+    {
         printProgressBar(lastPercent, 100);
+        myPrint(/*options, 1,*/ "\n");
+    }
+}
 
+template <typename TText, typename TSpec, typename TConfig>
+void
+indexCreateProgress(Index<TText, FMIndex<TSpec, TConfig> > & index,
+                    FibreSALF const &)
+                    // LambdaIndexerOptions const & options)
+{
+    IndexCreateTimes times;
+    indexCreateProgress(index, FibreSALF(), times, true);
+    printIndexCreateTimes(times);
+}
+
+// Like indexCreateProgress(), but the suffix array is built in external memory with at most about maxMemory bytes
+// (see createSuffixArrayExternal(), the temporary file is created in $TMPDIR). The sorted ranges of the suffix array
+// are passed on to the LF table and the sampled suffix array right away, i.e., the entire suffix array is never kept
+// in memory. The SA construction time excludes the time of the streamed BWT construction and SA sampling.
+template <typename TText, typename TSpec, typename TConfig>
+void
+indexCreateExternalProgress(Index<TText, FMIndex<TSpec, TConfig> > & index,
+                            FibreSALF const &,
+                            uint64_t const maxMemory,
+                            IndexCreateTimes & times,
+                            bool const progressBar)
+{
+    typedef Index<TText, FMIndex<TSpec, TConfig> >               TIndex;
+    typedef typename Fibre<TIndex, FibreTempSA>::Type            TTempSA;
+    typedef typename Value<TTempSA>::Type                        TSAValue;
+    typedef typename Size<TIndex>::Type                          TSize;
+
+    TText const & text = indexText(index);
+
+    if (empty(text))
+        return;
+
+    uint64_t lastPercent = 0;
+    times = IndexCreateTimes();
+
+    double const start = sysTime();
+    if (progressBar)
+        myPrint(/*options, 1, */"Generating Index 0%  10%  20%  30%  40%  50%  60%  70%  80%  90%  100%\n"
+                            " Progress:       |");
+
+    TSize numSentinel = countSequences(text);
+    initLFStreaming(indexLF(index), text);
+    initCompressedSaStreaming(indexSA(index), static_cast<TSize>(lengthSum(text)), numSentinel);
+
+    createSuffixArrayExternal<TSAValue>(text,
+                                        maxMemory,
+                                        [&] (TSAValue const * sa, uint64_t const n, uint64_t const offset)
+                                        {
+                                            double s = sysTime();
+                                            appendLFStreaming(indexLF(index), text, sa, n, offset);
+                                            times.bwt += sysTime() - s;
+
+                                            s = sysTime();
+                                            appendCompressedSaStreaming(indexSA(index), sa, n, offset, numSentinel);
+                                            times.sampling += sysTime() - s;
+                                        },
+                                        [&lastPercent, progressBar] (uint64_t curPerc)
+                                        {
+                                            // needs locking, because called from multiple threads
+                                            if (progressBar)
+                                            {
+                                                SEQAN_OMP_PRAGMA(critical(progressBar))
+                                                printProgressBar(lastPercent, curPerc * 0.95); // 95% of progress
+                                            }
+                                        });
+
+    double s = sysTime();
+    finalizeLFStreaming(indexLF(index), text);
+    // Set the FMIndex LF as the CompressedSA LF.
+    setFibre(indexSA(index), indexLF(index), FibreLF());
+    times.bwt += sysTime() - s;
+
+    s = sysTime();
+    finalizeCompressedSaStreaming(indexSA(index));
+    times.sampling += sysTime() - s;
+    times.saca = sysTime() - start - times.bwt - times.sampling;
+
+    if (progressBar)
+    {
+        printProgressBar(lastPercent, 100);
+        myPrint(/*options, 1,*/ "\n");
+    }
+}
+
+// Sequence number and offset of the suffix of a row of an FM index (>= the number of sequences), located by walking
+// the LF table to the next sampled row.
+template <typename TText, typename TSpec, typename TConfig>
+inline std::pair<uint64_t, uint64_t>
+locateSuffix(Index<TText, FMIndex<TSpec, TConfig> > & index, uint64_t row)
+{
+    auto const & lf = indexLF(index);
+    auto const & sparseString = getFibre(indexSA(index), FibreSparseString());
+    auto const & indicators = getFibre(sparseString, FibreIndicators());
+    auto const & values = getFibre(sparseString, FibreValues());
+
+    // the walk never crosses the beginning of a sequence since its first position is always sampled
+    uint64_t steps = 0;
+    for (; !getValue(indicators, row); ++steps)
+        row = lf(row);
+    auto const pos = getValue(values, getRank(indicators, row) - 1);
+    return {getSeqNo(pos), getSeqOffset(pos) + steps};
+}
+
+// Derives the LF table of the reverse index from the forward index (see createReverseLF()), the suffixes of the
+// reversed text are never sorted and the suffix array of the reverse index is never built (only its length is set,
+// it is only used for backward searches). locate(row) returns the sequence number and offset of a forward row.
+template <typename TText, typename TSpec, typename TConfig, typename TLocate>
+void
+indexCreateReverse(Index<TText, BidirectionalIndex<FMIndex<TSpec, TConfig> > > & index,
+                   IndexCreateTimes & times,
+                   TLocate && locate)
+{
+    TText const & text = indexText(index.fwd);
+
+    times = IndexCreateTimes();
+    if (empty(text))
+        return;
+
+    double const s = sysTime();
+    createReverseLF(indexLF(index.rev), indexText(index.rev), indexLF(index.fwd), text, locate);
+    // Set the FMIndex LF as the CompressedSA LF.
+    setFibre(indexSA(index.rev), indexLF(index.rev), FibreLF());
+    sparseSuffixArrayLength(indexSA(index.rev)) = lengthSum(text) + countSequences(text);
+    times.bwt = sysTime() - s;
+}
+
+// Builds the forward index and derives the LF table of the reverse index from it (see indexCreateReverse()), i.e.,
+// only one suffix array is sorted and sampled. If the estimated memory of the forward construction and the reverse LF
+// table (about two more bytes per character) fits into memoryBudget (in bytes), the full forward suffix array is kept
+// until the reverse LF table is derived (with all but one thread while the forward suffix array is sampled serially).
+// Otherwise the forward suffix array is sampled and freed first, and the suffixes are located through the sampled
+// suffix array while deriving the reverse LF table (slower, but never more memory than the forward construction).
+// Both constructions yield identical indices.
+template <typename TText, typename TSpec, typename TConfig>
+void
+indexCreateProgress(Index<TText, BidirectionalIndex<FMIndex<TSpec, TConfig> > > & index,
+                    FibreSALF const &,
+                    uint64_t const memoryBudget)
+                    // LambdaIndexerOptions const & options)
+{
+    typedef Index<TText, FMIndex<TSpec, TConfig> >               TIndex;
+    typedef typename Fibre<TIndex, FibreTempSA>::Type            TTempSA;
+    typedef typename Value<TTempSA>::Type                        TSAValue;
+    typedef typename Size<TIndex>::Type                          TSize;
+
+    TText const & text = indexText(index.fwd);
+
+    if (empty(text))
+        return;
+
+    unsigned const threads = omp_get_max_threads();
+    bool const keepSA = indexCreateMemory(index.fwd) + 2 * lengthSum(text) <= memoryBudget;
+    IndexCreateTimes fwdTimes, revTimes;
+    uint64_t lastPercent = 0;
+
+    myPrint(/*options, 1,*/ "Bi-Directional Index [forward and backward]\n");
+    myPrint(/*options, 1, */"Generating Index 0%  10%  20%  30%  40%  50%  60%  70%  80%  90%  100%\n"
+                            " Progress:       |");
+    {
+        TTempSA tempSA;
+        _indexCreateSALFProgress(index.fwd, tempSA, fwdTimes, true, lastPercent);
+
+        TSize numSentinel = countSequences(text);
+        auto const sample = [&index, &fwdTimes, &tempSA, numSentinel] ()
+        {
+            double const s = sysTime();
+            createCompressedSa(indexSA(index.fwd), tempSA, numSentinel);
+            fwdTimes.sampling = sysTime() - s;
+        };
+        auto const locate = [&tempSA, &text, numSentinel] (uint64_t const row)
+        {
+            TSAValue pos;
+            posLocalize(pos, tempSA[row - numSentinel], stringSetLimits(text));
+            return std::pair<uint64_t, uint64_t>(getSeqNo(pos), getSeqOffset(pos));
+        };
+
+        if (!keepSA)
+        {
+            sample();
+        }
+        else if (threads < 2)
+        {
+            indexCreateReverse(index, revTimes, locate);
+            sample();
+        }
+        else
+        {
+            // the number of threads of OpenMP is a setting of each (non-OpenMP) thread
+            std::future<void> rev = std::async(std::launch::async, [&index, &revTimes, &locate, threads] ()
+            {
+                omp_set_num_threads(threads - 1);
+                indexCreateReverse(index, revTimes, locate);
+            });
+            ConcurrentIndexCreateGuard guard{threads, rev}; // the suffix array is freed after the reverse construction
+            sample();
+            rev.get(); // rethrows exceptions of the reverse construction
+        }
+    }
+    if (!keepSA)
+        indexCreateReverse(index, revTimes, [&index] (uint64_t const row) { return locateSuffix(index.fwd, row); });
+
+    printProgressBar(lastPercent, 100);
     myPrint(/*options, 1,*/ "\n");
-    myPrint(/*options, 2,*/ "SA  construction runtime: ", sacaTime, "s\n");
-    myPrint(/*options, 2,*/ "BWT construction runtime: ", bwtTime, "s\n");
-    myPrint(/*options, 2,*/ "SA  sampling runtime:     ", sampleTime, "s\n");
-    myPrint(/*options, 1,*/ "\n");
+
+    myPrint(/*options, 1,*/ "Bi-Directional Index [forward]\n");
+    printIndexCreateTimes(fwdTimes);
+    myPrint(/*options, 1,*/ "Bi-Directional Index [backward]\n");
+    printIndexCreateTimes(revTimes);
 }
 
 template <typename TText, typename TSpec, typename TConfig>
@@ -323,11 +625,26 @@ indexCreateProgress(Index<TText, BidirectionalIndex<FMIndex<TSpec, TConfig> > >
                     FibreSALF const &)
                     // LambdaIndexerOptions const & options)
 {
+    indexCreateProgress(index, FibreSALF(), indexCreateMemoryBudget());
+}
+
+// The LF table of the reverse index is derived from the forward index after its construction, the suffixes are
+// located through the sampled suffix array (the full forward suffix array is never in memory).
+template <typename TText, typename TSpec, typename TConfig>
+void
+indexCreateExternalProgress(Index<TText, BidirectionalIndex<FMIndex<TSpec, TConfig> > > & index,
+                            FibreSALF const &,
+                            uint64_t const maxMemory)
+{
+    IndexCreateTimes times;
+
     myPrint(/*options, 1,*/ "Bi-Directional Index [forward]\n");
-    indexCreateProgress(index.fwd, FibreSALF()/*, options*/);
+    indexCreateExternalProgress(index.fwd, FibreSALF(), maxMemory, times, true);
+    printIndexCreateTimes(times);
 
     myPrint(/*options, 1,*/ "Bi-Directional Index [backward]\n");
-    indexCreateProgress(index.rev, FibreSALF()/*, options*/);
+    indexCreateReverse(index, times, [&index] (uint64_t const row) { return locateSuffix(index.fwd, row); });
+    printIndexCreateTimes(times);
 }
 
 template <typename T>
@@ -0,0 +1,305 @@
+// ==========================================================================
+//                                  lambda
+// ==========================================================================
+// Copyright (c) 2013-2017, Hannes Hauswedell <h2 @ fsfe.org>
+// Copyright (c) 2016-2017, Knut Reinert and Freie Universität Berlin
+// All rights reserved.
+//
+// This file is part of Lambda.
+//
+// Lambda is Free Software: you can redistribute it and/or modify it
+// under the terms found in the LICENSE[.md|.rst] file distributed
+// together with this file.
+//
+// Lambda is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+// ==========================================================================
+// mkindex_external.hpp: suffix array construction in external memory
+// ==========================================================================
+// The suffixes are partitioned into buckets by their first Q characters and
+// consecutive buckets are grouped such that the suffixes of a group fit into
+// the memory limit. One pass over the text distributes the suffixes into a
+// temporary file in $TMPDIR in which the groups are stored consecutively,
+// i.e., in the order of the suffix array. Then the groups are read back one
+// after the other (sequential I/O), sorted in memory with the in-place radix
+// sort and passed on to a consumer in the order of the suffix array (e.g., the
+// streaming construction of the BWT and the sampled suffix array). Only one
+// group of the suffix array is kept in memory at any time.
+// ==========================================================================
+
+#ifndef LAMBDA_INDEXER_EXTERNAL_HPP_
+#define LAMBDA_INDEXER_EXTERNAL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mkindex_saca.hpp"
+
+using namespace seqan;
+
+#define EXTERNAL_SACA_MAX_BUCKETS   (1 << 18) // upper bound of the number of buckets (SIGMA^Q)
+#define EXTERNAL_SACA_BLOCK_SIZE    (1 << 20) // text positions distributed at once by a thread
+#define EXTERNAL_SACA_BUFFER_SIZE   (1 << 16) // max. number of suffixes buffered per thread and group
+
+// Directory of the temporary file, i.e., $TMPDIR or /tmp.
+inline std::string
+externalSacaTempDir()
+{
+    char const * tmpDir = std::getenv("TMPDIR");
+    return (tmpDir != nullptr && *tmpDir != '\0') ? tmpDir : "/tmp";
+}
+
+inline void
+_externalSacaIO(bool const success, std::string const & path)
+{
+    if (!success)
+    {
+        std::cerr << "ERROR: Could not write/read the temporary file " << path
+                  << " of the suffix array construction. Please check the space in $TMPDIR.\n";
+        exit(1);
+    }
+}
+
+inline bool
+_externalSacaPwrite(int const fd, char const * data, uint64_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t const written = pwrite(fd, data, size, offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+inline bool
+_externalSacaPread(int const fd, char * data, uint64_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t const bytes = pread(fd, data, size, offset);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return false;
+        data += bytes;
+        size -= bytes;
+        offset += bytes;
+    }
+    return true;
+}
+
+// Calls f(seqNo, begin, end) for blocks of at most EXTERNAL_SACA_BLOCK_SIZE positions of all sequences in parallel.
+template <typename TText, typename TFunctor>
+inline void
+_externalSacaForEachBlock(TText const & text, TFunctor && f)
+{
+    std::vector<std::tuple<uint64_t, uint64_t, uint64_t> > blocks;
+    for (uint64_t seqNo = 0; seqNo < length(text); ++seqNo)
+        for (uint64_t begin = 0; begin < length(text[seqNo]); begin += EXTERNAL_SACA_BLOCK_SIZE)
+            blocks.emplace_back(seqNo, begin, std::min<uint64_t>(begin + EXTERNAL_SACA_BLOCK_SIZE, length(text[seqNo])));
+
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic))
+    for (uint64_t b = 0; b < blocks.size(); ++b)
+        f(std::get<0>(blocks[b]), std::get<1>(blocks[b]), std::get<2>(blocks[b]));
+}
+
+// Builds the suffix array of a string set using at most about maxMemory bytes for the suffix array (in addition to
+// the text). consumer(sa, n, offset) is called with the ranges [offset, offset + n) of the suffix array in increasing
+// order of offset. A bucket that exceeds the memory limit on its own is still sorted in memory (a warning is printed).
+// If the entire suffix array fits into maxMemory, it is sorted in memory at once and passed on in one range.
+template <typename TSAValue,
+          typename TString,
+          typename TSSetSpec,
+          typename TConsumer,
+          typename TLambda>
+inline void
+createSuffixArrayExternal(StringSet<TString, TSSetSpec> const & text,
+                          uint64_t const maxMemory,
+                          TConsumer && consumer,
+                          TLambda && progressCallback)
+{
+    typedef StringSet<TString, TSSetSpec>                               TText;
+    typedef typename Value<typename Concatenator<TText>::Type>::Type    TAlphabet;
+
+    static const uint64_t SIGMA = static_cast<uint64_t>(ValueSize<TAlphabet>::VALUE) + 1; // 0 = end of the sequence
+
+    uint64_t const n = lengthSum(text);
+    if (n == 0)
+        return;
+    unsigned const threads = omp_get_max_threads();
+
+    // Q characters per bucket (at least one)
+    unsigned Q = 1;
+    uint64_t buckets = SIGMA;
+    while (buckets * SIGMA <= EXTERNAL_SACA_MAX_BUCKETS)
+    {
+        ++Q;
+        buckets *= SIGMA;
+    }
+    uint64_t const shift = buckets / SIGMA;
+
+    // Calls f(bucket, seqNo, pos) for the positions [begin, end) of a sequence (the bucket is rolled over the text).
+    auto const forEachSuffix = [&] (uint64_t const seqNo, uint64_t const begin, uint64_t const end, auto && f)
+    {
+        auto const & sequence = text[seqNo];
+        uint64_t const len = length(sequence);
+        auto const character = [&] (uint64_t const pos) -> uint64_t
+        {
+            return (pos < len) ? ordValue(getValue(sequence, pos)) + 1 : 0;
+        };
+
+        uint64_t bucket = 0;
+        for (unsigned k = 0; k < Q; ++k)
+            bucket = bucket * SIGMA + character(begin + k);
+        for (uint64_t pos = begin; pos < end; ++pos)
+        {
+            f(bucket, seqNo, pos);
+            bucket = (bucket % shift) * SIGMA + character(pos + Q);
+        }
+    };
+
+    // FIRST STEP
+    // count the suffixes of each bucket
+    std::vector<std::vector<uint64_t> > threadCounts(threads, std::vector<uint64_t>(buckets, 0));
+    _externalSacaForEachBlock(text, [&] (uint64_t const seqNo, uint64_t const begin, uint64_t const end)
+    {
+        std::vector<uint64_t> & counts = threadCounts[omp_get_thread_num()];
+        forEachSuffix(seqNo, begin, end, [&counts] (uint64_t const bucket, uint64_t, uint64_t) { ++counts[bucket]; });
+    });
+    std::vector<uint64_t> counts(buckets, 0);
+    for (auto const & c : threadCounts)
+        for (uint64_t b = 0; b < buckets; ++b)
+            counts[b] += c[b];
+    std::vector<std::vector<uint64_t> >().swap(threadCounts);
+    progressCallback(2);
+
+    // group consecutive buckets, groupBegin[g] is the offset of group g in the suffix array
+    uint64_t const maxGroupSize = std::max<uint64_t>(maxMemory / sizeof(TSAValue), 1);
+    std::vector<uint32_t> bucketGroup(buckets);
+    std::vector<uint64_t> groupBegin(1, 0);
+    uint64_t groupSize = 0;
+    bool exceeded = false;
+    for (uint64_t b = 0; b < buckets; ++b)
+    {
+        if (groupSize > 0 && groupSize + counts[b] > maxGroupSize)
+        {
+            groupBegin.push_back(groupBegin.back() + groupSize);
+            groupSize = 0;
+        }
+        groupSize += counts[b];
+        exceeded |= counts[b] > maxGroupSize;
+        bucketGroup[b] = groupBegin.size() - 1;
+    }
+    groupBegin.push_back(n);
+    uint64_t const groups = groupBegin.size() - 1;
+    if (exceeded)
+    {
+        std::cerr << "WARNING: Some suffixes share a long prefix (e.g., runs of N). The suffix array construction "
+                     "needs more memory than the given limit.\n";
+    }
+
+    String<TSAValue> sa;
+    if (groups == 1) // the entire suffix array fits into memory, no temporary file needed
+    {
+        resize(sa, n, Exact());
+        uint64_t i = 0;
+        for (uint64_t seqNo = 0; seqNo < length(text); ++seqNo)
+            for (uint64_t pos = 0; pos < length(text[seqNo]); ++pos, ++i)
+                sa[i] = TSAValue(seqNo, pos);
+
+        inPlaceRadixSort(sa, text, [&] (unsigned curPerc)
+        {
+            progressCallback(2 + curPerc * 98 / 100);
+        });
+        consumer(&sa[0], n, 0);
+        progressCallback(100);
+        return;
+    }
+
+    // SECOND STEP
+    // distribute the suffixes into the temporary file (unlinked immediately, i.e., removed when it is closed)
+    std::string path = externalSacaTempDir() + "/genmap_sa_XXXXXX";
+    int const fd = mkstemp(&path[0]);
+    _externalSacaIO(fd != -1, path);
+    unlink(path.c_str());
+    _externalSacaIO(ftruncate(fd, n * sizeof(TSAValue)) == 0, path);
+
+    // each thread buffers the suffixes of each group, a full buffer is written to the next free range of its group
+    // (all buffers together take at most half of maxMemory, i.e., they get small for many groups and threads)
+    uint64_t const bufferSize = std::min<uint64_t>(std::max<uint64_t>(maxMemory / 2 / sizeof(TSAValue) / threads / groups,
+                                                                      1),
+                                                   EXTERNAL_SACA_BUFFER_SIZE);
+    std::vector<std::atomic<uint64_t> > groupEnd(groups);
+    for (uint64_t g = 0; g < groups; ++g)
+        groupEnd[g] = groupBegin[g];
+    std::vector<std::vector<std::vector<TSAValue> > > buffers(threads, std::vector<std::vector<TSAValue> >(groups));
+    auto const flush = [&] (std::vector<TSAValue> & buffer, uint64_t const g)
+    {
+        uint64_t const offset = groupEnd[g].fetch_add(buffer.size());
+        _externalSacaIO(_externalSacaPwrite(fd, reinterpret_cast<char const *>(buffer.data()),
+                                            buffer.size() * sizeof(TSAValue), offset * sizeof(TSAValue)), path);
+        buffer.clear();
+    };
+
+    _externalSacaForEachBlock(text, [&] (uint64_t const seqNo, uint64_t const begin, uint64_t const end)
+    {
+        auto & threadBuffers = buffers[omp_get_thread_num()];
+        forEachSuffix(seqNo, begin, end, [&] (uint64_t const bucket, uint64_t const s, uint64_t const pos)
+        {
+            uint64_t const g = bucketGroup[bucket];
+            threadBuffers[g].reserve(bufferSize); // the capacity is never exceeded
+            threadBuffers[g].push_back(TSAValue(s, pos));
+            if (threadBuffers[g].size() == bufferSize)
+                flush(threadBuffers[g], g);
+        });
+    });
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic))
+    for (uint64_t g = 0; g < groups; ++g)
+        for (unsigned t = 0; t < threads; ++t)
+            if (!buffers[t][g].empty())
+                flush(buffers[t][g], g);
+    std::vector<std::vector<std::vector<TSAValue> > >().swap(buffers);
+    progressCallback(10);
+
+    // THIRD STEP
+    // sort the groups one after the other and pass them on in the order of the suffix array
+    for (uint64_t g = 0; g < groups; ++g)
+    {
+        uint64_t const size = groupBegin[g + 1] - groupBegin[g];
+        if (size == 0)
+            continue;
+
+        resize(sa, size, Exact());
+        _externalSacaIO(_externalSacaPread(fd, reinterpret_cast<char *>(&sa[0]), size * sizeof(TSAValue),
+                                           groupBegin[g] * sizeof(TSAValue)), path);
+
+        // remaining groups alloted 90% of total progress
+        inPlaceRadixSort(sa, text, [&] (unsigned curPerc)
+        {
+            progressCallback(10 + (groupBegin[g] + size * curPerc / 100) * 90 / n);
+        });
+        consumer(&sa[0], size, groupBegin[g]);
+    }
+
+    ::close(fd);
+    progressCallback(100);
+}
+
+#endif // LAMBDA_INDEXER_EXTERNAL_HPP_
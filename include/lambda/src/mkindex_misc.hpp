@@ -22,6 +22,11 @@
 #ifndef LAMBDA_INDEXER_MISC_HPP_
 #define LAMBDA_INDEXER_MISC_HPP_
 
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
 using namespace seqan;
 
 // ============================================================================
@@ -120,4 +125,322 @@ createLFProgress(LF<TText, TSpec, TConfig> & lf, TOtherText const & text, TSA co
     progress(100);
 }
 
+// ============================================================================
+// Streaming LF table and sampled SA construction
+// ============================================================================
+// For suffix arrays that are not kept in memory entirely (external memory construction): the suffix array is passed
+// on in consecutive ranges [offset, offset + n) in increasing order of offset.
+
+template <typename TText, typename TSpec, typename TConfig, typename TOtherText>
+void
+initLFStreaming(LF<TText, TSpec, TConfig> & lf, TOtherText const & text)
+{
+    typedef LF<TText, TSpec, TConfig>                          TLF;
+    typedef typename Value<TLF>::Type                          TValue;
+    typedef typename Size<TLF>::Type                           TSize;
+
+    // Clear assuming undefined state.
+    clear(lf);
+
+    // Compute prefix sum.
+    prefixSums<TValue>(lf.sums, text);
+
+    // Choose the sentinel substitute.
+    _setSentinelSubstitute(lf);
+
+    // Resize the RankDictionary.
+    TSize seqNum = countSequences(text);
+    TSize totalLen = lengthSum(text);
+    resize(lf.sentinels, seqNum + totalLen, Exact());
+    resize(lf.bwt, seqNum + totalLen, Exact());
+
+    // Fill the sentinel positions (they are all at the beginning of the bwt).
+    for (TSize i = 0; i < seqNum; ++i)
+    {
+        if (length(text[seqNum - (i + 1)]) > 0)
+        {
+            setValue(lf.bwt, i, back(text[seqNum - (i + 1)]));
+            setValue(lf.sentinels, i, false);
+        }
+    }
+}
+
+template <typename TText, typename TSSetSpec, typename TSpec, typename TConfig, typename TOtherText, typename TSAValue>
+void
+appendLFStreaming(LF<StringSet<TText, TSSetSpec>, TSpec, TConfig> & lf,
+                  TOtherText const & text,
+                  TSAValue const * sa,
+                  uint64_t const n,
+                  uint64_t const offset)
+{
+    if (n == 0)
+        return;
+
+    uint64_t const seqNum = countSequences(text);
+    uint64_t const first = seqNum + offset;
+    uint64_t const last = first + n;
+
+    // the blocks are aligned to bwt positions such that no two threads write to the same word
+    uint64_t const blockSize = 1ull << 16;
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic))
+    for (uint64_t b = first / blockSize; b <= (last - 1) / blockSize; ++b)
+    {
+        for (uint64_t i = std::max(first, b * blockSize); i < std::min(last, (b + 1) * blockSize); ++i)
+        {
+            TSAValue pos;    // = SA[i];
+            posLocalize(pos, sa[i - first], stringSetLimits(text));
+
+            if (getSeqOffset(pos) != 0)
+            {
+                setValue(lf.bwt, i, getValue(getValue(text, getSeqNo(pos)), getSeqOffset(pos) - 1));
+                setValue(lf.sentinels, i, false);
+            }
+            else
+            {
+                setValue(lf.bwt, i, lf.sentinelSubstitute);
+                setValue(lf.sentinels, i, true);
+            }
+        }
+    }
+}
+
+template <typename TText, typename TSpec, typename TConfig, typename TOtherText>
+void
+finalizeLFStreaming(LF<TText, TSpec, TConfig> & lf, TOtherText const & text)
+{
+    typedef LF<TText, TSpec, TConfig>                          TLF;
+    typedef typename Size<TLF>::Type                           TSize;
+
+    // Update all ranks.
+    updateRanks(lf.bwt);
+    // Update the auxiliary RankDictionary of sentinel positions.
+    updateRanks(lf.sentinels);
+
+    // Add sentinels to prefix sum.
+    TSize sentinelsCount = countSequences(text);
+    for (TSize i = 0; i < length(lf.sums); ++i)
+        lf.sums[i] += sentinelsCount;
+}
+
+// Same sampling as createCompressedSa(): every suffix starting at a multiple of TConfig::SAMPLING is stored. The
+// sampled values are appended in the order of the suffix array, i.e., in the order of their ranks.
+template <typename TText, typename TSpec, typename TConfig, typename TSize>
+void
+initCompressedSaStreaming(CompressedSA<TText, TSpec, TConfig> & compressedSA, TSize const saLength,
+                          TSize const numSentinel)
+{
+    auto & sparseString = getFibre(compressedSA, FibreSparseString());
+    auto & indicators = getFibre(sparseString, FibreIndicators());
+    auto & values = getFibre(sparseString, FibreValues());
+
+    resize(compressedSA, saLength + numSentinel, Exact());
+    for (TSize i = 0; i < numSentinel; ++i)
+        setValue(indicators, i, false);
+    clear(values);
+    reserve(values, saLength / TConfig::SAMPLING + numSentinel, Exact());
+}
+
+template <typename TText, typename TSpec, typename TConfig, typename TSAValue, typename TSize>
+void
+appendCompressedSaStreaming(CompressedSA<TText, TSpec, TConfig> & compressedSA,
+                            TSAValue const * sa,
+                            uint64_t const n,
+                            uint64_t const offset,
+                            TSize const numSentinel)
+{
+    auto & sparseString = getFibre(compressedSA, FibreSparseString());
+    auto & indicators = getFibre(sparseString, FibreIndicators());
+    auto & values = getFibre(sparseString, FibreValues());
+
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        bool const sampled = getSeqOffset(sa[i]) % TConfig::SAMPLING == 0;
+        setValue(indicators, numSentinel + offset + i, sampled);
+        if (sampled)
+            appendValue(values, sa[i]);
+    }
+}
+
+template <typename TText, typename TSpec, typename TConfig>
+void
+finalizeCompressedSaStreaming(CompressedSA<TText, TSpec, TConfig> & compressedSA)
+{
+    updateRanks(getFibre(getFibre(compressedSA, FibreSparseString()), FibreIndicators()));
+}
+
+// ============================================================================
+// Reverse LF table
+// ============================================================================
+// The LF table of the reverse index of a bidirectional index is derived from the LF table of the forward index, i.e.,
+// the suffixes of the reversed sequences are never sorted. The rows of the reverse index (after the sentinels) are the
+// non-empty prefixes of the sequences sorted by their reversed strings, the BWT of the reverse index stores the
+// character following each prefix (a sentinel for an entire sequence). All right-maximal strings w (followed by at
+// least two different characters or sequence ends) are enumerated by backward searches in the forward index. The
+// interval of the reversed w in the reverse index is split by the preceding characters like in a bidirectional search,
+// first the prefix w itself (occurrences of w at the beginning of a sequence), then cw for each character c. If cw is
+// not right-maximal, all of its occurrences are followed by the same character (the first and the last suffix of its
+// forward interval are located), i.e., its entire reverse interval is filled with it. There are at most as many
+// right-maximal strings as characters and each of them takes two rank queries per character of the alphabet.
+// Equal prefixes of different sequences are sorted like the sentinels (the last sequence first).
+// locate(row) returns the sequence number and offset of the suffix of a row of the forward index (>= the number of
+// sequences). The subtrees of the enumeration are distributed among the threads.
+
+template <typename TText, typename TSpec, typename TConfig, typename TOtherText, typename TFwdLF, typename TFwdText,
+          typename TLocate>
+void
+createReverseLF(LF<TText, TSpec, TConfig> & lf,
+                TOtherText const & text,
+                TFwdLF const & fwdLF,
+                TFwdText const & fwdText,
+                TLocate && locate)
+{
+    typedef LF<TText, TSpec, TConfig>                          TLF;
+    typedef typename Value<TLF>::Type                          TValue;
+
+    // forward interval [begin, end) of w, the first row of the reversed w in the reverse index and the length of w
+    struct Interval
+    {
+        uint64_t begin;
+        uint64_t end;
+        uint64_t revBegin;
+        uint64_t depth;
+    };
+
+    uint64_t const seqNum = countSequences(fwdText);
+    unsigned const sigma = ValueSize<TValue>::VALUE;
+    uint8_t const SENTINEL = sigma;
+
+    initLFStreaming(lf, text);
+
+    // characters of the rows after the sentinels (filled by disjoint intervals)
+    std::vector<uint8_t> bwt(lengthSum(fwdText));
+
+    // occurrences of c (respectively sentinels) in the forward BWT before pos
+    auto const occ = [&fwdLF] (TValue const c, uint64_t const pos) -> uint64_t
+    {
+        if (pos == 0)
+            return 0;
+        uint64_t rank = getRank(fwdLF.bwt, pos - 1, c);
+        if (c == fwdLF.sentinelSubstitute)
+            rank -= getRank(fwdLF.sentinels, pos - 1);
+        return rank;
+    };
+    auto const sentinels = [&fwdLF] (uint64_t const pos) -> uint64_t
+    {
+        return (pos == 0) ? 0 : getRank(fwdLF.sentinels, pos - 1);
+    };
+    // character following the first depth characters of a suffix
+    auto const following = [&fwdText, SENTINEL] (std::pair<uint64_t, uint64_t> const & pos, uint64_t const depth)
+    {
+        if (pos.second + depth == length(fwdText[pos.first]))
+            return SENTINEL;
+        return static_cast<uint8_t>(ordValue(getValue(getValue(fwdText, pos.first), pos.second + depth)));
+    };
+
+    auto const expand = [&] (Interval const & interval, auto && push)
+    {
+        uint64_t revPos;
+        if (interval.depth == 0)
+        {
+            // the empty prefixes are the sentinel rows of the reverse index
+            revPos = seqNum;
+        }
+        else
+        {
+            // the prefix w itself, i.e., the rows of w with a sentinel in the forward BWT
+            uint64_t const first = sentinels(interval.begin);
+            uint64_t const count = sentinels(interval.end) - first;
+            std::vector<std::pair<uint64_t, uint8_t> > prefixes;
+            for (uint64_t k = 1; k <= count; ++k)
+            {
+                uint64_t lo = interval.begin, hi = interval.end - 1;
+                while (lo < hi)
+                {
+                    uint64_t const mid = lo + (hi - lo) / 2;
+                    if (getRank(fwdLF.sentinels, mid) >= first + k)
+                        hi = mid;
+                    else
+                        lo = mid + 1;
+                }
+                auto const pos = locate(lo);
+                prefixes.emplace_back(pos.first, following(pos, interval.depth));
+            }
+            std::sort(prefixes.begin(), prefixes.end(), std::greater<std::pair<uint64_t, uint8_t> >());
+            for (uint64_t k = 0; k < count; ++k)
+                bwt[interval.revBegin - seqNum + k] = prefixes[k].second;
+            revPos = interval.revBegin + count;
+        }
+
+        for (unsigned c = 0; c < sigma; ++c)
+        {
+            uint64_t const begin = fwdLF.sums[c] + ((interval.depth == 0) ? 0 : occ(TValue(c), interval.begin));
+            uint64_t const end = (interval.depth == 0) ? fwdLF.sums[c + 1]
+                                                       : fwdLF.sums[c] + occ(TValue(c), interval.end);
+            if (begin == end)
+                continue;
+
+            uint8_t const next = following(locate(begin), interval.depth + 1);
+            if (end - begin == 1 || next == following(locate(end - 1), interval.depth + 1))
+                std::fill(bwt.begin() + (revPos - seqNum), bwt.begin() + (revPos - seqNum + end - begin), next);
+            else
+                push(Interval{begin, end, revPos, interval.depth + 1});
+            revPos += end - begin;
+        }
+    };
+
+    // breadth-first until there are enough subtrees for all threads
+    std::vector<Interval> intervals{Interval{0, length(fwdLF.bwt), 0, 0}};
+    while (!intervals.empty() && intervals.size() < 64ull * omp_get_max_threads())
+    {
+        std::vector<Interval> children;
+        for (Interval const & interval : intervals)
+            expand(interval, [&children] (Interval const & child) { children.push_back(child); });
+        intervals.swap(children);
+    }
+
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic, 1))
+    for (uint64_t i = 0; i < intervals.size(); ++i)
+    {
+        std::vector<Interval> stack{intervals[i]};
+        while (!stack.empty())
+        {
+            Interval const interval = stack.back();
+            stack.pop_back();
+            expand(interval, [&stack] (Interval const & child) { stack.push_back(child); });
+        }
+    }
+
+    // the blocks are aligned to bwt positions such that no two threads write to the same word
+    uint64_t const blockSize = 1ull << 16;
+    uint64_t const last = seqNum + bwt.size();
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic))
+    for (uint64_t b = seqNum / blockSize; b <= (last - 1) / blockSize; ++b)
+    {
+        for (uint64_t i = std::max(seqNum, b * blockSize); i < std::min(last, (b + 1) * blockSize); ++i)
+        {
+            if (bwt[i - seqNum] != SENTINEL)
+            {
+                setValue(lf.bwt, i, TValue(bwt[i - seqNum]));
+                setValue(lf.sentinels, i, false);
+            }
+            else
+            {
+                setValue(lf.bwt, i, lf.sentinelSubstitute);
+                setValue(lf.sentinels, i, true);
+            }
+        }
+    }
+
+    finalizeLFStreaming(lf, text);
+}
+
+// Length of a compressed suffix array without any samples, e.g., of the reverse index of a bidirectional index which
+// only stores its LF table (it is built, saved and loaded separately from the LF table).
+template <typename TText, typename TSpec, typename TConfig>
+auto &
+sparseSuffixArrayLength(CompressedSA<TText, TSpec, TConfig> & compressedSA)
+{
+    return getFibre(compressedSA, FibreSparseString())._length;
+}
+
 #endif // LAMBDA_INDEXER_MISC_HPP_
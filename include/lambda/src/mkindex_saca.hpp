@@ -416,6 +416,10 @@ void inPlaceRadixSort(TSA & sa, TText const & text, TLambda && progressCallback
                  return (std::get<1>(l) - std::get<0>(l)) > (std::get<1>(r) - std::get<0>(r));
              });
 
+        // all intervals have been sorted entirely (e.g., by quicksort since they were small)
+        if (secondStack.empty())
+            break;
+
         // check if largest interval "fits" in one thread efficiently
         // this works independently of alphabet size and just depends on the data
         // MIN_BUCKETS check additionally guarantees a degree of granularity
@@ -1,6 +1,16 @@
 #pragma once
 
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
 #include "find2_index_approx.hpp"
+#include "frequencies.hpp"
 
 using namespace seqan;
 
@@ -9,56 +19,9 @@ using ModComplement = ModView<FunctorComplement<TChar> >;
 template <typename TText>
 using ModRevCompl = ModifiedString<ModifiedString<TText, ModComplement<typename Value<TText>::Type>>, ModReverse>;
 
-// template <typename TMappVector, typename TChromosomeLength>
-// void resetLimits(TMappVector const &, unsigned const, TChromosomeLength const)
-// { }
-
-template <bool csvComputation, typename TMappVector, typename TChromLengths, typename TCumChromLengths, typename TLocations>
-void resetLimits(TMappVector & c, unsigned const kmerLength, TChromLengths const & chromLengths, TCumChromLengths const & cumChromLengths, TLocations & locations)
-{
-    using TLocation = typename TLocations::key_type;
-    using TEntry = std::pair<TLocation, std::pair<std::vector<TLocation>, std::vector<TLocation> > >;
-
-    // skip first, since the first cumulative length is 0
-    for (uint64_t i = 1; i < length(cumChromLengths); ++i)
-    {
-        for (uint64_t j = 1; j < kmerLength; ++j)
-        {
-            c[cumChromLengths[i] - j] = 0;
-        }
-
-        // TODO: if sequences are shorter that the kmer (and possibly span more than 2 sequences), this will lead to errors!
-        // Remove csv entries for kmers overlapping multiple sequences accidentally.
-        SEQAN_IF_CONSTEXPR (csvComputation)
-        {
-            // for single fasta files it is guaranteed that every entry exists and it only has to be resetted if the kmer is overlapping
-            // for directories some kmers might be missing
-
-            // add empty entries in csv for sequences that are shorter that K and reset the last k-1 entries of each sequence
-            TEntry entry;
-            entry.first.i1 = i - 1;
-            entry.first.i2 = (chromLengths[i - 1] >= kmerLength) ? (chromLengths[i - 1] - kmerLength + 1) : 0;
-            while (entry.first.i2 < chromLengths[i - 1])
-            {
-                auto const insertPos = locations.lower_bound(entry.first);
-                if (insertPos != locations.end() && !(locations.key_comp()(entry.first, insertPos->first)))
-                {
-                    insertPos->second.first.clear();
-                    insertPos->second.second.clear();
-                }
-                else
-                {
-                    locations.insert(insertPos, entry);
-                }
-                ++entry.first.i2;
-            }
-        }
-    }
-}
-
 // TODO: avoid signed integers
 
-template <bool reportExactMatch, bool csvComputation, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
+template <bool reportExactMatch, bool collectIterators, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
 inline void extendExact(TBiIter it, std::vector<TValue> & hits, std::vector<typename TBiIter::TFwdIndexIter> & itExact,
                         std::vector<std::vector<typename TBiIter::TFwdIndexIter> > & itAll,
                         TText const & text, unsigned const length,
@@ -75,7 +38,7 @@ inline void extendExact(TBiIter it, std::vector<TValue> & hits, std::vector<type
         {
             itExact[a-ab] = it.fwdIter;
         }
-        SEQAN_IF_CONSTEXPR (csvComputation)
+        SEQAN_IF_CONSTEXPR (collectIterators)
         {
             itAll[a-ab].push_back(it.fwdIter);
         }
@@ -95,7 +58,7 @@ inline void extendExact(TBiIter it, std::vector<TValue> & hits, std::vector<type
                 success = (!isDna5 || text[i] != Dna5('N')) && goDown(it2, text[i], Rev());
             }
             if (success)
-                extendExact<reportExactMatch, csvComputation, maxErrors>(it2, hits, itExact, itAll, text, length, a, b_new, ab, bb);
+                extendExact<reportExactMatch, collectIterators, maxErrors>(it2, hits, itExact, itAll, text, length, a, b_new, ab, bb);
         }
     //}
 
@@ -108,19 +71,19 @@ inline void extendExact(TBiIter it, std::vector<TValue> & hits, std::vector<type
             if((isDna5 && text[i] == Dna5('N')) || !goDown(it, text[i], Fwd()))
                 return;
         }
-        extendExact<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, text, length, a_new, b, ab, bb);
+        extendExact<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, text, length, a_new, b, ab, bb);
     }
 }
 
 // forward
-template <bool reportExactMatch, bool csvComputation, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
+template <bool reportExactMatch, bool collectIterators, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
 inline void extend(TBiIter it, std::vector<TValue> & hits, std::vector<typename TBiIter::TFwdIndexIter> & itExact,
                    std::vector<std::vector<typename TBiIter::TFwdIndexIter> > & itAll,
                    unsigned errorsLeft, TText const & text, unsigned const length,
                    uint64_t a, uint64_t b, // searched interval
                    uint64_t ab, uint64_t bb); // entire interval
 
-template <bool reportExactMatch, bool csvComputation, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
+template <bool reportExactMatch, bool collectIterators, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
 inline void approxSearch(TBiIter it, std::vector<TValue> & hits, std::vector<typename TBiIter::TFwdIndexIter> & itExact,
                          std::vector<std::vector<typename TBiIter::TFwdIndexIter> > & itAll,
                          unsigned errorsLeft, TText const & text, unsigned const length,
@@ -133,7 +96,7 @@ inline void approxSearch(TBiIter it, std::vector<TValue> & hits, std::vector<typ
 
     if (b == b_new)
     {
-        extend<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, errorsLeft, text, length, a, b, ab, bb);
+        extend<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, errorsLeft, text, length, a, b, ab, bb);
         return;
     }
     if (errorsLeft > 0)
@@ -143,7 +106,7 @@ inline void approxSearch(TBiIter it, std::vector<TValue> & hits, std::vector<typ
             do {
                 bool delta = !ordEqual(parentEdgeLabel(it, Rev()), text[b + 1])
                              || (isDna5 && text[b + 1] == Dna5('N'));
-                approxSearch<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, errorsLeft - delta, text, length, a, b + 1, ab, bb, b_new, Rev());
+                approxSearch<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, errorsLeft - delta, text, length, a, b + 1, ab, bb, b_new, Rev());
             } while (goRight(it, Rev()));
         }
     }
@@ -154,10 +117,10 @@ inline void approxSearch(TBiIter it, std::vector<TValue> & hits, std::vector<typ
             if ((isDna5 && text[i] == Dna5('N')) || !goDown(it, text[i], Rev()))
                 return;
         }
-        extendExact<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, text, length, a, b_new, ab, bb);
+        extendExact<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, text, length, a, b_new, ab, bb);
     }
 }
-template <bool reportExactMatch, bool csvComputation, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
+template <bool reportExactMatch, bool collectIterators, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
 inline void approxSearch(TBiIter it, std::vector<TValue> & hits, std::vector<typename TBiIter::TFwdIndexIter> & itExact,
                          std::vector<std::vector<typename TBiIter::TFwdIndexIter> > & itAll,
                          unsigned errorsLeft, TText const & text, unsigned const length,
@@ -170,7 +133,7 @@ inline void approxSearch(TBiIter it, std::vector<TValue> & hits, std::vector<typ
 
     if (a == a_new)
     {
-        extend<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, errorsLeft, text, length, a, b, ab, bb);
+        extend<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, errorsLeft, text, length, a, b, ab, bb);
         return;
     }
     if (errorsLeft > 0)
@@ -180,7 +143,7 @@ inline void approxSearch(TBiIter it, std::vector<TValue> & hits, std::vector<typ
             do {
                 bool delta = !ordEqual(parentEdgeLabel(it, Fwd()), text[a - 1])
                              || (isDna5 && text[a - 1] == Dna5('N'));
-                approxSearch<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, errorsLeft - delta, text, length, a - 1, b, ab, bb, a_new, Fwd());
+                approxSearch<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, errorsLeft - delta, text, length, a - 1, b, ab, bb, a_new, Fwd());
             } while (goRight(it, Fwd()));
         }
     }
@@ -191,11 +154,11 @@ inline void approxSearch(TBiIter it, std::vector<TValue> & hits, std::vector<typ
             if ((isDna5 && text[i] == Dna5('N')) || !goDown(it, text[i], Fwd()))
                 return;
         }
-        extendExact<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, text, length, a_new, b, ab, bb);
+        extendExact<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, text, length, a_new, b, ab, bb);
     }
 }
 
-template <bool reportExactMatch, bool csvComputation, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
+template <bool reportExactMatch, bool collectIterators, unsigned maxErrors, typename TBiIter, typename TValue, typename TText>
 inline void extend(TBiIter it, std::vector<TValue> & hits, std::vector<typename TBiIter::TFwdIndexIter> & itExact,
                    std::vector<std::vector<typename TBiIter::TFwdIndexIter> > & itAll,
                    unsigned errorsLeft, TText const & text, unsigned const length,
@@ -206,7 +169,7 @@ inline void extend(TBiIter it, std::vector<TValue> & hits, std::vector<typename
 
     if (errorsLeft == 0)
     {
-        extendExact<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, text, length, a, b, ab, bb);
+        extendExact<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, text, length, a, b, ab, bb);
         return;
     }
     if (b - a + 1 == length)
@@ -216,7 +179,7 @@ inline void extend(TBiIter it, std::vector<TValue> & hits, std::vector<typename
             if (maxErrors == errorsLeft)
                 itExact[a-ab] = it.fwdIter;
         }
-        SEQAN_IF_CONSTEXPR (csvComputation)
+        SEQAN_IF_CONSTEXPR (collectIterators)
         {
             itAll[a-ab].push_back(it.fwdIter);
         }
@@ -229,7 +192,7 @@ inline void extend(TBiIter it, std::vector<TValue> & hits, std::vector<typename
         uint64_t b_new = b + (((brm - b) + 2 - 1) >> 1); // ceil((bb - b)/2)
         if (b_new <= bb)
         {
-            approxSearch<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, errorsLeft, text, length,
+            approxSearch<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, errorsLeft, text, length,
                          a, b, // searched interval
                          ab, bb, // entire interval
                          b_new,
@@ -242,7 +205,7 @@ inline void extend(TBiIter it, std::vector<TValue> & hits, std::vector<typename
     {
         int64_t alm = b + 1 - length;
         uint64_t a_new = alm + std::max<int64_t>(((a - alm) - 1) >> 1, 0);
-        approxSearch<reportExactMatch, csvComputation, maxErrors>(it, hits, itExact, itAll, errorsLeft, text, length,
+        approxSearch<reportExactMatch, collectIterators, maxErrors>(it, hits, itExact, itAll, errorsLeft, text, length,
                      a, b, // searched interval
                      ab, bb, // entire interval
                      a_new,
@@ -251,11 +214,295 @@ inline void extend(TBiIter it, std::vector<TValue> & hits, std::vector<typename
     }
 }
 
-template <unsigned errors, bool csvComputation, typename TIndex, typename TText, typename TContainer, typename TChromosomeLengths, typename TLocations, typename TMapping>
+// Maps each row of the BWT to the fasta file that its suffix belongs to (only needed for --exclude-pseudo). The ids are
+// bit-packed with ceil(log2(files)) bits per row (no bits at all for a single fasta file), an id may span two words.
+struct FastaFileIds
+{
+    std::vector<uint64_t> words;
+    uint32_t files = 0;
+    unsigned bits = 0;
+};
+
+inline void initFastaFileIds(FastaFileIds & fileIds, uint64_t const rows, uint32_t const files)
+{
+    fileIds.files = files;
+    fileIds.bits = 0;
+    while (fileIds.bits < 32 && (1ull << fileIds.bits) < files)
+        ++fileIds.bits;
+    fileIds.words.assign((rows * fileIds.bits + 63) / 64, 0);
+}
+
+// Can be called concurrently for different rows (each row is set at most once after the initialization).
+inline void setFastaFileId(FastaFileIds & fileIds, uint64_t const row, uint32_t const fileId)
+{
+    if (fileIds.bits == 0)
+        return;
+    uint64_t const bit = row * fileIds.bits;
+    uint64_t const word = bit / 64;
+    unsigned const offset = bit % 64;
+    __atomic_fetch_or(&fileIds.words[word], static_cast<uint64_t>(fileId) << offset, __ATOMIC_RELAXED);
+    if (offset + fileIds.bits > 64)
+        __atomic_fetch_or(&fileIds.words[word + 1], static_cast<uint64_t>(fileId) >> (64 - offset), __ATOMIC_RELAXED);
+}
+
+inline uint32_t getFastaFileId(FastaFileIds const & fileIds, uint64_t const row)
+{
+    if (fileIds.bits == 0)
+        return 0;
+    uint64_t const bit = row * fileIds.bits;
+    uint64_t const word = bit / 64;
+    unsigned const offset = bit % 64;
+    uint64_t value = fileIds.words[word] >> offset;
+    if (offset + fileIds.bits > 64)
+        value |= fileIds.words[word + 1] << (64 - offset);
+    return value & ((1ull << fileIds.bits) - 1);
+}
+
+// Traverses each sequence backwards with LF starting from its sentinel, i.e., every row of the BWT is visited exactly once.
+template <typename TIndex, typename TMapping>
+inline void computeFastaFileIds(FastaFileIds & fileIds, TIndex & index, TMapping const & mappingSeqIdFile, unsigned const threads)
+{
+    auto const & text = indexText(index);
+    auto const & lfTable = indexLF(index.fwd);
+    uint64_t const seqNum = countSequences(text);
+
+    initFastaFileIds(fileIds, seqNum + lengthSum(text), (seqNum > 0) ? mappingSeqIdFile[seqNum - 1] + 1 : 0);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for (uint64_t i = 0; i < seqNum; ++i)
+    {
+        // the first rows of the BWT belong to the sentinels, row i is the sentinel of sequence seqNum - 1 - i
+        uint64_t const seqNo = seqNum - 1 - i;
+        if (length(text[seqNo]) == 0)
+            continue;
+
+        uint32_t const fileId = mappingSeqIdFile[seqNo];
+        uint64_t row = i;
+        do
+        {
+            row = lfTable(row);
+            setFastaFileId(fileIds, row, fileId);
+        } while (!isSentinel(lfTable, row));
+    }
+}
+
+// Counts the number of distinct fasta files covered by the SA intervals of the iterators without locating them.
+template <typename TIters>
+inline uint64_t countDistinctFastaFiles(TIters const & itFwd, TIters const & itRevCompl, FastaFileIds const & fileIds)
+{
+    thread_local std::vector<bool> seen;
+    thread_local std::vector<uint32_t> seenFiles;
+
+    seen.resize(fileIds.files, false); // all entries are false, they are reset below
+    seenFiles.clear();
+
+    for (auto const * its : {&itFwd, &itRevCompl})
+    {
+        for (auto const & it : *its)
+        {
+            // stop as soon as the k-mer has been found in every fasta file
+            for (uint64_t row = it.vDesc.range.i1; row < it.vDesc.range.i2 && seenFiles.size() < fileIds.files; ++row)
+            {
+                uint32_t const fileId = getFastaFileId(fileIds, row);
+                if (!seen[fileId])
+                {
+                    seen[fileId] = true;
+                    seenFiles.push_back(fileId);
+                }
+            }
+        }
+    }
+
+    for (uint32_t const fileId : seenFiles)
+        seen[fileId] = false;
+    return seenFiles.size();
+}
+
+// Exact copies of k-mers are located in batches: the SA rows of the exact matches of many windows are collected per
+// thread (up to SearchParams::locateBatchSize rows) and located together. Locating a single occurrence is a chain of
+// dependent LF steps (each rank query has to wait for the previous one), in a batch all pending rows take one LF step
+// per round, i.e., the rank queries of different rows are independent and their cache misses overlap. The located
+// positions are sorted and written to the frequency vector mostly sequentially instead of randomly distributed.
+// The batch is kept small since exact copies can only be skipped by subsequent windows once the batch is written.
+// For the csv output the exact copies are located anyway (for the locations), they are marked right away instead.
+
+template <typename TValue>
+struct LocateEntry
+{
+    uint64_t row;       // current SA row (after steps LF steps)
+    uint64_t steps;
+    TValue   frequency;
+};
+
+template <typename TValue>
+struct ScatterBuffer
+{
+    std::vector<LocateEntry<TValue> > rows;             // SA rows of exact copies that have not been located yet
+    std::vector<std::pair<uint64_t, TValue> > entries; // (global position, frequency)
+};
+
+template <typename TFwdIter, typename TValue>
+inline void addExactCopies(ScatterBuffer<TValue> & buffer, TFwdIter const & it, TValue const frequency)
+{
+    for (uint64_t row = it.vDesc.range.i1; row < it.vDesc.range.i2; ++row)
+        buffer.rows.push_back({row, 0, frequency});
+}
+
+// Locates all pending rows of the buffer (with the same sampling as the compressed suffix array, see
+// appendCompressedSaStreaming()) and appends the global positions to the entries.
+template <typename TFwdIndex, typename TLimits, typename TValue>
+inline void locateExactCopies(ScatterBuffer<TValue> & buffer, TFwdIndex & fwdIndex, TLimits const & limits)
+{
+    auto const & lf = indexLF(fwdIndex);
+    auto const & sparseString = getFibre(indexSA(fwdIndex), FibreSparseString());
+    auto const & indicators = getFibre(sparseString, FibreIndicators());
+    auto const & values = getFibre(sparseString, FibreValues());
+
+    auto & rows = buffer.rows;
+    buffer.entries.reserve(buffer.entries.size() + rows.size());
+    while (!rows.empty())
+    {
+        uint64_t pending = 0;
+        for (uint64_t k = 0; k < rows.size(); ++k)
+        {
+            LocateEntry<TValue> entry = rows[k];
+            if (getValue(indicators, entry.row))
+            {
+                // the walk never crosses the beginning of a sequence since its first position is always sampled
+                auto const sampledPos = getValue(values, getRank(indicators, entry.row) - 1);
+                buffer.entries.emplace_back(posGlobalize(sampledPos, limits) + entry.steps, entry.frequency);
+            }
+            else
+            {
+                entry.row = lf(entry.row);
+                ++entry.steps;
+                rows[pending++] = entry;
+            }
+        }
+        rows.resize(pending);
+    }
+}
+
+// In the chunked mode (--chunk-size) the frequency vector only covers the sequences [firstSeq, lastSeq) of the text.
+// Frequencies of exact copies of k-mers in subsequent chunks are appended to a temporary file per chunk on disk and
+// loaded before the chunk is computed, s.t. these k-mers do not have to be searched again. Copies in previous chunks
+// are dropped since their frequencies have already been computed and written. The temporary files are created with
+// unique names by createSpillFiles() (i.e., files of other or aborted runs are never read) and removed when they have
+// been loaded or at the latest when the SpillFiles are destroyed.
+struct SpillFiles
+{
+    std::vector<uint64_t> chunkBegins; // first position of each chunk and the length of the text
+    std::vector<std::string> paths;    // temporary file of each chunk (empty if already removed)
+
+    SpillFiles() = default;
+    SpillFiles(SpillFiles const &) = delete;
+    SpillFiles & operator=(SpillFiles const &) = delete;
+
+    ~SpillFiles()
+    {
+        for (std::string const & path : paths)
+            if (!path.empty())
+                std::remove(path.c_str());
+    }
+};
+
+struct FrequencyChunk
+{
+    uint64_t firstSeq = 0;
+    uint64_t lastSeq = std::numeric_limits<uint64_t>::max(); // excluding
+    uint64_t id = 0;
+    SpillFiles * spill = nullptr; // nullptr if the entire text is covered
+};
+
+// Creates an empty temporary file for each chunk (in the directory of prefix).
+inline void createSpillFiles(SpillFiles & spill, std::string const & prefix)
+{
+    for (uint64_t chunk = 0; chunk + 1 < spill.chunkBegins.size(); ++chunk)
+    {
+        std::string path = prefix + ".spill" + std::to_string(chunk) + ".XXXXXX";
+        int const fd = mkstemp(&path[0]);
+        if (fd == -1)
+        {
+            std::cerr << "ERROR: Could not create temporary file " << path << " (" << strerror(errno) << ").\n";
+            exit(1);
+        }
+        close(fd);
+        spill.paths.push_back(path);
+    }
+}
+
+// entries have to be sorted by position and must not belong to the chunk 'chunk' or any previous chunk
+template <typename TIter>
+inline void appendSpill(SpillFiles & spill, uint64_t chunk, TIter it, TIter const end)
+{
+    while (it != end)
+    {
+        while (spill.chunkBegins[chunk + 1] <= it->first)
+            ++chunk;
+        auto const itEnd = std::lower_bound(it, end, spill.chunkBegins[chunk + 1],
+                                            [] (auto const & entry, uint64_t const pos) { return entry.first < pos; });
+
+        #pragma omp critical (spill)
+        {
+            std::ofstream spillFile(spill.paths[chunk], std::ios::out | std::ios::binary | std::ios::app);
+            spillFile.write(reinterpret_cast<char const *>(&*it), (itEnd - it) * sizeof(*it));
+        }
+        it = itEnd;
+    }
+}
+
+template <typename TContainer>
+inline void loadSpill(SpillFiles & spill, uint64_t const chunk, TContainer & c)
+{
+    typedef std::pair<uint64_t, typename TContainer::value_type> TEntry;
+
+    std::string & path = spill.paths[chunk];
+    std::ifstream spillFile(path, std::ios::in | std::ios::binary);
+    TEntry entry;
+    while (spillFile.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+        setFrequency(c, entry.first - spill.chunkBegins[chunk], entry.second);
+    spillFile.close();
+    std::remove(path.c_str());
+    path.clear();
+}
+
+template <typename TFwdIndex, typename TLimits, typename TValue, typename TContainer>
+inline void flushScatterBuffer(ScatterBuffer<TValue> & buffer, TFwdIndex & fwdIndex, TLimits const & limits,
+                               TContainer & c, uint64_t const chunkBegin, uint64_t const chunkEnd,
+                               FrequencyChunk const & chunk)
+{
+    constexpr uint64_t prefetchDistance = 16;
+
+    locateExactCopies(buffer, fwdIndex, limits);
+
+    auto & entries = buffer.entries;
+    std::sort(entries.begin(), entries.end(), [] (auto const & a, auto const & b) { return a.first < b.first; });
+
+    auto const comp = [] (auto const & entry, uint64_t const pos) { return entry.first < pos; };
+    uint64_t const first = std::lower_bound(entries.begin(), entries.end(), chunkBegin, comp) - entries.begin();
+    uint64_t const last = std::lower_bound(entries.begin() + first, entries.end(), chunkEnd, comp) - entries.begin();
+    for (uint64_t k = first; k < last; ++k)
+    {
+        if (k + prefetchDistance < last)
+            prefetchFrequency(c, entries[k + prefetchDistance].first - chunkBegin);
+        setFrequency(c, entries[k].first - chunkBegin, entries[k].second);
+    }
+
+    if (chunk.spill != nullptr && last < entries.size())
+        appendSpill(*chunk.spill, chunk.id + 1, entries.begin() + last, entries.end());
+    entries.clear();
+}
+
+template <unsigned errors, bool csvComputation, bool excludePseudo, typename TIndex, typename TText, typename TContainer, typename TChromosomeLengths, typename TLocations>
 inline void computeMappability(TIndex & index, TText const & text, TContainer & c, SearchParams const & params,
-                               bool const directory, TChromosomeLengths const & chromLengths, TLocations & locations, TMapping const & mappingSeqIdFile)
+                               bool const directory, TChromosomeLengths const & chromLengths, TLocations & locations, FastaFileIds const & fileIds,
+                               FrequencyChunk const & chunk = FrequencyChunk())
 {
     typedef typename TContainer::value_type TValue;
+
+    // occurrences have to be collected for the csv output, for --exclude-pseudo only their SA intervals are needed
+    constexpr bool collectIterators = csvComputation || excludePseudo;
+    constexpr uint64_t max_val = std::numeric_limits<TValue>::max();
     typedef Iter<TIndex, VSTree<TopDown<> > > TBiIter;
 
     TChromosomeLengths chromCumLengths;
@@ -269,39 +516,65 @@ inline void computeMappability(TIndex & index, TText const & text, TContainer &
             appendValue(chromCumLengths, _cumLength);
         }
     }
+    SequenceLookup sequenceLookup;
+    initSequenceLookup(sequenceLookup, chromCumLengths);
     auto const & limits = stringSetLimits(indexText(index));
     uint64_t const textLength = length(text);
-    uint64_t const numberOfKmers = textLength - params.length + 1;
     uint64_t const stepSize = params.length - params.overlap + 1; // Number of overlapping k-mers searched at once
 
+    // Only k-mers that lie entirely within a sequence are searched (i.e., the k-1 k-mers spanning two adjacent sequences
+    // and sequences shorter than k are skipped). Each sequence is divided into windows of stepSize k-mers
+    // (the last window of each sequence might be shorter). A window is mapped back to its sequence in constant time.
+    // In the chunked mode only the windows of the sequences in the chunk are searched (c only covers these sequences).
+    uint64_t const firstSeq = std::min<uint64_t>(chunk.firstSeq, length(chromLengths));
+    uint64_t const lastSeq = std::min<uint64_t>(chunk.lastSeq, length(chromLengths));
+    uint64_t const chunkBegin = chromCumLengths[firstSeq];
+    uint64_t const chunkEnd = chromCumLengths[lastSeq];
+
+    std::vector<uint64_t> windowCumCounts(1, 0);
+    for (uint64_t i = firstSeq; i < lastSeq; ++i)
+    {
+        uint64_t const numberOfKmers = (chromLengths[i] >= params.length) ? chromLengths[i] - params.length + 1 : 0;
+        windowCumCounts.push_back(windowCumCounts.back() + (numberOfKmers + stepSize - 1) / stepSize);
+    }
+    uint64_t const numberOfWindows = windowCumCounts.back();
+    SequenceLookup windowLookup;
+    initSequenceLookup(windowLookup, windowCumCounts);
+
     // Number of loop iterations assigned to a thread at once
-    // It should be significantly smaller than the number of loop iterations (numberOfKmers/stepSize), since
+    // It should be significantly smaller than the number of loop iterations (numberOfWindows), since
     // the running time of different loop iterations can vary vastly (e.g., repeats are slower than unique regions).
     // This leads to an unused variable warning in Clang
     #pragma clang diagnostic push
     #pragma clang diagnostic ignored "-Wunused"
-    uint64_t const chunkSize = std::max<uint64_t>(1, numberOfKmers / (stepSize * params.threads * 50));
+    uint64_t const chunkSize = std::max<uint64_t>(1, numberOfWindows / (params.threads * 50));
     #pragma clang diagnostic pop
 
     uint64_t progressCount, progressMax, progressStep;
-    initProgress<outputProgress>(progressCount, progressStep, progressMax, stepSize, numberOfKmers);
+    initProgress<outputProgress>(progressCount, progressStep, progressMax, 1, numberOfWindows);
+
+    std::vector<ScatterBuffer<TValue> > scatterBuffers(params.threads);
 
     #pragma omp parallel for schedule(dynamic, chunkSize) num_threads(params.threads)
 
-    for (uint64_t i = 0; i < numberOfKmers; i += stepSize)
+    for (uint64_t w = 0; w < numberOfWindows; ++w)
     {
-        // overlap is the length of the infix!
-        uint64_t maxPos = std::min(i + params.length - params.overlap, textLength - params.length) + 1;
+        Pair<uint64_t, uint64_t> window; // sequence and number of the window in this sequence
+        myPosLocalize(window, w, windowLookup);
+        window.i1 += firstSeq;
+
+        uint64_t const i = chromCumLengths[window.i1] + window.i2 * stepSize;
+        uint64_t const maxPos = std::min(i + stepSize, chromCumLengths[window.i1 + 1] - params.length + 1);
 
         // Skip leading and trailing precomputed k-mer frequencies
         uint64_t beginPos = i;
-        while (beginPos < maxPos && c[beginPos] != 0)
+        while (beginPos < maxPos && isFrequencySet(c, beginPos - chunkBegin))
             ++beginPos;
 
         uint64_t endPos = maxPos; // endPos is excluding, i.e. [beginPos, endPos)
-        while (i > 0 && endPos - 1 >= i && c[endPos - 1] != 0) // we do not check for i == 0 to avoid an underflow.
+        while (endPos > beginPos && isFrequencySet(c, endPos - 1 - chunkBegin))
             --endPos;
-        if (i != endPos)
+        if (beginPos != endPos)
         {
             uint64_t overlap = params.length - (endPos - beginPos) + 1;
             auto scheme = OptimalSearchSchemesGM<errors>::VALUE;
@@ -323,14 +596,14 @@ inline void computeMappability(TIndex & index, TText const & text, TContainer &
                 // WARNING: if it is computed on the directory, csvComputation currently still needs the exact matches (can be updated down below)
                 if (errors_spent == 0)
                 {
-                    extend<true, csvComputation, errors>(it, hits, itExact, itAll, errors - errors_spent, needles, params.length,
+                    extend<true, collectIterators, errors>(it, hits, itExact, itAll, errors - errors_spent, needles, params.length,
                         params.length - overlap, params.length - 1, // searched interval
                         0, bb // entire interval
                     );
                 }
                 else
                 {
-                    extend<false, csvComputation, errors>(it, hits, itExact, itAll, errors - errors_spent, needles, params.length,
+                    extend<false, collectIterators, errors>(it, hits, itExact, itAll, errors - errors_spent, needles, params.length,
                         params.length - overlap, params.length - 1, // searched interval
                         0, bb // entire interval
                     );
@@ -347,7 +620,7 @@ inline void computeMappability(TIndex & index, TText const & text, TContainer &
                 auto delegateRevCompl = [&hits, &itExact, &itAllrevCompl, bb, overlap, &params, &needlesRevCompl](
                     TBiIter it, TNeedlesRevComplOverlap const & /*read*/, unsigned const errors_spent)
                 {
-                    extend<false, csvComputation, errors>(it, hits, itExact, itAllrevCompl, errors - errors_spent, needlesRevCompl, params.length,
+                    extend<false, collectIterators, errors>(it, hits, itExact, itAllrevCompl, errors - errors_spent, needlesRevCompl, params.length,
                         params.length - overlap, params.length - 1, // searched interval
                         0, bb // entire interval
                     );
@@ -364,110 +637,146 @@ inline void computeMappability(TIndex & index, TText const & text, TContainer &
             _optimalSearchSchemeGM(delegate, it, needlesOverlap, scheme, HammingDistance());
             for (uint64_t j = beginPos; j < endPos; ++j)
             {
+                uint64_t frequency = hits[j - beginPos];
+                bool exactCopiesMarked = false;
+
+                // overwrite frequency vector, i.e., count the fasta files containing the k-mer instead of its occurrences
+                SEQAN_IF_CONSTEXPR (excludePseudo)
+                {
+                    frequency = countDistinctFastaFiles(itAll[j - beginPos], itAllrevCompl[endPos - 1 - j], fileIds);
+                    hits[j - beginPos] = std::min<uint64_t>(frequency, max_val);
+                }
+
                 SEQAN_IF_CONSTEXPR (csvComputation) // Attention: why this here? no location filling when csvCompution = 0
                 {
-                    using TLocation = typename TLocations::key_type;
-                    using TEntry = std::pair<TLocation, std::pair<std::vector<TLocation>, std::vector<TLocation> > >;
+                    // hits are saturated at the maximum of the value type, the filter needs the actual frequency
+                    if (!excludePseudo && frequency == max_val)
+                    {
+                        frequency = 0;
+                        for (auto const & iterator : itAll[j - beginPos])
+                            frequency += countOccurrences(iterator);
+                        for (auto const & iterator : itAllrevCompl[endPos - 1 - j])
+                            frequency += countOccurrences(iterator);
+                    }
 
-                    TEntry entry;
+                    // k-mers with a frequency outside of the requested range are neither located nor stored
+                    // (this holds for exact copies as well since they share the frequency)
+                    if (frequency >= params.csvMinFrequency && frequency <= params.csvMaxFrequency)
+                    {
+                        using TLocation = typename TLocations::key_type;
+                        using TGroup = typename TLocations::TGroup;
 
-                    uint64_t size = 0;
-                    for (auto const & iterator : itAll[j - beginPos])
-                        size += countOccurrences(iterator);
-                    // if (size < CUTOFF) continue;
-                    entry.second.first.reserve(size);
+                        TGroup group;
 
-                    size = 0;
-                    for (auto const & iterator : itAllrevCompl[j - beginPos])
-                        size += countOccurrences(iterator);
-                    entry.second.second.reserve(size);
+                        uint64_t size = 0;
+                        for (auto const & iterator : itAll[j - beginPos])
+                            size += countOccurrences(iterator);
+                        // if (size < CUTOFF) continue;
+                        group.first.reserve(size);
 
-                    for (auto const & iterator : itAll[j - beginPos])
-                    {
-                        for (auto const & occ : getOccurrences(iterator))
+                        size = 0;
+                        for (auto const & iterator : itAllrevCompl[j - beginPos])
+                            size += countOccurrences(iterator);
+                        group.second.reserve(size);
+
+                        for (auto const & iterator : itAll[j - beginPos])
                         {
-                            entry.second.first.push_back(occ);
+                            for (auto const & occ : getOccurrences(iterator))
+                            {
+                                group.first.push_back(occ);
+                            }
                         }
-                    }
-                    // sorting is needed for output when multiple fasta files are indexed and the locations need to be separated by filename.
-                    std::sort(entry.second.first.begin(), entry.second.first.end());
+                        // sorting is needed for output when multiple fasta files are indexed and the locations need to be separated by filename.
+                        std::sort(group.first.begin(), group.first.end());
 
-                    // NOTE: vector has to be iterated over in reverse order (compared to itAll)
-                    // for (auto const & iterator : itAllrevCompl[j - beginPos])
-                    for (auto const & iterator : itAllrevCompl[endPos - 1 - j])
-                    {
-                        for (auto const & occ : getOccurrences(iterator))
+                        // NOTE: vector has to be iterated over in reverse order (compared to itAll)
+                        // for (auto const & iterator : itAllrevCompl[j - beginPos])
+                        for (auto const & iterator : itAllrevCompl[endPos - 1 - j])
                         {
-                            entry.second.second.push_back(occ);
+                            for (auto const & occ : getOccurrences(iterator))
+                            {
+                                group.second.push_back(occ);
+                            }
                         }
-                    }
-                    // sorting is needed for output when multiple fasta files are indexed and the locations need to be separated by filename.
-                    std::sort(entry.second.second.begin(), entry.second.second.end());
-
-                    // overwrite frequency vector
-                    if (params.excludePseudo)
-                    {
-                        std::set<typename Value<TLocation, 1>::Type> distinct_sequences;
-                        for (auto const & location : entry.second.first) // forward strand
-                            distinct_sequences.insert(mappingSeqIdFile[location.i1]);
-                        assert(entry.second.second.size() == 0 || params.revCompl);
-                        for (auto const & location : entry.second.second) // reverse strand
-                            distinct_sequences.insert(mappingSeqIdFile[location.i1]);
-
-                        hits[j - beginPos] = distinct_sequences.size();
+                        // sorting is needed for output when multiple fasta files are indexed and the locations need to be separated by filename.
+                        std::sort(group.second.begin(), group.second.end());
 
                         // NOTE: If you want to filter certain k-mers in the csv file based on the mappability value
-                        // (with respect to --exclude-pseudo) you can unset 'entry' here.
+                        // (with respect to --exclude-pseudo) you can unset 'group' here.
 
-                    }
+                        // All exact copies of this k-mer refer to the same group, i.e., the occurrences are only stored once.
+                        // k-mers without any occurrence (e.g. containing an N) refer to the empty group 0.
+                        bool const emptyGroup = group.first.empty() && group.second.empty();
+                        TLocation kmerPos;
 
-                    if (!directory && countOccurrences(itExact[j - beginPos]) > 1)
-                    {
-                        // the for-loop does not insert an entry for kmers originating from a position such that the kmer spans two sequences. Hence we insert it here. The occurrences will later be cleared by resetLimits, but at least the position exists in the map.
-                        myPosLocalize(entry.first, j, chromCumLengths); // TODO: inefficient for read data sets   0 > 0
-                        if (entry.first.i2 > chromLengths[entry.first.i1] - params.length)
+                        if (!directory && countOccurrences(itExact[j - beginPos]) > 1)
                         {
+                            auto const & exactOccs = getOccurrences(itExact[j - beginPos]);
+                            myPosLocalize(kmerPos, j, sequenceLookup);
                             #pragma omp critical
-                            locations.insert(entry);
+                            {
+                                // the k-mer might have been stored already as an exact copy of a k-mer that was
+                                // searched at the same time by another thread, i.e., every group is stored only once
+                                if (locations.positions.count(kmerPos) == 0)
+                                {
+                                    uint64_t const groupId = emptyGroup ? 0 : locations.groups.size();
+                                    if (!emptyGroup)
+                                        locations.groups.push_back(std::move(group));
+
+                                    for (auto const & exact_occ : exactOccs)
+                                    {
+                                        kmerPos = exact_occ;
+                                        locations.positions.insert({kmerPos, groupId});
+                                    }
+                                }
+                            }
+
+                            // the exact copies are marked right away (instead of being located again in a batch),
+                            // s.t. windows of other threads skip them
+                            auto & buffer = scatterBuffers[omp_get_thread_num()];
+                            for (auto const & exact_occ : exactOccs)
+                            {
+                                uint64_t const pos = posGlobalize(exact_occ, limits);
+                                if (pos >= chunkBegin && pos < chunkEnd)
+                                    setFrequency(c, pos - chunkBegin, hits[j - beginPos]);
+                                else
+                                    buffer.entries.emplace_back(pos, hits[j - beginPos]); // spilled by the next flush
+                            }
+                            exactCopiesMarked = true;
                         }
-
-                        for (auto const & exact_occ : getOccurrences(itExact[j - beginPos]))
+                        else
                         {
-                            entry.first = exact_occ;
-                            // TODO: avoid copying
+                            myPosLocalize(kmerPos, j, sequenceLookup);
                             #pragma omp critical
-                            locations.insert(entry);
+                            {
+                                uint64_t const groupId = emptyGroup ? 0 : locations.groups.size();
+                                if (!emptyGroup)
+                                    locations.groups.push_back(std::move(group));
+                                locations.positions.insert({kmerPos, groupId});
+                            }
                         }
                     }
-                    else
-                    {
-                        myPosLocalize(entry.first, j, chromCumLengths); // TODO: inefficient for read data sets
-                        // TODO: avoid copying
-                        #pragma omp critical
-                        locations.insert(entry);
-                    }
                 }
 
-                if (!directory && countOccurrences(itExact[j - beginPos]) > 1) // guaranteed to exist, since there has to be at least one match!
-                {
-                    for (auto const & occ : getOccurrences(itExact[j-beginPos]))
-                    {
-                        auto const occ_pos = posGlobalize(occ, limits);
-                        c[occ_pos] = hits[j - beginPos];
-                    }
-                }
-                else
-                {
-                    c[j] = hits[j - beginPos];
-                }
+                // the frequency of the current k-mer is written immediately (windows of other threads might skip it),
+                // its exact copies are located and written later in a batch
+                setFrequency(c, j - chunkBegin, hits[j - beginPos]);
+                if (!directory && !exactCopiesMarked && countOccurrences(itExact[j - beginPos]) > 1) // guaranteed to exist, since there has to be at least one match!
+                    addExactCopies(scatterBuffers[omp_get_thread_num()], itExact[j - beginPos], hits[j - beginPos]);
             }
+
+            if (scatterBuffers[omp_get_thread_num()].rows.size() >= params.locateBatchSize)
+                flushScatterBuffer(scatterBuffers[omp_get_thread_num()], index.fwd, limits, c, chunkBegin, chunkEnd, chunk);
         }
 
         printProgress<outputProgress>(progressCount, progressStep, progressMax);
     }
-    // The algorithm searches k-mers in the concatenation of all strings in the fasta file (e.g. chromosomes).
-    // Hence, it also searches k-mers that overlap two strings that actually do not exist.
-    // At the end we overwrite the frequency of those k-mers with 0.
-    // TODO: k-mers spanning two strings should not be searched if there are many short strings (i.e., fasta of reads).
-    resetLimits<csvComputation>(c, params.length, chromLengths, chromCumLengths, locations);
+
+    #pragma omp parallel for num_threads(params.threads)
+    for (uint64_t t = 0; t < scatterBuffers.size(); ++t)
+        flushScatterBuffer(scatterBuffers[t], index.fwd, limits, c, chunkBegin, chunkEnd, chunk);
+    finalizeFrequencies(c);
+
+    // k-mers spanning two sequences (and all positions of sequences shorter than k) are never searched, their frequency
+    // remains 0. They are not stored in the locations either, the csv output generates them on the fly.
 }
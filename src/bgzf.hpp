@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+#include "outputfile.hpp"
+
+#if SEQAN_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// Text files with optional BGZF compression (--compress)
+// ----------------------------------------------------------------------------
+// BGZF files are gzip files (i.e., readable by gzip, zcat, etc.) that consist of independent blocks of at most
+// BGZF_BLOCK_SIZE uncompressed bytes, hence the blocks of a buffer are compressed in parallel. Positions in a BGZF file
+// are addressed by virtual offsets (file offset of the block << 16 | offset in the uncompressed block) which are used
+// by the tabix index of the bed file.
+
+#define     BGZF_BLOCK_SIZE     0xff00 // max. uncompressed bytes per block (as in htslib)
+
+namespace genmap::detail
+{
+
+// compressed blocks of a buffer
+struct BgzfBuffer
+{
+    std::string data;
+    std::vector<std::pair<uint32_t, uint32_t> > blocks; // uncompressed and compressed size of each block
+};
+
+struct TextFile
+{
+    OutputFile file;
+    bool compress = false;
+    unsigned threads = 1;
+    uint64_t fileOffset = 0;         // compressed bytes written
+    uint64_t uncompressedOffset = 0; // uncompressed bytes written
+    // uncompressed offset and file offset of each block written by the last call of writeText()/writeBgzf()
+    std::vector<std::pair<uint64_t, uint64_t> > lastBlocks;
+};
+
+inline void appendLittleEndian(std::string & buffer, uint64_t value, unsigned const bytes)
+{
+    for (unsigned i = 0; i < bytes; ++i, value >>= 8)
+        buffer.push_back(static_cast<char>(value & 0xFF));
+}
+
+// Appends a BGZF block, i.e., a gzip member with the size of the block in the extra field 'BC'.
+inline void compressBgzfBlock(std::string & block, char const * data, uint32_t const size)
+{
+#if SEQAN_HAS_ZLIB
+    std::string deflated(compressBound(size) + 64, '\0');
+    z_stream stream{};
+    int status = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15 /* raw deflate */, 8, Z_DEFAULT_STRATEGY);
+    if (status == Z_OK)
+    {
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        stream.avail_in = size;
+        stream.next_out = reinterpret_cast<Bytef *>(&deflated[0]);
+        stream.avail_out = deflated.size();
+        status = deflate(&stream, Z_FINISH);
+        deflateEnd(&stream);
+    }
+    if (status != Z_STREAM_END)
+    {
+        std::cerr << "ERROR: Could not compress a BGZF block (zlib error " << status << ").\n";
+        exit(1);
+    }
+    deflated.resize(stream.total_out);
+
+    uint64_t const blockSize = 18 + deflated.size() + 8;
+    block += std::string("\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00", 16);
+    appendLittleEndian(block, blockSize - 1, 2);
+    block += deflated;
+    appendLittleEndian(block, crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<Bytef const *>(data), size), 4);
+    appendLittleEndian(block, size, 4);
+#else
+    (void) block; (void) data; (void) size;
+#endif
+}
+
+// Compresses text into blocks of BGZF_BLOCK_SIZE bytes (the last block may be smaller) using the given threads.
+inline void compressBgzf(BgzfBuffer & buffer, std::string const & text, unsigned const threads)
+{
+    uint64_t const blocks = (text.size() + BGZF_BLOCK_SIZE - 1) / BGZF_BLOCK_SIZE;
+    std::vector<std::string> compressed(blocks);
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+    for (uint64_t b = 0; b < blocks; ++b)
+    {
+        uint64_t const begin = b * BGZF_BLOCK_SIZE;
+        compressBgzfBlock(compressed[b], text.data() + begin, std::min<uint64_t>(BGZF_BLOCK_SIZE, text.size() - begin));
+    }
+
+    buffer.data.clear();
+    buffer.blocks.clear();
+    for (uint64_t b = 0; b < blocks; ++b)
+    {
+        buffer.data += compressed[b];
+        buffer.blocks.emplace_back(std::min<uint64_t>(BGZF_BLOCK_SIZE, text.size() - b * BGZF_BLOCK_SIZE), compressed[b].size());
+    }
+}
+
+// Opens path (with the suffix .gz if compressed).
+inline void openTextFile(TextFile & textFile, std::string const & path, bool const append, bool const compress,
+                         unsigned const threads)
+{
+    textFile.compress = compress;
+    textFile.threads = threads;
+    openOutputFile(textFile.file, path + (compress ? ".gz" : ""), append);
+}
+
+inline void writeBgzf(TextFile & textFile, BgzfBuffer const & buffer)
+{
+    writeOutput(textFile.file, buffer.data);
+    textFile.lastBlocks.clear();
+    for (auto const & block : buffer.blocks)
+    {
+        textFile.lastBlocks.emplace_back(textFile.uncompressedOffset, textFile.fileOffset);
+        textFile.uncompressedOffset += block.first;
+        textFile.fileOffset += block.second;
+    }
+}
+
+// Writes (and compresses) text. If called from a parallel region, the text is compressed by the calling thread only.
+inline void writeText(TextFile & textFile, std::string const & text)
+{
+    if (text.empty())
+        return;
+
+    if (textFile.compress)
+    {
+        BgzfBuffer buffer;
+        compressBgzf(buffer, text, omp_in_parallel() ? 1 : textFile.threads);
+        writeBgzf(textFile, buffer);
+    }
+    else
+    {
+        writeOutput(textFile.file, text);
+        textFile.uncompressedOffset += text.size();
+        textFile.fileOffset += text.size();
+    }
+}
+
+// Virtual offset of an uncompressed offset in the text of the last call of writeText()/writeBgzf() (including its end).
+inline uint64_t virtualOffset(TextFile const & textFile, uint64_t const uncompressedOffset)
+{
+    auto const block = std::upper_bound(textFile.lastBlocks.begin(), textFile.lastBlocks.end(),
+                                        std::make_pair(uncompressedOffset, std::numeric_limits<uint64_t>::max())) - 1;
+    return (block->second << 16) | (uncompressedOffset - block->first);
+}
+
+inline void closeTextFile(TextFile & textFile)
+{
+    if (textFile.compress) // empty block marking the end of the file
+        writeOutput(textFile.file, "\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00\x1b\x00\x03\x00\x00\x00\x00\x00\x00\x00\x00\x00", 28);
+    closeOutputFile(textFile.file);
+}
+
+// ----------------------------------------------------------------------------
+// Tabix index (.tbi, or .csi for sequences longer than 2^29)
+// ----------------------------------------------------------------------------
+// Index of a BGZF compressed bed file (as created by tabix -p bed). Each record is assigned to the smallest bin of the
+// binning scheme that contains it and consecutive records of a bin are merged into chunks of virtual offsets. The
+// linear index stores the smallest virtual offset of the records overlapping each window of 2^minShift bases.
+
+struct TabixIndex
+{
+    struct Reference
+    {
+        std::map<uint32_t, std::vector<std::pair<uint64_t, uint64_t> > > bins; // bin -> chunks of virtual offsets
+        std::vector<uint64_t> linear;
+    };
+
+    unsigned minShift = 14;
+    unsigned depth = 5;
+    std::vector<std::string> names;
+    std::vector<Reference> references;
+};
+
+inline void initTabixIndex(TabixIndex & index, std::vector<std::string> const & names, uint64_t const maxLength)
+{
+    index.names = names;
+    index.references.assign(names.size(), TabixIndex::Reference());
+    index.depth = 5;
+    while (maxLength > (1ull << (index.minShift + 3 * index.depth)))
+        ++index.depth;
+}
+
+inline bool isCsi(TabixIndex const & index)
+{
+    return index.depth > 5; // .tbi only supports the default binning scheme
+}
+
+inline uint32_t tabixBin(uint64_t const begin, uint64_t end, unsigned const minShift, unsigned const depth)
+{
+    --end;
+    uint32_t t = ((1u << (3 * depth)) - 1) / 7; // first bin of the lowest level
+    unsigned shift = minShift;
+    for (unsigned level = depth; level > 0; --level, shift += 3, t -= 1u << (3 * level))
+    {
+        if ((begin >> shift) == (end >> shift))
+            return t + (begin >> shift);
+    }
+    return 0;
+}
+
+// Adds a record [begin, end) of reference ref stored at the virtual offsets [virtualBegin, virtualEnd).
+inline void addTabixRecord(TabixIndex & index, uint64_t const ref, uint64_t const begin, uint64_t const end,
+                           uint64_t const virtualBegin, uint64_t const virtualEnd)
+{
+    TabixIndex::Reference & reference = index.references[ref];
+
+    auto & chunks = reference.bins[tabixBin(begin, end, index.minShift, index.depth)];
+    if (!chunks.empty() && chunks.back().second == virtualBegin)
+        chunks.back().second = virtualEnd;
+    else
+        chunks.emplace_back(virtualBegin, virtualEnd);
+
+    uint64_t const lastWindow = (end - 1) >> index.minShift;
+    if (reference.linear.size() <= lastWindow)
+        reference.linear.resize(lastWindow + 1, std::numeric_limits<uint64_t>::max());
+    for (uint64_t window = begin >> index.minShift; window <= lastWindow; ++window)
+        reference.linear[window] = std::min(reference.linear[window], virtualBegin);
+}
+
+// Writes the (BGZF compressed) index of the bed file path to path.tbi or path.csi.
+inline void saveTabixIndex(TabixIndex & index, std::string const & path, unsigned const threads)
+{
+    // tabix header: UCSC bed format (0-based, half-open), columns of the sequence name, begin and end
+    std::string meta;
+    appendLittleEndian(meta, 0x10000, 4); // format
+    appendLittleEndian(meta, 1, 4);       // col_seq
+    appendLittleEndian(meta, 2, 4);       // col_beg
+    appendLittleEndian(meta, 3, 4);       // col_end
+    appendLittleEndian(meta, '#', 4);     // meta character
+    appendLittleEndian(meta, 0, 4);       // lines to skip
+    std::string names;
+    for (std::string const & name : index.names)
+        names.append(name.c_str(), name.size() + 1);
+    appendLittleEndian(meta, names.size(), 4);
+    meta += names;
+
+    bool const csi = isCsi(index);
+    std::string data;
+    if (csi)
+    {
+        data += std::string("CSI\1", 4);
+        appendLittleEndian(data, index.minShift, 4);
+        appendLittleEndian(data, index.depth, 4);
+        appendLittleEndian(data, meta.size(), 4);
+        data += meta;
+        appendLittleEndian(data, index.references.size(), 4);
+    }
+    else
+    {
+        data += std::string("TBI\1", 4);
+        appendLittleEndian(data, index.references.size(), 4);
+        data += meta;
+    }
+
+    for (TabixIndex::Reference & reference : index.references)
+    {
+        // windows without records refer to the previous window
+        for (uint64_t window = 0; window < reference.linear.size(); ++window)
+        {
+            if (reference.linear[window] == std::numeric_limits<uint64_t>::max())
+                reference.linear[window] = (window > 0) ? reference.linear[window - 1] : 0;
+        }
+
+        appendLittleEndian(data, reference.bins.size(), 4);
+        for (auto const & bin : reference.bins)
+        {
+            appendLittleEndian(data, bin.first, 4);
+            if (csi) // smallest virtual offset of records overlapping the first window of the bin
+            {
+                uint32_t levelBegin = 0;
+                unsigned level = 0;
+                while (level < index.depth && bin.first >= levelBegin + (1u << (3 * level)))
+                    levelBegin += 1u << (3 * level++);
+                uint64_t const window = static_cast<uint64_t>(bin.first - levelBegin) << (3 * (index.depth - level));
+                appendLittleEndian(data, reference.linear.empty() ? 0 :
+                                   reference.linear[std::min<uint64_t>(window, reference.linear.size() - 1)], 8);
+            }
+            appendLittleEndian(data, bin.second.size(), 4);
+            for (auto const & chunk : bin.second)
+            {
+                appendLittleEndian(data, chunk.first, 8);
+                appendLittleEndian(data, chunk.second, 8);
+            }
+        }
+
+        if (!csi)
+        {
+            appendLittleEndian(data, reference.linear.size(), 4);
+            for (uint64_t const offset : reference.linear)
+                appendLittleEndian(data, offset, 8);
+        }
+    }
+
+    TextFile indexFile;
+    indexFile.compress = true;
+    indexFile.threads = threads;
+    openOutputFile(indexFile.file, path + (csi ? ".csi" : ".tbi"));
+    writeText(indexFile, data);
+    closeTextFile(indexFile);
+}
+
+} // namespace genmap::detail
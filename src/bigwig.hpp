@@ -0,0 +1,545 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if SEQAN_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#include "frequencies.hpp"
+#include "outputfile.hpp"
+
+// ----------------------------------------------------------------------------
+// bigWig output
+// ----------------------------------------------------------------------------
+// Writes the binary indexed bigWig format (version 4) of the UCSC Genome Browser, i.e., the same file wigToBigWig
+// creates from the wig and .chrom.sizes files. Runs of equal values are stored as bedGraph items in zlib compressed
+// sections of BIGWIG_ITEMS_PER_SLOT items which are indexed by an R-tree. Zoom levels summarize bins of
+// BIGWIG_FIRST_REDUCTION, 4 * BIGWIG_FIRST_REDUCTION, ... bases. Sections and zoom levels are computed in parallel per
+// chromosome. All values are written in the byte order of the host (readers detect it by the magic numbers).
+
+#define     BIGWIG_ITEMS_PER_SLOT     1024
+#define     BIGWIG_BLOCK_SIZE         256 // max. number of children of a node in the R-tree and the chromosome B+ tree
+#define     BIGWIG_FIRST_REDUCTION    256
+#define     BIGWIG_MAX_ZOOM_LEVELS    10
+
+namespace genmap::detail
+{
+
+constexpr uint32_t BIGWIG_MAGIC = 0x888FFC26;
+constexpr uint32_t BIGWIG_CHROM_TREE_MAGIC = 0x78CA8C91;
+constexpr uint32_t BIGWIG_RTREE_MAGIC = 0x2468ACE0;
+
+// sizes of the fixed records in the file
+constexpr uint64_t BIGWIG_HEADER_SIZE = 64;
+constexpr uint64_t BIGWIG_ZOOM_HEADER_SIZE = 24;
+constexpr uint64_t BIGWIG_TOTAL_SUMMARY_SIZE = 40;
+
+// zoom record, the sums are accumulated in double (over up to entire chromosomes) and only written as float
+struct BigWigSummary
+{
+    uint32_t chromId;
+    uint32_t start;
+    uint32_t end;
+    uint32_t validCount;
+    float minVal;
+    float maxVal;
+    double sumData;
+    double sumSquares;
+};
+
+// compressed section (of items or zoom records) and its position in the file once written
+struct BigWigBlock
+{
+    uint32_t chromId;
+    uint32_t start;
+    uint32_t end;
+    std::string data;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// everything computed for one chromosome
+struct BigWigChromosome
+{
+    std::vector<BigWigBlock> blocks;
+    std::vector<std::vector<BigWigBlock> > zoomBlocks; // per zoom level
+    std::vector<uint64_t> zoomRecords;                 // per zoom level
+    uint64_t maxUncompressed = 0;
+    uint64_t basesCovered = 0;
+    double minVal = std::numeric_limits<double>::max();
+    double maxVal = std::numeric_limits<double>::lowest();
+    double sumData = 0;
+    double sumSquares = 0;
+};
+
+template <typename T>
+inline void appendBinary(std::string & buffer, T const value)
+{
+    buffer.append(reinterpret_cast<char const *>(&value), sizeof(T));
+}
+
+inline std::string compressBlock(std::string const & data)
+{
+#if SEQAN_HAS_ZLIB
+    uLongf size = compressBound(data.size());
+    std::string compressed(size, '\0');
+    int const status = compress(reinterpret_cast<Bytef *>(&compressed[0]), &size,
+                                reinterpret_cast<Bytef const *>(data.data()), data.size());
+    if (status != Z_OK)
+    {
+        std::cerr << "ERROR: Could not compress a bigWig section (zlib error " << status << ").\n";
+        exit(1);
+    }
+    compressed.resize(size);
+    return compressed;
+#else
+    return data;
+#endif
+}
+
+inline void addSummary(BigWigSummary & summary, float const value, uint32_t const bases)
+{
+    if (summary.validCount == 0)
+    {
+        summary.minVal = value;
+        summary.maxVal = value;
+    }
+    else
+    {
+        summary.minVal = std::min(summary.minVal, value);
+        summary.maxVal = std::max(summary.maxVal, value);
+    }
+    summary.validCount += bases;
+    summary.sumData += static_cast<double>(value) * bases;
+    summary.sumSquares += static_cast<double>(value) * value * bases;
+}
+
+// Compresses the zoom records of one chromosome into blocks of BIGWIG_ITEMS_PER_SLOT records.
+inline void compressZoomRecords(std::vector<BigWigSummary> const & records, std::vector<BigWigBlock> & blocks,
+                                uint64_t & maxUncompressed)
+{
+    std::string buffer;
+    for (uint64_t i = 0; i < records.size(); i += BIGWIG_ITEMS_PER_SLOT)
+    {
+        uint64_t const last = std::min<uint64_t>(i + BIGWIG_ITEMS_PER_SLOT, records.size());
+        buffer.clear();
+        for (uint64_t r = i; r < last; ++r)
+        {
+            appendBinary(buffer, records[r].chromId);
+            appendBinary(buffer, records[r].start);
+            appendBinary(buffer, records[r].end);
+            appendBinary(buffer, records[r].validCount);
+            appendBinary(buffer, records[r].minVal);
+            appendBinary(buffer, records[r].maxVal);
+            appendBinary(buffer, static_cast<float>(records[r].sumData));
+            appendBinary(buffer, static_cast<float>(records[r].sumSquares));
+        }
+        maxUncompressed = std::max<uint64_t>(maxUncompressed, buffer.size());
+        blocks.push_back({records[i].chromId, records[i].start, records[last - 1].end, compressBlock(buffer), 0, 0});
+    }
+}
+
+// Computes the compressed sections and zoom levels of the chromosome [begin, begin + chromLength) of c.
+template <bool mappability, typename TContainer>
+inline void computeBigWigChromosome(TContainer const & c, uint64_t const begin, uint32_t const chromLength,
+                                    uint32_t const chromId, std::vector<uint32_t> const & reductions,
+                                    BigWigChromosome & result)
+{
+    typedef typename TContainer::value_type T;
+
+    auto toValue = [] (T const v)
+    {
+        SEQAN_IF_CONSTEXPR (mappability)
+            return (v != 0) ? 1.0f / static_cast<float>(v) : 0.0f;
+        else
+            return static_cast<float>(v);
+    };
+
+    // zoom records of the first level are computed while scanning the runs, all other levels are merged from the
+    // previous level (the reductions are multiples of each other)
+    std::vector<std::vector<BigWigSummary> > zoom(reductions.size());
+    result.zoomBlocks.resize(reductions.size());
+    result.zoomRecords.assign(reductions.size(), 0);
+    if (chromLength == 0)
+        return;
+
+    std::string section;
+    uint16_t items = 0;
+    uint32_t sectionStart = 0;
+    auto flushSection = [&] (uint32_t const sectionEnd)
+    {
+        // section header (bedGraph items)
+        std::string header;
+        appendBinary(header, chromId);
+        appendBinary(header, sectionStart);
+        appendBinary(header, sectionEnd);
+        appendBinary(header, static_cast<uint32_t>(0)); // item step
+        appendBinary(header, static_cast<uint32_t>(0)); // item span
+        appendBinary(header, static_cast<uint8_t>(1));  // type: bedGraph
+        appendBinary(header, static_cast<uint8_t>(0));  // reserved
+        appendBinary(header, items);
+        header += section;
+        result.maxUncompressed = std::max<uint64_t>(result.maxUncompressed, header.size());
+        result.blocks.push_back({chromId, sectionStart, sectionEnd, compressBlock(header), 0, 0});
+        section.clear();
+        items = 0;
+    };
+
+    uint32_t runStart = 0;
+    T runValue = getFrequency(c, begin);
+    for (uint32_t pos = 1; pos <= chromLength; ++pos)
+    {
+        if (pos < chromLength && getFrequency(c, begin + pos) == runValue)
+            continue;
+
+        float const value = toValue(runValue);
+        if (items == 0)
+            sectionStart = runStart;
+        appendBinary(section, runStart);
+        appendBinary(section, pos);
+        appendBinary(section, value);
+        if (++items == BIGWIG_ITEMS_PER_SLOT)
+            flushSection(pos);
+
+        result.basesCovered += pos - runStart;
+        result.minVal = std::min<double>(result.minVal, value);
+        result.maxVal = std::max<double>(result.maxVal, value);
+        result.sumData += static_cast<double>(value) * (pos - runStart);
+        result.sumSquares += static_cast<double>(value) * value * (pos - runStart);
+
+        // split the run at the bins of the first zoom level
+        if (!reductions.empty())
+        {
+            for (uint32_t start = runStart; start < pos;)
+            {
+                uint32_t const binStart = start - start % reductions[0];
+                uint32_t const binEnd = std::min<uint64_t>(static_cast<uint64_t>(binStart) + reductions[0], chromLength);
+                uint32_t const end = std::min(binEnd, pos);
+                if (zoom[0].empty() || zoom[0].back().start != binStart)
+                    zoom[0].push_back({chromId, binStart, binEnd, 0, 0, 0, 0, 0});
+                addSummary(zoom[0].back(), value, end - start);
+                start = end;
+            }
+        }
+
+        runStart = pos;
+        if (pos < chromLength)
+            runValue = getFrequency(c, begin + pos);
+    }
+    if (items > 0)
+        flushSection(chromLength);
+
+    for (uint64_t level = 1; level < reductions.size(); ++level)
+    {
+        for (BigWigSummary const & record : zoom[level - 1])
+        {
+            uint32_t const binStart = record.start - record.start % reductions[level];
+            if (zoom[level].empty() || zoom[level].back().start != binStart)
+            {
+                uint32_t const binEnd = std::min<uint64_t>(static_cast<uint64_t>(binStart) + reductions[level], chromLength);
+                zoom[level].push_back({chromId, binStart, binEnd, 0, record.minVal, record.maxVal, 0, 0});
+            }
+            BigWigSummary & summary = zoom[level].back();
+            summary.validCount += record.validCount;
+            summary.minVal = std::min(summary.minVal, record.minVal);
+            summary.maxVal = std::max(summary.maxVal, record.maxVal);
+            summary.sumData += record.sumData;
+            summary.sumSquares += record.sumSquares;
+        }
+    }
+
+    for (uint64_t level = 0; level < reductions.size(); ++level)
+    {
+        result.zoomRecords[level] = zoom[level].size();
+        compressZoomRecords(zoom[level], result.zoomBlocks[level], result.maxUncompressed);
+    }
+}
+
+// Writes an R-tree (cirTree) indexing the blocks that are sorted by chromosome and start position. Nodes are padded to
+// BIGWIG_BLOCK_SIZE entries, the root is written first and the leaves last.
+inline void writeBigWigRTree(OutputFile & out, std::vector<BigWigBlock const *> const & blocks, uint64_t const endFileOffset)
+{
+    uint64_t const n = blocks.size();
+    std::string buffer;
+    appendBinary(buffer, BIGWIG_RTREE_MAGIC);
+    appendBinary(buffer, static_cast<uint32_t>(BIGWIG_BLOCK_SIZE));
+    appendBinary(buffer, n);
+    appendBinary(buffer, (n > 0) ? blocks.front()->chromId : 0u);
+    appendBinary(buffer, (n > 0) ? blocks.front()->start : 0u);
+    appendBinary(buffer, (n > 0) ? blocks.back()->chromId : 0u);
+    appendBinary(buffer, (n > 0) ? blocks.back()->end : 0u);
+    appendBinary(buffer, endFileOffset);
+    appendBinary(buffer, static_cast<uint32_t>(BIGWIG_ITEMS_PER_SLOT));
+    appendBinary(buffer, static_cast<uint32_t>(0)); // reserved
+    writeOutput(out, buffer.data(), buffer.size());
+
+    // number of nodes on each level (level 0 are the leaves) and number of blocks covered by a node on each level
+    std::vector<uint64_t> nodes(1, std::max<uint64_t>(1, (n + BIGWIG_BLOCK_SIZE - 1) / BIGWIG_BLOCK_SIZE));
+    std::vector<uint64_t> span(1, BIGWIG_BLOCK_SIZE);
+    while (nodes.back() > 1)
+    {
+        nodes.push_back((nodes.back() + BIGWIG_BLOCK_SIZE - 1) / BIGWIG_BLOCK_SIZE);
+        span.push_back(span.back() * BIGWIG_BLOCK_SIZE);
+    }
+
+    auto nodeSize = [] (uint64_t const level) { return 4 + BIGWIG_BLOCK_SIZE * ((level == 0) ? 32 : 24); };
+    std::vector<uint64_t> levelOffsets(nodes.size());
+    uint64_t offset = tellOutput(out);
+    for (uint64_t level = nodes.size(); level-- > 0;)
+    {
+        levelOffsets[level] = offset;
+        offset += nodes[level] * nodeSize(level);
+    }
+
+    for (uint64_t level = nodes.size(); level-- > 0;)
+    {
+        for (uint64_t node = 0; node < nodes[level]; ++node)
+        {
+            buffer.clear();
+            uint64_t const first = std::min(node * span[level], n);
+            uint64_t const last = std::min(first + span[level], n);
+            uint64_t const step = span[level] / BIGWIG_BLOCK_SIZE; // blocks per child
+            uint16_t const count = (last - first + step - 1) / step;
+            appendBinary(buffer, static_cast<uint8_t>(level == 0)); // is leaf
+            appendBinary(buffer, static_cast<uint8_t>(0));          // reserved
+            appendBinary(buffer, count);
+            for (uint64_t child = 0; child < count; ++child)
+            {
+                BigWigBlock const & firstBlock = *blocks[first + child * step];
+                BigWigBlock const & lastBlock = *blocks[std::min(first + (child + 1) * step, last) - 1];
+                appendBinary(buffer, firstBlock.chromId);
+                appendBinary(buffer, firstBlock.start);
+                appendBinary(buffer, lastBlock.chromId);
+                appendBinary(buffer, lastBlock.end);
+                if (level == 0)
+                {
+                    appendBinary(buffer, firstBlock.offset);
+                    appendBinary(buffer, firstBlock.size);
+                }
+                else
+                {
+                    appendBinary(buffer, levelOffsets[level - 1] + (node * BIGWIG_BLOCK_SIZE + child) * nodeSize(level - 1));
+                }
+            }
+            buffer.resize(nodeSize(level), '\0');
+            writeOutput(out, buffer.data(), buffer.size());
+        }
+    }
+}
+
+// Writes the B+ tree mapping chromosome names to their ids and lengths.
+template <typename TChromosomeNames, typename TChromosomeLengths>
+inline void writeBigWigChromosomeTree(OutputFile & out, TChromosomeNames const & chromNames,
+                                      TChromosomeLengths const & chromLengths)
+{
+    uint64_t const n = length(chromLengths);
+    std::vector<std::string> names(n);
+    std::vector<uint32_t> order(n);
+    uint32_t keySize = 1;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        names[i] = toCString(static_cast<CharString>(chromNames[i]));
+        keySize = std::max<uint32_t>(keySize, names[i].size());
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&names] (uint32_t const a, uint32_t const b) { return names[a] < names[b]; });
+
+    uint32_t const blockSize = std::max<uint64_t>(1, std::min<uint64_t>(n, BIGWIG_BLOCK_SIZE));
+    std::string buffer;
+    appendBinary(buffer, BIGWIG_CHROM_TREE_MAGIC);
+    appendBinary(buffer, blockSize);
+    appendBinary(buffer, keySize);
+    appendBinary(buffer, static_cast<uint32_t>(8)); // value size: id and length
+    appendBinary(buffer, n);
+    appendBinary(buffer, static_cast<uint64_t>(0)); // reserved
+    writeOutput(out, buffer.data(), buffer.size());
+
+    std::vector<uint64_t> nodes(1, std::max<uint64_t>(1, (n + blockSize - 1) / blockSize));
+    std::vector<uint64_t> span(1, blockSize);
+    while (nodes.back() > 1)
+    {
+        nodes.push_back((nodes.back() + blockSize - 1) / blockSize);
+        span.push_back(span.back() * blockSize);
+    }
+
+    uint64_t const nodeSize = 4 + blockSize * (keySize + 8); // leaves and inner nodes have the same size
+    std::vector<uint64_t> levelOffsets(nodes.size());
+    uint64_t offset = tellOutput(out);
+    for (uint64_t level = nodes.size(); level-- > 0;)
+    {
+        levelOffsets[level] = offset;
+        offset += nodes[level] * nodeSize;
+    }
+
+    for (uint64_t level = nodes.size(); level-- > 0;)
+    {
+        for (uint64_t node = 0; node < nodes[level]; ++node)
+        {
+            buffer.clear();
+            uint64_t const first = std::min(node * span[level], n);
+            uint64_t const last = std::min(first + span[level], n);
+            uint64_t const step = span[level] / blockSize; // chromosomes per child
+            uint16_t const count = (last - first + step - 1) / step;
+            appendBinary(buffer, static_cast<uint8_t>(level == 0)); // is leaf
+            appendBinary(buffer, static_cast<uint8_t>(0));          // reserved
+            appendBinary(buffer, count);
+            for (uint64_t child = 0; child < count; ++child)
+            {
+                uint32_t const chromId = order[first + child * step];
+                std::string key = names[chromId];
+                key.resize(keySize, '\0');
+                buffer += key;
+                if (level == 0)
+                {
+                    appendBinary(buffer, chromId);
+                    appendBinary(buffer, static_cast<uint32_t>(chromLengths[chromId]));
+                }
+                else
+                {
+                    appendBinary(buffer, levelOffsets[level - 1] + (node * blockSize + child) * nodeSize);
+                }
+            }
+            buffer.resize(nodeSize, '\0');
+            writeOutput(out, buffer.data(), buffer.size());
+        }
+    }
+}
+
+} // namespace genmap::detail
+
+template <bool mappability, typename TContainer, typename TChromosomeNames, typename TChromosomeLengths>
+void saveBigWig(TContainer const & c, std::string const & output_path, TChromosomeNames const & chromNames,
+                TChromosomeLengths const & chromLengths, unsigned const threads)
+{
+    using namespace genmap::detail;
+
+    uint64_t const chromosomes = length(chromLengths);
+    std::vector<uint64_t> chromBegins(chromosomes + 1, 0);
+    uint64_t maxChromLength = 0;
+    for (uint64_t i = 0; i < chromosomes; ++i)
+    {
+        chromBegins[i + 1] = chromBegins[i] + chromLengths[i];
+        maxChromLength = std::max<uint64_t>(maxChromLength, chromLengths[i]);
+    }
+
+    std::vector<uint32_t> reductions;
+    for (uint64_t r = BIGWIG_FIRST_REDUCTION; r < maxChromLength && reductions.size() < BIGWIG_MAX_ZOOM_LEVELS; r *= 4)
+        reductions.push_back(r);
+
+    OutputFile out;
+    openOutputFile(out, output_path + ".bw");
+
+    // header, zoom headers and total summary are written at the end
+    std::string const placeholder(BIGWIG_HEADER_SIZE + reductions.size() * BIGWIG_ZOOM_HEADER_SIZE + BIGWIG_TOTAL_SUMMARY_SIZE, '\0');
+    writeOutput(out, placeholder.data(), placeholder.size());
+    uint64_t const totalSummaryOffset = BIGWIG_HEADER_SIZE + reductions.size() * BIGWIG_ZOOM_HEADER_SIZE;
+
+    uint64_t const chromTreeOffset = tellOutput(out);
+    writeBigWigChromosomeTree(out, chromNames, chromLengths);
+
+    uint64_t const fullDataOffset = tellOutput(out);
+    uint64_t sectionCount = 0;
+    writeOutput(out, reinterpret_cast<char const *>(&sectionCount), sizeof(sectionCount)); // written at the end
+
+    // chromosomes are computed in parallel and their sections are written in order (the compressed sections are
+    // released once written, the compressed zoom levels are kept until the full index has been written)
+    std::vector<BigWigChromosome> results(chromosomes);
+    #pragma omp parallel for schedule(dynamic, 1) ordered num_threads(threads)
+    for (uint64_t i = 0; i < chromosomes; ++i)
+    {
+        computeBigWigChromosome<mappability>(c, chromBegins[i], chromLengths[i], i, reductions, results[i]);
+
+        #pragma omp ordered
+        {
+            for (BigWigBlock & block : results[i].blocks)
+            {
+                block.offset = tellOutput(out);
+                block.size = block.data.size();
+                writeOutput(out, block.data.data(), block.data.size());
+                std::string().swap(block.data);
+            }
+        }
+    }
+
+    uint64_t maxUncompressed = 0;
+    BigWigChromosome total;
+    std::vector<BigWigBlock const *> blocks;
+    for (BigWigChromosome const & result : results)
+    {
+        maxUncompressed = std::max(maxUncompressed, result.maxUncompressed);
+        total.basesCovered += result.basesCovered;
+        total.minVal = std::min(total.minVal, result.minVal);
+        total.maxVal = std::max(total.maxVal, result.maxVal);
+        total.sumData += result.sumData;
+        total.sumSquares += result.sumSquares;
+        for (BigWigBlock const & block : result.blocks)
+            blocks.push_back(&block);
+    }
+    sectionCount = blocks.size();
+
+    uint64_t const fullIndexOffset = tellOutput(out);
+    writeBigWigRTree(out, blocks, fullIndexOffset);
+
+    // zoom levels: record count, compressed records and R-tree of each level
+    std::string zoomHeaders;
+    for (uint64_t level = 0; level < reductions.size(); ++level)
+    {
+        uint64_t const dataOffset = tellOutput(out);
+        uint32_t records = 0;
+        for (BigWigChromosome const & result : results)
+            records += result.zoomRecords[level];
+        writeOutput(out, reinterpret_cast<char const *>(&records), sizeof(records));
+
+        blocks.clear();
+        for (BigWigChromosome & result : results)
+        {
+            for (BigWigBlock & block : result.zoomBlocks[level])
+            {
+                block.offset = tellOutput(out);
+                block.size = block.data.size();
+                writeOutput(out, block.data.data(), block.data.size());
+                std::string().swap(block.data);
+                blocks.push_back(&block);
+            }
+        }
+
+        uint64_t const indexOffset = tellOutput(out);
+        writeBigWigRTree(out, blocks, indexOffset);
+
+        appendBinary(zoomHeaders, reductions[level]);
+        appendBinary(zoomHeaders, static_cast<uint32_t>(0)); // reserved
+        appendBinary(zoomHeaders, dataOffset);
+        appendBinary(zoomHeaders, indexOffset);
+    }
+
+    std::string header;
+    appendBinary(header, BIGWIG_MAGIC);
+    appendBinary(header, static_cast<uint16_t>(4)); // version
+    appendBinary(header, static_cast<uint16_t>(reductions.size()));
+    appendBinary(header, chromTreeOffset);
+    appendBinary(header, fullDataOffset);
+    appendBinary(header, fullIndexOffset);
+    appendBinary(header, static_cast<uint16_t>(0)); // field count
+    appendBinary(header, static_cast<uint16_t>(0)); // defined field count
+    appendBinary(header, static_cast<uint64_t>(0)); // autoSql offset
+    appendBinary(header, totalSummaryOffset);
+    appendBinary(header, static_cast<uint32_t>(maxUncompressed)); // uncompressed buffer size
+    appendBinary(header, static_cast<uint64_t>(0)); // extension offset
+    header += zoomHeaders;
+    appendBinary(header, total.basesCovered);
+    appendBinary(header, (total.basesCovered > 0) ? total.minVal : 0.0);
+    appendBinary(header, (total.basesCovered > 0) ? total.maxVal : 0.0);
+    appendBinary(header, total.sumData);
+    appendBinary(header, total.sumSquares);
+
+    closeOutputFile(out);
+    overwriteOutput(output_path + ".bw", 0, header.data(), header.size());
+    overwriteOutput(output_path + ".bw", fullDataOffset, reinterpret_cast<char const *>(&sectionCount), sizeof(sectionCount));
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <vector>
+
 #include <time.h>
 #include <sys/time.h>
 
@@ -19,10 +24,22 @@ struct Options
     bool mmap;
     bool indels;
     bool wigFile; // group files into mergable flags, i.e., BED | WIG, etc.
+    bool wigAdaptive; // wig file with fixedStep or variableStep sections, whichever is smaller
     bool bedFile;
+    bool bedGraphFile;
+    bool maskBedFile;
+    float maskMinMappability; // intervals written to the mask bed file (--mask-bed)
+    std::vector<uint64_t> bins; // bin sizes of the binned summaries (--bins)
     bool rawFile;
+    bool rawMmap; // compute the frequencies directly into the memory-mapped raw file
+    bool rawContainer; // self-describing raw file (.gmr) for 'genmap query'
     bool txtFile;
+    bool bigwigFile;
     bool csvFile;
+    bool locFile;
+    bool statisticsFile;
+    bool splitBySequence; // one output file per sequence (frequency based formats)
+    bool compress; // BGZF compression of txt, wig and bed files
     OutputType outputType;
     bool directory;
     bool verbose;
@@ -34,6 +51,7 @@ struct Options
     uint32_t totalLengthWidth;
     unsigned errors;
     unsigned sampling;
+    uint64_t chunkSize; // max. size of the frequency vector in bytes (0 = entire fasta file at once)
 };
 
 template <typename TSpec>
@@ -61,13 +79,54 @@ inline auto retrieveDirectoryInformationLine(CharString const & info)
     return std::make_tuple(fastaFile, length, chromName);
 }
 
-template <typename TResult, typename TPosition, typename TLimits>
-inline void myPosLocalize(TResult & result, TPosition const & pos, TLimits const & limits) {
-    typedef typename Iterator<TLimits const, Standard>::Type TIter;
-    TIter _begin = begin(limits, Standard());
-    TIter _upper = std::upper_bound(_begin, end(limits, Standard()), pos) - 1;
-    result.i1 = difference(_begin, _upper);
-    result.i2 = pos - *_upper;
+// Lookup table for localizing positions in the concatenation of sequences in constant time (instead of a binary search
+// on the cumulative sequence lengths for every position, which is slow on read data sets with millions of sequences).
+// The concatenation is divided into buckets of 2^shift characters (about two buckets per sequence) and each bucket
+// stores the sequence containing its first character, i.e., only the few sequences starting in a bucket are left to check.
+struct SequenceLookup
+{
+    std::vector<uint64_t> limits;  // cumulative sequence lengths starting with 0
+    std::vector<uint64_t> buckets; // sequence containing the first character of each bucket
+    unsigned shift = 0;
+};
+
+template <typename TLimits>
+inline void initSequenceLookup(SequenceLookup & lookup, TLimits const & limits)
+{
+    uint64_t const n = length(limits);
+    lookup.limits.resize(n);
+    for (uint64_t i = 0; i < n; ++i)
+        lookup.limits[i] = limits[i];
+
+    uint64_t const totalLength = lookup.limits.back();
+    uint64_t const maxBuckets = 2 * std::max<uint64_t>(n - 1, 1);
+    lookup.shift = 0;
+    while ((totalLength >> lookup.shift) >= maxBuckets)
+        ++lookup.shift;
+
+    lookup.buckets.resize((totalLength >> lookup.shift) + 1);
+    uint64_t seqNo = 0;
+    for (uint64_t b = 0; b < lookup.buckets.size(); ++b)
+    {
+        uint64_t const pos = b << lookup.shift;
+        while (seqNo + 2 < n && lookup.limits[seqNo + 1] <= pos) // skips empty sequences as well
+            ++seqNo;
+        lookup.buckets[b] = seqNo;
+    }
+}
+
+template <typename TResult, typename TPosition>
+inline void myPosLocalize(TResult & result, TPosition const & pos, SequenceLookup const & lookup)
+{
+    uint64_t const b = pos >> lookup.shift;
+    uint64_t const first = lookup.buckets[b];
+    uint64_t const last = (b + 1 < lookup.buckets.size()) ? lookup.buckets[b + 1] : lookup.limits.size() - 2;
+
+    // the position lies in one of the sequences [first, last], usually first == last
+    auto const limitsBegin = lookup.limits.begin();
+    auto const upper = std::upper_bound(limitsBegin + first + 1, limitsBegin + last + 1, pos) - 1;
+    result.i1 = upper - limitsBegin;
+    result.i2 = pos - *upper;
 }
 
 inline double get_wall_time()
@@ -112,6 +171,27 @@ struct SAValue<StringSet<TString, Owner<ConcatDirect<SizeSpec_<TSeqNo, TSeqPos>
 
 } // namespace seqan
 
+// Locations of each k-mer for the csv output. k-mers that are exact copies of each other share the same occurrences,
+// hence every list of occurrences is only stored once (as a group) and the k-mer positions refer to it by its group id.
+template <typename TLocation>
+struct KmerLocations
+{
+    typedef TLocation                                                   key_type;
+    typedef std::pair<std::vector<TLocation>, std::vector<TLocation> >  TGroup; // occurrences on + and - strand
+
+    std::map<TLocation, uint64_t> positions; // k-mer position -> group id
+    std::vector<TGroup> groups;              // group 0 is always empty (e.g. k-mers spanning two sequences)
+
+    KmerLocations() : groups(1)
+    {}
+
+    void clear()
+    {
+        positions.clear();
+        groups.assign(1, TGroup());
+    }
+};
+
 struct SearchParams
 {
     unsigned length;
@@ -120,6 +200,11 @@ struct SearchParams
     // bool indels;
     bool revCompl;
     bool excludePseudo;
+    // only k-mers with a frequency in [csvMinFrequency, csvMaxFrequency] are located for the csv/locations output
+    uint64_t csvMinFrequency = 0;
+    uint64_t csvMaxFrequency = std::numeric_limits<uint64_t>::max();
+    // SA rows of exact k-mer copies located at once by a thread (1 writes the exact copies after every window)
+    uint64_t locateBatchSize = 1 << 12;
 };
 
 std::string mytime()
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+// ----------------------------------------------------------------------------
+// Frequency vectors
+// ----------------------------------------------------------------------------
+// The frequency vector c can either be a std::vector<TValue>, a CompactFrequencies<TValue> or a MappedFrequencies<TValue>.
+// A FrequencySlice is a read-only view of a range of a frequency vector (e.g., a single sequence for the output).
+// All of them are accessed through
+// getFrequency() and setFrequency(), and finalizeFrequencies() has to be called after the computation (before reading
+// any values).
+
+// Frequency vector storing one byte per position. Frequencies up to 254 are stored directly, larger frequencies are
+// stored as the escape code 255 and their actual value is kept in an escape table. During the computation each thread
+// appends its escaped values to its own list (no locks needed). The escape code is set atomically and only the thread
+// that sets it appends the value, i.e., every position is escaped only once even if it is set multiple times.
+// finalizeFrequencies() sorts the escapes into blocks of 2^COMPACT_FREQUENCIES_BLOCK_BITS positions and stores their
+// 16-bit offsets in the block and their values in separate arrays, i.e., an escaped value is only searched among the
+// escapes of its block. If the escape table would take more memory than a plain vector of TValue (e.g., on repeat-rich
+// genomes), the frequencies are converted into a plain vector instead. Checking whether a frequency has already been
+// computed (i.e., is non-zero) does not need the escape table.
+
+#define     COMPACT_FREQUENCIES_BLOCK_BITS  16
+
+template <typename TValue>
+struct CompactFrequencies
+{
+    typedef TValue value_type;
+    typedef std::pair<uint64_t, TValue> TEscape;
+
+    static constexpr uint8_t ESCAPE = std::numeric_limits<uint8_t>::max();
+
+    std::vector<uint8_t> codes;                       // empty if plain
+    std::vector<std::vector<TEscape> > threadEscapes; // escaped values of each thread (until finalizeFrequencies())
+    std::vector<uint64_t> escapeBlocks;               // index of the first escape of each block (and the number of escapes)
+    std::vector<uint16_t> escapeOffsets;              // offsets of the escaped positions in their blocks (sorted per block)
+    std::vector<TValue> escapeValues;
+    std::vector<TValue> values;                       // all frequencies if plain
+    uint64_t length = 0;
+    bool plain = false;
+
+    uint64_t size() const
+    {
+        return length;
+    }
+};
+
+// Frequency vector stored in a memory-mapped file (the raw output file), i.e., the frequencies are written to the file
+// directly during the computation without an additional copy, and partial results are on disk if the computation is
+// aborted. The path has to be set before calling initFrequencies().
+template <typename TValue>
+struct MappedFrequencies
+{
+    typedef TValue value_type;
+
+    std::string path;
+    TValue * values = nullptr;
+    uint64_t length = 0;
+    int fd = -1;
+
+    MappedFrequencies() = default;
+    MappedFrequencies(MappedFrequencies const &) = delete;
+    MappedFrequencies & operator=(MappedFrequencies const &) = delete;
+
+    ~MappedFrequencies()
+    {
+        if (values != nullptr)
+            munmap(values, length * sizeof(TValue));
+        if (fd != -1)
+            ::close(fd);
+    }
+
+    uint64_t size() const
+    {
+        return length;
+    }
+};
+
+template <typename TContainer>
+struct FrequencySlice
+{
+    typedef typename TContainer::value_type value_type;
+
+    TContainer const * c;
+    uint64_t offset;
+    uint64_t length;
+
+    uint64_t size() const
+    {
+        return length;
+    }
+};
+
+// A slice of a slice refers to the underlying frequency vector.
+template <typename TContainer>
+inline FrequencySlice<TContainer> sliceFrequencies(TContainer const & c, uint64_t const offset, uint64_t const length)
+{
+    return {&c, offset, length};
+}
+
+template <typename TContainer>
+inline FrequencySlice<TContainer> sliceFrequencies(FrequencySlice<TContainer> const & c, uint64_t const offset,
+                                                   uint64_t const length)
+{
+    return {c.c, c.offset + offset, length};
+}
+
+template <typename TValue>
+inline void initFrequencies(std::vector<TValue> & c, uint64_t const size, unsigned const /*threads*/)
+{
+    c.assign(size, 0);
+}
+
+template <typename TValue>
+inline void initFrequencies(CompactFrequencies<TValue> & c, uint64_t const size, unsigned const threads)
+{
+    c.codes.assign(size, 0);
+    c.threadEscapes.assign(std::max<unsigned>(threads, omp_get_max_threads()), {});
+    c.escapeBlocks.clear();
+    c.escapeOffsets.clear();
+    c.escapeValues.clear();
+    c.values.clear();
+    c.length = size;
+    c.plain = false;
+}
+
+template <typename TValue>
+inline void initFrequencies(MappedFrequencies<TValue> & c, uint64_t const size, unsigned const /*threads*/)
+{
+    // the file is truncated and extended to its final size, i.e., it is filled with zeros
+    c.fd = ::open(c.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (c.fd == -1 || ftruncate(c.fd, size * sizeof(TValue)) != 0)
+    {
+        std::cerr << "ERROR: Could not create " << c.path << ".\n";
+        exit(1);
+    }
+    c.length = size;
+    if (size == 0)
+        return;
+
+    void * const values = mmap(nullptr, size * sizeof(TValue), PROT_READ | PROT_WRITE, MAP_SHARED, c.fd, 0);
+    if (values == MAP_FAILED)
+    {
+        std::cerr << "ERROR: Could not memory-map " << c.path << ".\n";
+        exit(1);
+    }
+    c.values = static_cast<TValue *>(values);
+}
+
+template <typename TValue>
+inline TValue getFrequency(std::vector<TValue> const & c, uint64_t const pos)
+{
+    return c[pos];
+}
+
+template <typename TValue>
+inline TValue getFrequency(CompactFrequencies<TValue> const & c, uint64_t const pos)
+{
+    if (c.plain)
+        return c.values[pos];
+
+    uint8_t const code = c.codes[pos];
+    if (code != CompactFrequencies<TValue>::ESCAPE)
+        return code;
+
+    uint64_t const block = pos >> COMPACT_FREQUENCIES_BLOCK_BITS;
+    auto const first = c.escapeOffsets.begin() + c.escapeBlocks[block];
+    auto const last = c.escapeOffsets.begin() + c.escapeBlocks[block + 1];
+    uint16_t const offset = pos & ((1ull << COMPACT_FREQUENCIES_BLOCK_BITS) - 1);
+    return c.escapeValues[std::lower_bound(first, last, offset) - c.escapeOffsets.begin()];
+}
+
+template <typename TValue>
+inline TValue getFrequency(MappedFrequencies<TValue> const & c, uint64_t const pos)
+{
+    return c.values[pos];
+}
+
+template <typename TContainer>
+inline typename TContainer::value_type getFrequency(FrequencySlice<TContainer> const & c, uint64_t const pos)
+{
+    return getFrequency(*c.c, c.offset + pos);
+}
+
+// Decodes the frequencies of [begin, begin + n) into values.
+template <typename TValue>
+inline void getFrequencies(std::vector<TValue> const & c, uint64_t const begin, uint64_t const n, TValue * values)
+{
+    std::copy(c.begin() + begin, c.begin() + begin + n, values);
+}
+
+template <typename TValue>
+inline void getFrequencies(CompactFrequencies<TValue> const & c, uint64_t const begin, uint64_t const n, TValue * values)
+{
+    if (c.plain)
+    {
+        std::copy(c.values.begin() + begin, c.values.begin() + begin + n, values);
+        return;
+    }
+    std::copy(c.codes.begin() + begin, c.codes.begin() + begin + n, values);
+    if (n == 0)
+        return;
+
+    // only the blocks overlapping the range have to be checked
+    uint64_t const end = begin + n;
+    for (uint64_t block = begin >> COMPACT_FREQUENCIES_BLOCK_BITS; block <= (end - 1) >> COMPACT_FREQUENCIES_BLOCK_BITS;
+         ++block)
+    {
+        for (uint64_t e = c.escapeBlocks[block]; e < c.escapeBlocks[block + 1]; ++e)
+        {
+            uint64_t const pos = (block << COMPACT_FREQUENCIES_BLOCK_BITS) + c.escapeOffsets[e];
+            if (pos >= begin && pos < end)
+                values[pos - begin] = c.escapeValues[e];
+        }
+    }
+}
+
+template <typename TValue>
+inline void getFrequencies(MappedFrequencies<TValue> const & c, uint64_t const begin, uint64_t const n, TValue * values)
+{
+    std::copy(c.values + begin, c.values + begin + n, values);
+}
+
+template <typename TContainer>
+inline void getFrequencies(FrequencySlice<TContainer> const & c, uint64_t const begin, uint64_t const n,
+                           typename TContainer::value_type * values)
+{
+    getFrequencies(*c.c, c.offset + begin, n, values);
+}
+
+// only checks whether the frequency has been set, i.e., does not need the escape table
+template <typename TValue>
+inline bool isFrequencySet(std::vector<TValue> const & c, uint64_t const pos)
+{
+    return c[pos] != 0;
+}
+
+template <typename TValue>
+inline bool isFrequencySet(CompactFrequencies<TValue> const & c, uint64_t const pos)
+{
+    return c.plain ? c.values[pos] != 0 : c.codes[pos] != 0;
+}
+
+template <typename TValue>
+inline bool isFrequencySet(MappedFrequencies<TValue> const & c, uint64_t const pos)
+{
+    return c.values[pos] != 0;
+}
+
+template <typename TValue, typename TSource>
+inline void setFrequency(std::vector<TValue> & c, uint64_t const pos, TSource const value)
+{
+    c[pos] = value;
+}
+
+template <typename TValue, typename TSource>
+inline void setFrequency(CompactFrequencies<TValue> & c, uint64_t const pos, TSource const value)
+{
+    if (c.plain)
+        c.values[pos] = value;
+    else if (value < CompactFrequencies<TValue>::ESCAPE)
+        c.codes[pos] = value;
+    else if (__atomic_exchange_n(&c.codes[pos], CompactFrequencies<TValue>::ESCAPE, __ATOMIC_RELAXED) != CompactFrequencies<TValue>::ESCAPE)
+        c.threadEscapes[omp_get_thread_num()].emplace_back(pos, value); // the position has not been escaped before
+}
+
+template <typename TValue, typename TSource>
+inline void setFrequency(MappedFrequencies<TValue> & c, uint64_t const pos, TSource const value)
+{
+    c.values[pos] = value;
+}
+
+template <typename TValue>
+inline void prefetchFrequency(std::vector<TValue> & c, uint64_t const pos)
+{
+    __builtin_prefetch(&c[pos], 1);
+}
+
+template <typename TValue>
+inline void prefetchFrequency(CompactFrequencies<TValue> & c, uint64_t const pos)
+{
+    if (c.plain)
+        __builtin_prefetch(&c.values[pos], 1);
+    else
+        __builtin_prefetch(&c.codes[pos], 1);
+}
+
+template <typename TValue>
+inline void prefetchFrequency(MappedFrequencies<TValue> & c, uint64_t const pos)
+{
+    __builtin_prefetch(&c.values[pos], 1);
+}
+
+template <typename TValue>
+inline void finalizeFrequencies(std::vector<TValue> & /*c*/)
+{}
+
+// writes the frequencies back to the file
+template <typename TValue>
+inline void finalizeFrequencies(MappedFrequencies<TValue> & c)
+{
+    if (c.values != nullptr && msync(c.values, c.length * sizeof(TValue), MS_SYNC) != 0)
+    {
+        std::cerr << "ERROR: Could not write " << c.path << ".\n";
+        exit(1);
+    }
+}
+
+template <typename TValue>
+inline void finalizeFrequencies(CompactFrequencies<TValue> & c)
+{
+    typedef typename CompactFrequencies<TValue>::TEscape TEscape;
+
+    if (c.plain)
+        return;
+
+    uint64_t escapes = 0;
+    for (auto const & threadEscapes : c.threadEscapes)
+        escapes += threadEscapes.size();
+
+    // the escape table takes more memory than it saves
+    if (escapes * (sizeof(uint16_t) + sizeof(TValue)) > c.length * (sizeof(TValue) - 1))
+    {
+        c.values.assign(c.codes.begin(), c.codes.end());
+        std::vector<uint8_t>().swap(c.codes);
+        for (auto & threadEscapes : c.threadEscapes)
+        {
+            for (TEscape const & escape : threadEscapes)
+                c.values[escape.first] = escape.second;
+            std::vector<TEscape>().swap(threadEscapes);
+        }
+        c.plain = true;
+        return;
+    }
+
+    // counting sort of the escapes by block, each block is sorted by offset afterwards
+    uint64_t const blocks = (c.length >> COMPACT_FREQUENCIES_BLOCK_BITS) + 1;
+    c.escapeBlocks.assign(blocks + 1, 0);
+    for (auto const & threadEscapes : c.threadEscapes)
+        for (TEscape const & escape : threadEscapes)
+            ++c.escapeBlocks[(escape.first >> COMPACT_FREQUENCIES_BLOCK_BITS) + 1];
+    for (uint64_t block = 0; block < blocks; ++block)
+        c.escapeBlocks[block + 1] += c.escapeBlocks[block];
+
+    std::vector<uint64_t> next(c.escapeBlocks.begin(), c.escapeBlocks.end() - 1);
+    c.escapeOffsets.resize(escapes);
+    c.escapeValues.resize(escapes);
+    for (auto & threadEscapes : c.threadEscapes)
+    {
+        for (TEscape const & escape : threadEscapes)
+        {
+            uint64_t const e = next[escape.first >> COMPACT_FREQUENCIES_BLOCK_BITS]++;
+            c.escapeOffsets[e] = escape.first & ((1ull << COMPACT_FREQUENCIES_BLOCK_BITS) - 1);
+            c.escapeValues[e] = escape.second;
+        }
+        std::vector<TEscape>().swap(threadEscapes);
+    }
+
+    std::vector<std::pair<uint16_t, TValue> > block;
+    for (uint64_t b = 0; b < blocks; ++b)
+    {
+        block.clear();
+        for (uint64_t e = c.escapeBlocks[b]; e < c.escapeBlocks[b + 1]; ++e)
+            block.emplace_back(c.escapeOffsets[e], c.escapeValues[e]);
+        std::sort(block.begin(), block.end());
+        for (uint64_t e = c.escapeBlocks[b]; e < c.escapeBlocks[b + 1]; ++e)
+            std::tie(c.escapeOffsets[e], c.escapeValues[e]) = block[e - c.escapeBlocks[b]];
+    }
+}
@@ -6,6 +6,8 @@
 #include "genmap_helper.hpp"
 #include "indexing.hpp"
 #include "mappability.hpp"
+#include "query.hpp"
+#include "view.hpp"
 
 using namespace seqan;
 
@@ -56,9 +58,7 @@ int main(int const argc, char const ** argv)
     {
         using TSeqNo = uint64_t;
         using TSeqPos = uint64_t;
-        using TLocations = std::map<seqan::Pair<TSeqNo, TSeqPos>,
-                 std::pair<std::vector<seqan::Pair<TSeqNo, TSeqPos> >,
-                           std::vector<seqan::Pair<TSeqNo, TSeqPos> > > >;
+        using TLocations = KmerLocations<seqan::Pair<TSeqNo, TSeqPos> >;
         TLocations locations;
         return mappabilityMain<TLocations>(argc - until, argv + until, locations);
     }
@@ -66,6 +66,14 @@ int main(int const argc, char const ** argv)
     {
         return indexMain(argc - until, argv + until);
     }
+    else if (std::string(argv[until]) == "view")
+    {
+        return viewMain(argc - until, argv + until);
+    }
+    else if (std::string(argv[until]) == "query")
+    {
+        return queryMain(argc - until, argv + until);
+    }
     else
     {
         // should not be reached
@@ -87,11 +95,13 @@ ArgumentParser::ParseResult parseCommandLineMain(int const argc, char const ** a
 
     addArgument(parser, ArgParseArgument(ArgParseArgument::STRING, "COMMAND"));
     setHelpText(parser, 0, "The sub-program to execute. See below.");
-    setValidValues(parser, 0, "index map");
+    setValidValues(parser, 0, "index map view query");
 
     addTextSection(parser, "Available commands");
     addText(parser, "\\fBindex  \\fP– Creates an index for mappability computation.");
     addText(parser, "\\fBmap  \\fP– Computes the mappability (requires a pre-built index).");
+    addText(parser, "\\fBview  \\fP– Converts a binary locations file into a csv file.");
+    addText(parser, "\\fBquery  \\fP– Outputs the values of regions from a raw container file.");
     addText(parser, "To view the help page for a specific command, simply run 'genmap command --help'.");
 
     return parse(parser, argc, argv);
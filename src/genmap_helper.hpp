@@ -5,6 +5,8 @@
 #include <seqan/arg_parse.h>
 #include <seqan/index.h>
 
+#include "../include/lambda/src/mkindex_misc.hpp"
+
 using namespace seqan;
 
 void sharedSetup(ArgumentParser & parser)
@@ -92,7 +94,7 @@ inline bool open(Index<TText, BidirectionalIndex<FMIndex<TSpec, TConfig> > > & i
     if (!open(getFibre(index.rev, FibreLF()), toCString(name), openMode)) return false;
 
     name = fileName;    append(name, ".sa.len");
-    if (!seqan::open(index.rev.sa.sparseString._length, toCString(name), openMode)) return false;
+    if (!seqan::open(sparseSuffixArrayLength(index.rev.sa), toCString(name), openMode)) return false;
 
     setFibre(getFibre(index.rev, FibreSA()), getFibre(index.rev, FibreLF()), FibreLF());
 
@@ -122,26 +122,24 @@ template <typename TDistance, typename value_type, bool csvComputation, typename
           typename TIndex, typename TText, typename TChromosomeNames, typename TChromosomeLengths, typename TDirectoryInformation>
 inline void run(TIndex & index, TText const & text, Options const & opt, SearchParams const & searchParams,
                 std::string const & fastaFile, TChromosomeNames const & chromNames, TChromosomeLengths const & chromLengths,
-                TDirectoryInformation const & directoryInformation, std::vector<TSeqNo> const & mappingSeqIdFile)
+                TDirectoryInformation const & directoryInformation, FastaFileIds const & fileIds)
 {
     std::vector<value_type> c(length(text), 0);
 
-    std::map<Pair<TSeqNo, TSeqPos>,
-             std::pair<std::vector<Pair<TSeqNo, TSeqPos> >,
-                       std::vector<Pair<TSeqNo, TSeqPos> > > > locations;
+    KmerLocations<Pair<TSeqNo, TSeqPos> > locations;
 
     double start = get_wall_time();
     switch (opt.errors)
     {
-        case 0:  computeMappability<0, csvComputation>(index, text, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 0:  computeMappability<0, csvComputation, false>(index, text, c, searchParams, opt.directory, chromLengths, locations, fileIds);
                  break;
-        case 1:  computeMappability<1, csvComputation>(index, text, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 1:  computeMappability<1, csvComputation, false>(index, text, c, searchParams, opt.directory, chromLengths, locations, fileIds);
                  break;
-        case 2:  computeMappability<2, csvComputation>(index, text, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 2:  computeMappability<2, csvComputation, false>(index, text, c, searchParams, opt.directory, chromLengths, locations, fileIds);
                  break;
-        case 3:  computeMappability<3, csvComputation>(index, text, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 3:  computeMappability<3, csvComputation, false>(index, text, c, searchParams, opt.directory, chromLengths, locations, fileIds);
                  break;
-        case 4:  computeMappability<4, csvComputation>(index, text, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 4:  computeMappability<4, csvComputation, false>(index, text, c, searchParams, opt.directory, chromLengths, locations, fileIds);
                  break;
         default: std::cerr << "E > 4 not yet supported.\n";
                  exit(1);
@@ -177,9 +175,10 @@ inline void run(Options const & opt, SearchParams const & searchParams)
     appendValue(directoryInformation, "dummy.entry;0;chromosomename"); // dummy entry enforces that the mappability is
                                                                        // computed for the last file in the while loop.
 
-    std::vector<TSeqNo> mappingSeqIdFile(length(directoryInformation) - 1);
+    FastaFileIds fileIds;
     if (searchParams.excludePseudo)
     {
+        std::vector<TSeqNo> mappingSeqIdFile(length(directoryInformation) - 1);
         uint64_t fastaId = 0;
         std::string fastaFile = std::get<0>(retrieveDirectoryInformationLine(directoryInformation[0]));
         for (uint64_t i = 0; i < length(directoryInformation) - 1; ++i)
@@ -192,6 +191,7 @@ inline void run(Options const & opt, SearchParams const & searchParams)
             }
             mappingSeqIdFile[i] = fastaId;
         }
+        computeFastaFileIds(fileIds, index, mappingSeqIdFile, searchParams.threads);
     }
 
     auto const & text = indexText(index);
@@ -206,7 +206,7 @@ inline void run(Options const & opt, SearchParams const & searchParams)
         if (std::get<0>(row) != fastaFile)
         {
             auto const & fastaInfix = infixWithLength(text.concat, startPos, fastaFileLength);
-            run<TDistance, value_type, csvComputation, TSeqNo, TSeqPos>(index, fastaInfix, opt, searchParams, fastaFile, chromosomeNames, chromosomeLengths, directoryInformation, mappingSeqIdFile);
+            run<TDistance, value_type, csvComputation, TSeqNo, TSeqPos>(index, fastaInfix, opt, searchParams, fastaFile, chromosomeNames, chromosomeLengths, directoryInformation, fileIds);
 
             startPos += fastaFileLength;
             fastaFile = std::get<0>(row);
@@ -239,7 +239,7 @@ inline void run(Options const & opt, SearchParams const & searchParams)
 template <typename TChar, typename TAllocConfig, typename TDistance, typename TValue>
 inline void run(Options const & opt, SearchParams const & searchParams)
 {
-    if (opt.csvFile || searchParams.excludePseudo) // compute csv output when --exclude-pseudo, but don't output!
+    if (opt.csvFile)
         run<TChar, TAllocConfig, TDistance, TValue, true>(opt, searchParams);
     else
         run<TChar, TAllocConfig, TDistance, TValue, false>(opt, searchParams);
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <cstdint>
 #include <filesystem>
 #include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
 #include <sys/stat.h>
+#include <type_traits>
 #include <vector>
 
 #include <seqan/arg_parse.h>
@@ -17,40 +24,125 @@
 #include "common.hpp"
 #include "algo.hpp"
 #include "output.hpp"
+#include "bigwig.hpp"
+#include "statistics.hpp"
 
-template <typename TVector, typename TChromosomeNames, typename TChromosomeLengths, typename TLocations, typename TDirectoryInformation>
-inline void outputMappability(TVector const & c, Options const & opt, SearchParams const & searchParams,
-                              std::string const & fastaFile, TChromosomeNames const & chromNames,
-                              TChromosomeLengths const & chromLengths, TLocations & locations,
-                              TDirectoryInformation const & directoryInformation)
+inline std::string getOutputPath(Options const & opt, std::string const & fastaFile)
 {
-    std::cout << "Start writing output files ...";
-    if (opt.verbose)
-        std::cout << '\n' << std::flush;
-
     std::string output_path = std::string(toCString(opt.outputPath));
     output_path += fastaFile.substr(0, fastaFile.find_last_of('.')) + ".genmap";
+    return output_path;
+}
+
+// Output paths of the files of each sequence (--split-by-sequence), i.e., the output path followed by the fasta id of
+// the sequence. Characters other than letters, digits, '.', '-' and '_' are replaced by '_', the number of the
+// sequence is appended to ids that are not unique (repeatedly if the result is the id of another sequence). The paths
+// have to be computed from all sequences of the fasta file, i.e., not per chunk.
+template <typename TChromosomeNames>
+inline std::vector<std::string> getSequenceOutputPaths(std::string const & output_path, TChromosomeNames const & chromNames)
+{
+    std::vector<std::string> ids(length(chromNames));
+    std::map<std::string, uint64_t> idCount;
+    for (uint64_t i = 0; i < ids.size(); ++i)
+    {
+        std::string const name = genmap::detail::formatName(chromNames[i]);
+        ids[i] = name.substr(0, name.find_first_of(" \t"));
+        for (char & c : ids[i])
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-' && c != '_')
+                c = '_';
+        ++idCount[ids[i]];
+    }
+
+    std::set<std::string> used; // unique ids and assigned ids
+    for (auto const & [id, count] : idCount)
+        if (count == 1)
+            used.insert(id);
+
+    std::vector<std::string> paths(ids.size());
+    for (uint64_t i = 0; i < ids.size(); ++i)
+    {
+        if (idCount[ids[i]] > 1)
+        {
+            do
+                ids[i] += '_' + std::to_string(i);
+            while (!used.insert(ids[i]).second);
+        }
+        paths[i] = output_path + '.' + ids[i];
+    }
+    return paths;
+}
+
+// Writes the frequency based output files (raw, raw container, txt, wig, bed, bedGraph, mask bed, bins, bigWig). In the chunked mode the files
+// are appended (the raw container, bigWig and compressed files support the chunked mode only with --split-by-sequence).
+// With --split-by-sequence the files of each sequence are written separately and in parallel (one thread per file) to
+// sequencePaths (one path per sequence of chromNames, see getSequenceOutputPaths).
+template <typename TVector, typename TChromosomeNames, typename TChromosomeLengths>
+inline void outputFrequencies(TVector const & c, Options const & opt, SearchParams const & searchParams,
+                              std::string const & output_path, TChromosomeNames const & chromNames,
+                              TChromosomeLengths const & chromLengths, bool const append,
+                              std::vector<std::string> const & sequencePaths)
+{
+    if (opt.splitBySequence)
+    {
+        double start = get_wall_time();
+        Options sequenceOpt = opt;
+        sequenceOpt.splitBySequence = false;
+        sequenceOpt.verbose = false;
+        SearchParams sequenceParams = searchParams;
+        sequenceParams.threads = 1;
+
+        std::vector<uint64_t> offsets(1, 0);
+        for (uint64_t i = 0; i < length(chromLengths); ++i)
+            offsets.push_back(offsets.back() + chromLengths[i]);
+
+        // each sequence is written in its own files, i.e., nothing is appended in the chunked mode
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(searchParams.threads)
+        for (uint64_t i = 0; i < length(chromLengths); ++i)
+        {
+            TChromosomeNames sequenceNames;
+            TChromosomeLengths sequenceLengths;
+            appendValue(sequenceNames, chromNames[i]);
+            appendValue(sequenceLengths, chromLengths[i]);
+            outputFrequencies(sliceFrequencies(c, offsets[i], chromLengths[i]), sequenceOpt, sequenceParams,
+                              sequencePaths[i], sequenceNames, sequenceLengths, false, {});
+        }
 
-    if (opt.rawFile)
+        if (opt.verbose)
+            std::cout << "- Files of " << length(chromLengths) << " sequences written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
+        return;
+    }
+
+    if (opt.rawFile && !opt.rawMmap) // otherwise the raw file has been written during the computation
     {
         double start = get_wall_time();
         if (opt.outputType == OutputType::mappability)
-            saveRaw<true>(c, output_path + ".map");
+            saveRaw<true>(c, output_path + ".map", append);
         else if (opt.outputType == OutputType::frequency_small)
-            saveRaw<false>(c, output_path + ".freq8");
+            saveRaw<false>(c, output_path + ".freq8", append);
         else // if (opt.outputType == OutputType::frequency_large)
-            saveRaw<false>(c, output_path + ".freq16");
+            saveRaw<false>(c, output_path + ".freq16", append);
         if (opt.verbose)
             std::cout << "- RAW file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
     }
 
+    if (opt.rawContainer)
+    {
+        double start = get_wall_time();
+        if (opt.outputType == OutputType::mappability)
+            saveRawContainer<true>(c, output_path, chromNames, chromLengths, searchParams, opt.errors, opt.indels);
+        else
+            saveRawContainer<false>(c, output_path, chromNames, chromLengths, searchParams, opt.errors, opt.indels);
+        if (opt.verbose)
+            std::cout << "- Raw container file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
+    }
+
     if (opt.txtFile)
     {
         double start = get_wall_time();
         if (opt.outputType == OutputType::mappability)
-            saveTxt<true>(c, output_path, chromNames, chromLengths);
+            saveTxt<true>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
         if (opt.outputType == OutputType::frequency_small || opt.outputType == OutputType::frequency_large)
-            saveTxt<false>(c, output_path, chromNames, chromLengths);
+            saveTxt<false>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
         if (opt.verbose)
             std::cout << "- TXT file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
     }
@@ -58,10 +150,14 @@ inline void outputMappability(TVector const & c, Options const & opt, SearchPara
     if (opt.wigFile)
     {
         double start = get_wall_time();
-        if (opt.outputType == OutputType::mappability)
-            saveWig<true>(c, output_path, chromNames, chromLengths);
+        if (opt.wigAdaptive && opt.outputType == OutputType::mappability)
+            saveAdaptiveWig<true>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
+        else if (opt.wigAdaptive)
+            saveAdaptiveWig<false>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
+        else if (opt.outputType == OutputType::mappability)
+            saveWig<true>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
         else
-            saveWig<false>(c, output_path, chromNames, chromLengths);
+            saveWig<false>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
         if (opt.verbose)
             std::cout << "- WIG file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
     }
@@ -70,44 +166,116 @@ inline void outputMappability(TVector const & c, Options const & opt, SearchPara
     {
         double start = get_wall_time();
         if (opt.outputType == OutputType::mappability)
-            saveBed<true>(c, output_path, chromNames, chromLengths);
+            saveBed<true>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
         else
-            saveBed<false>(c, output_path, chromNames, chromLengths);
+            saveBed<false>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
         if (opt.verbose)
             std::cout << "- BED file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
     }
 
+    if (opt.bedGraphFile)
+    {
+        double start = get_wall_time();
+        if (opt.outputType == OutputType::mappability)
+            saveBedGraph<true>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
+        else
+            saveBedGraph<false>(c, output_path, chromNames, chromLengths, append, searchParams.threads, opt.compress);
+        if (opt.verbose)
+            std::cout << "- BedGraph file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
+    }
+
+    if (opt.maskBedFile)
+    {
+        double start = get_wall_time();
+        saveMaskBed(c, output_path, chromNames, chromLengths, opt.maskMinMappability, append, searchParams.threads, opt.compress);
+        if (opt.verbose)
+            std::cout << "- Mask BED file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
+    }
+
+    for (uint64_t const binSize : opt.bins)
+    {
+        double start = get_wall_time();
+        if (opt.outputType == OutputType::mappability)
+            saveBins<true>(c, output_path, chromNames, chromLengths, binSize, append, searchParams.threads, opt.compress);
+        else
+            saveBins<false>(c, output_path, chromNames, chromLengths, binSize, append, searchParams.threads, opt.compress);
+        if (opt.verbose)
+            std::cout << "- Bins (" << binSize << ") file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
+    }
+
+    if (opt.bigwigFile)
+    {
+        double start = get_wall_time();
+        if (opt.outputType == OutputType::mappability)
+            saveBigWig<true>(c, output_path, chromNames, chromLengths, searchParams.threads);
+        else
+            saveBigWig<false>(c, output_path, chromNames, chromLengths, searchParams.threads);
+        if (opt.verbose)
+            std::cout << "- BigWig file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
+    }
+}
+
+// Writes the location based output files (csv, loc).
+template <typename TChromosomeLengths, typename TLocations, typename TDirectoryInformation>
+inline void outputLocations(Options const & opt, SearchParams const & searchParams, std::string const & output_path,
+                            TChromosomeLengths const & chromLengths, TLocations & locations,
+                            TDirectoryInformation const & directoryInformation)
+{
     if (opt.csvFile)
     {
         double start = get_wall_time();
         if (opt.outputType == OutputType::mappability)
-            saveCsv<true>(output_path, locations, searchParams, directoryInformation);
+            saveCsv<true>(output_path, locations, searchParams, chromLengths, directoryInformation);
         else
-            saveCsv<false>(output_path, locations, searchParams, directoryInformation);
+            saveCsv<false>(output_path, locations, searchParams, chromLengths, directoryInformation);
         if (opt.verbose)
             std::cout << "- CSV file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
     }
 
+    if (opt.locFile)
+    {
+        double start = get_wall_time();
+        saveLocations(output_path, locations, searchParams, chromLengths, directoryInformation);
+        if (opt.verbose)
+            std::cout << "- Locations file written in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
+    }
+}
+
+template <typename TVector, typename TChromosomeNames, typename TChromosomeLengths, typename TLocations, typename TDirectoryInformation>
+inline void outputMappability(TVector const & c, Options const & opt, SearchParams const & searchParams,
+                              std::string const & fastaFile, TChromosomeNames const & chromNames,
+                              TChromosomeLengths const & chromLengths, TLocations & locations,
+                              TDirectoryInformation const & directoryInformation)
+{
+    std::cout << "Start writing output files ...";
+    if (opt.verbose)
+        std::cout << '\n' << std::flush;
+
+    std::string const output_path = getOutputPath(opt, fastaFile);
+    std::vector<std::string> const sequencePaths = opt.splitBySequence ? getSequenceOutputPaths(output_path, chromNames)
+                                                                       : std::vector<std::string>();
+    outputFrequencies(c, opt, searchParams, output_path, chromNames, chromLengths, false, sequencePaths);
+    outputLocations(opt, searchParams, output_path, chromLengths, locations, directoryInformation);
+
     if (!opt.verbose)
         std::cout << " done!\n";
 }
 
-template <typename TLocations, typename TDistance, typename value_type, bool csvComputation, typename TSeqNo, typename TSeqPos, typename TIndex, typename TText, typename TChromosomeNames, typename TChromosomeLengths, typename TDirectoryInformation>
-inline void run7(TLocations & locations, TIndex & index, TText const & fastaInfix, Options const & opt, SearchParams const & searchParams, std::string const & fastaFile, TChromosomeNames const & chromNames, TChromosomeLengths const & chromLengths, TDirectoryInformation const & directoryInformation, std::vector<TSeqNo> const & mappingSeqIdFile)
+template <bool csvComputation, bool excludePseudo, typename TContainer, typename TIndex, typename TText, typename TChromosomeLengths, typename TLocations>
+inline void computeFrequencies(TContainer & c, TIndex & index, TText const & fastaInfix, Options const & opt, SearchParams const & searchParams, TChromosomeLengths const & chromLengths, TLocations & locations, FastaFileIds const & fileIds, FrequencyChunk const & chunk)
 {
-    std::vector<value_type> c(length(fastaInfix), 0);
     double start = get_wall_time();
     switch (opt.errors)
     {
-        case 0:  computeMappability<0, csvComputation>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 0:  computeMappability<0, csvComputation, excludePseudo>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, fileIds, chunk);
                  break;
-        case 1:  computeMappability<1, csvComputation>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 1:  computeMappability<1, csvComputation, excludePseudo>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, fileIds, chunk);
                  break;
-        case 2:  computeMappability<2, csvComputation>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 2:  computeMappability<2, csvComputation, excludePseudo>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, fileIds, chunk);
                  break;
-        case 3:  computeMappability<3, csvComputation>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 3:  computeMappability<3, csvComputation, excludePseudo>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, fileIds, chunk);
                  break;
-        case 4:  computeMappability<4, csvComputation>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, mappingSeqIdFile);
+        case 4:  computeMappability<4, csvComputation, excludePseudo>(index, fastaInfix, c, searchParams, opt.directory, chromLengths, locations, fileIds, chunk);
                  break;
         default: std::cerr << "E > 4 not yet supported.\n";
                  exit(1);
@@ -120,11 +288,125 @@ inline void run7(TLocations & locations, TIndex & index, TText const & fastaInfi
 
     if (opt.verbose)
         std::cout << "Mappability computed in " << (round((get_wall_time() - start) * 100.0) / 100.0) << " seconds\n";
+}
+
+template <typename TLocations, typename TDistance, typename value_type, bool csvComputation, bool excludePseudo, typename TIndex, typename TText, typename TChromosomeNames, typename TChromosomeLengths, typename TDirectoryInformation>
+inline void run7(TLocations & locations, TIndex & index, TText const & fastaInfix, Options const & opt, SearchParams const & searchParams, std::string const & fastaFile, TChromosomeNames const & chromNames, TChromosomeLengths const & chromLengths, TDirectoryInformation const & directoryInformation, FastaFileIds const & fileIds)
+{
+    // 16 bit frequencies are stored with one byte per position (and an escape table for frequencies >= 255).
+    typedef std::conditional_t<sizeof(value_type) == 1, std::vector<value_type>, CompactFrequencies<value_type> > TFrequencies;
+
+    // With --raw-mmap the frequencies are computed directly into the memory-mapped raw output file.
+    if (opt.rawMmap)
+    {
+        MappedFrequencies<value_type> c;
+        c.path = getOutputPath(opt, fastaFile) + ((opt.outputType == OutputType::frequency_small) ? ".freq8" : ".freq16");
+        initFrequencies(c, length(fastaInfix), searchParams.threads);
+        computeFrequencies<csvComputation, excludePseudo>(c, index, fastaInfix, opt, searchParams, chromLengths, locations, fileIds, FrequencyChunk());
+        if (opt.statisticsFile)
+        {
+            std::vector<SequenceStatistics> stats;
+            computeStatistics(stats, c, chromLengths, 0, length(chromLengths), searchParams.length, searchParams.threads);
+            saveStatistics(stats, getOutputPath(opt, fastaFile), chromNames);
+        }
+        outputMappability(c, opt, searchParams, fastaFile, chromNames, chromLengths, locations, directoryInformation);
+
+        SEQAN_IF_CONSTEXPR (csvComputation)
+            locations.clear();
+        return;
+    }
+
+    // In the chunked mode (--chunk-size) the frequency vector only covers a range of consecutive sequences at once.
+    // Each chunk contains at least one entire sequence.
+    uint64_t const maxChunkLength = (opt.chunkSize == 0) ? length(fastaInfix) : std::max<uint64_t>(1, opt.chunkSize);
+    std::vector<uint64_t> chunkSeqs(1, 0); // first sequence of each chunk
+    std::string const outputPath = getOutputPath(opt, fastaFile);
+    SpillFiles spill;
+    spill.chunkBegins.push_back(0);
+    {
+        uint64_t chunkLength = 0;
+        for (uint64_t i = 0; i < length(chromLengths); ++i)
+        {
+            if (chunkLength > 0 && chunkLength + chromLengths[i] > maxChunkLength)
+            {
+                chunkSeqs.push_back(i);
+                spill.chunkBegins.push_back(spill.chunkBegins.back() + chunkLength);
+                chunkLength = 0;
+            }
+            chunkLength += chromLengths[i];
+        }
+        chunkSeqs.push_back(length(chromLengths));
+        spill.chunkBegins.push_back(spill.chunkBegins.back() + chunkLength);
+    }
+    uint64_t const chunks = chunkSeqs.size() - 1;
+    if (chunks > 1)
+        createSpillFiles(spill, outputPath);
+    std::vector<std::string> const sequencePaths = (opt.splitBySequence && chunks > 1)
+                                                   ? getSequenceOutputPaths(outputPath, chromNames)
+                                                   : std::vector<std::string>();
+    std::vector<SequenceStatistics> stats; // of all chunks
+
+    for (uint64_t k = 0; k < chunks; ++k)
+    {
+        FrequencyChunk chunk;
+        chunk.firstSeq = chunkSeqs[k];
+        chunk.lastSeq = chunkSeqs[k + 1];
+        chunk.id = k;
+        chunk.spill = (chunks > 1) ? &spill : nullptr;
 
-    outputMappability(c, opt, searchParams, fastaFile, chromNames, chromLengths, locations, directoryInformation);
+        if (opt.verbose && chunks > 1)
+            std::cout << "Chunk " << (k + 1) << " of " << chunks << " (sequences " << chunk.firstSeq << " to "
+                      << (chunk.lastSeq - 1) << ")\n";
+
+        TFrequencies c;
+        initFrequencies(c, spill.chunkBegins[k + 1] - spill.chunkBegins[k], searchParams.threads);
+        if (chunks > 1)
+            loadSpill(spill, k, c);
+
+        computeFrequencies<csvComputation, excludePseudo>(c, index, fastaInfix, opt, searchParams, chromLengths, locations, fileIds, chunk);
+
+        // statistics are computed while the frequencies of the chunk are still in memory
+        if (opt.statisticsFile)
+        {
+            computeStatistics(stats, c, chromLengths, chunk.firstSeq, chunk.lastSeq, searchParams.length, searchParams.threads);
+            if (k + 1 == chunks)
+                saveStatistics(stats, outputPath, chromNames);
+        }
+
+        if (chunks == 1)
+        {
+            outputMappability(c, opt, searchParams, fastaFile, chromNames, chromLengths, locations, directoryInformation);
+        }
+        else
+        {
+            TChromosomeNames chunkNames;
+            TChromosomeLengths chunkLengths;
+            for (uint64_t i = chunk.firstSeq; i < chunk.lastSeq; ++i)
+            {
+                appendValue(chunkNames, chromNames[i]);
+                appendValue(chunkLengths, chromLengths[i]);
+            }
+
+            std::cout << "Start writing output files ...";
+            if (opt.verbose)
+                std::cout << '\n' << std::flush;
+            std::vector<std::string> chunkPaths;
+            if (opt.splitBySequence)
+                chunkPaths.assign(sequencePaths.begin() + chunk.firstSeq, sequencePaths.begin() + chunk.lastSeq);
+            outputFrequencies(c, opt, searchParams, outputPath, chunkNames, chunkLengths, k > 0, chunkPaths);
+            if (k + 1 == chunks)
+                outputLocations(opt, searchParams, outputPath, chromLengths, locations, directoryInformation);
+            if (!opt.verbose)
+                std::cout << " done!\n";
+        }
+    }
+
+    // locations are only valid for the current fasta file
+    SEQAN_IF_CONSTEXPR (csvComputation)
+        locations.clear();
 }
 
-template <typename TLocations, typename TChar, typename TAllocConfig, typename TDistance, typename value_type, bool csvComputation,
+template <typename TLocations, typename TChar, typename TAllocConfig, typename TDistance, typename value_type, bool csvComputation, bool excludePseudo,
           typename TSeqNo, typename TSeqPos, typename TBWTLen>
 inline void run6(TLocations & locations, Options const & opt, SearchParams const & searchParams)
 {
@@ -146,9 +428,10 @@ inline void run6(TLocations & locations, Options const & opt, SearchParams const
     appendValue(directoryInformation, "dummy.entry;0;chromosomename"); // dummy entry enforces that the mappability is
                                                                        // computed for the last file in the while loop.
 
-    std::vector<TSeqNo> mappingSeqIdFile(length(directoryInformation) - 1);
-    if (searchParams.excludePseudo)
+    FastaFileIds fileIds;
+    SEQAN_IF_CONSTEXPR (excludePseudo)
     {
+        std::vector<TSeqNo> mappingSeqIdFile(length(directoryInformation) - 1);
         uint64_t fastaId = 0;
         std::string fastaFile = std::get<0>(retrieveDirectoryInformationLine(directoryInformation[0]));
         for (uint64_t i = 0; i < length(directoryInformation) - 1; ++i)
@@ -161,6 +444,9 @@ inline void run6(TLocations & locations, Options const & opt, SearchParams const
             }
             mappingSeqIdFile[i] = fastaId;
         }
+
+        // assign each row of the BWT to its fasta file once, s.t. k-mers do not have to be located for --exclude-pseudo
+        computeFastaFileIds(fileIds, index, mappingSeqIdFile, searchParams.threads);
     }
 
     auto const & text = indexText(index);
@@ -175,7 +461,7 @@ inline void run6(TLocations & locations, Options const & opt, SearchParams const
         if (std::get<0>(row) != fastaFile)
         {
             auto const & fastaInfix = infixWithLength(text.concat, startPos, fastaFileLength);
-            run7<TLocations, TDistance, value_type, csvComputation, TSeqNo, TSeqPos>(locations, index, fastaInfix, opt, searchParams, fastaFile, chromosomeNames, chromosomeLengths, directoryInformation, mappingSeqIdFile);
+            run7<TLocations, TDistance, value_type, csvComputation, excludePseudo>(locations, index, fastaInfix, opt, searchParams, fastaFile, chromosomeNames, chromosomeLengths, directoryInformation, fileIds);
 
             startPos += fastaFileLength;
             fastaFile = std::get<0>(row);
@@ -189,30 +475,39 @@ inline void run6(TLocations & locations, Options const & opt, SearchParams const
     }
 }
 
-template <typename TLocations, typename TChar, typename TAllocConfig, typename TDistance, typename TValue, bool csvComputation>
+template <typename TLocations, typename TChar, typename TAllocConfig, typename TDistance, typename TValue, bool csvComputation, bool excludePseudo>
 inline void run5(TLocations & locations, Options const & opt, SearchParams const & searchParams)
 {
     if (opt.seqNoWidth == 16 && opt.maxSeqLengthWidth == 32)
     {
         if (opt.totalLengthWidth == 32)
-            run6<TLocations, TChar, TAllocConfig, TDistance, TValue, csvComputation, uint16_t, uint32_t, uint32_t>(locations, opt, searchParams);
+            run6<TLocations, TChar, TAllocConfig, TDistance, TValue, csvComputation, excludePseudo, uint16_t, uint32_t, uint32_t>(locations, opt, searchParams);
         else if (opt.totalLengthWidth == 64)
-            run6<TLocations, TChar, TAllocConfig, TDistance, TValue, csvComputation, uint16_t, uint32_t, uint64_t>(locations, opt, searchParams);
+            run6<TLocations, TChar, TAllocConfig, TDistance, TValue, csvComputation, excludePseudo, uint16_t, uint32_t, uint64_t>(locations, opt, searchParams);
     }
     else if (opt.seqNoWidth == 32 && opt.maxSeqLengthWidth == 16 && opt.totalLengthWidth == 64)
-        run6<TLocations, TChar, TAllocConfig, TDistance, TValue, csvComputation, uint32_t, uint16_t, uint64_t>(locations, opt, searchParams);
+        run6<TLocations, TChar, TAllocConfig, TDistance, TValue, csvComputation, excludePseudo, uint32_t, uint16_t, uint64_t>(locations, opt, searchParams);
     else if (opt.seqNoWidth == 64 && opt.maxSeqLengthWidth == 64 && opt.totalLengthWidth == 64)
-        run6<TLocations, TChar, TAllocConfig, TDistance, TValue, csvComputation, uint64_t, uint64_t, uint64_t>(locations, opt, searchParams);
+        run6<TLocations, TChar, TAllocConfig, TDistance, TValue, csvComputation, excludePseudo, uint64_t, uint64_t, uint64_t>(locations, opt, searchParams);
 }
 
 template <typename TLocations, typename TChar, typename TAllocConfig, typename TDistance, typename TValue>
 inline void run4(TLocations & locations, Options const & opt, SearchParams const & searchParams)
 {
-    //std::cout << "excludePseudo = " << searchParams.excludePseudo << std::endl;
-    if (opt.csvFile || searchParams.excludePseudo) // compute csv output when --exclude-pseudo, but don't output!
-        run5<TLocations, TChar, TAllocConfig, TDistance, TValue, true>(locations, opt, searchParams);
+    if (opt.csvFile || opt.locFile)
+    {
+        if (searchParams.excludePseudo)
+            run5<TLocations, TChar, TAllocConfig, TDistance, TValue, true, true>(locations, opt, searchParams);
+        else
+            run5<TLocations, TChar, TAllocConfig, TDistance, TValue, true, false>(locations, opt, searchParams);
+    }
     else
-        run5<TLocations, TChar, TAllocConfig, TDistance, TValue, false>(locations, opt, searchParams);
+    {
+        if (searchParams.excludePseudo)
+            run5<TLocations, TChar, TAllocConfig, TDistance, TValue, false, true>(locations, opt, searchParams);
+        else
+            run5<TLocations, TChar, TAllocConfig, TDistance, TValue, false, false>(locations, opt, searchParams);
+    }
 }
 
 template <typename TLocations, typename TChar, typename TAllocConfig, typename TDistance>
@@ -279,24 +574,79 @@ int mappabilityMain(int argc, char const ** argv, TLocations & locations)
     addOption(parser, ArgParseOption("r", "raw",
         "Output raw files, i.e., the binary format of std::vector<T> with T = float, uint8_t or uint16_t (depending on whether -fs or -fl is set). For each fasta file that was indexed a separate file is created. File type is .map, .freq8 or .freq16."));
 
+    addOption(parser, ArgParseOption("rm", "raw-mmap",
+        "Computes the frequencies directly into the memory-mapped raw file (--raw with --frequency-small or --frequency-large), i.e., the raw file does not need to be written after the computation and contains the partial results if the computation is aborted."));
+
+    addOption(parser, ArgParseOption("rc", "raw-container",
+        "Output raw container files, i.e., the raw values with a header describing the computation (K, E, strand mode, value type) and the sequences (names, lengths and offsets). The values of each sequence are page-aligned such that regions can be retrieved directly with 'genmap query'. File type is .gmr."));
+
     addOption(parser, ArgParseOption("t", "txt",
         "Output human readable text files, i.e., the mappability respectively frequency values separated by spaces (depending on whether -fs or -fl is set). For each fasta file that was indexed a separate txt file is created. WARNING: This output is significantly larger that raw files."));
 
     addOption(parser, ArgParseOption("w", "wig",
         "Output wig files, e.g., for adding a custom feature track to genome browsers. For each fasta file that was indexed a separate wig file and chrom.size file is created."));
 
+    addOption(parser, ArgParseOption("wa", "wig-adaptive",
+        "Writes the wig files (--wig) with fixedStep or variableStep sections, whichever is smaller for each region, instead of variableStep only. Significantly reduces the file size if the values change often (e.g., in gene-dense regions). The blocks of the sequences are formatted in parallel."));
+
     addOption(parser, ArgParseOption("b", "bed",
         "Output bed files. For each fasta file that was indexed a separate bed-file is created."));
 
+    addOption(parser, ArgParseOption("bg", "bedgraph",
+        "Output bedGraph files, i.e., one line per run of equal values (0-based start, exclusive end). For each fasta file that was indexed a separate bedGraph file is created."));
+
+    addOption(parser, ArgParseOption("mb", "mask-bed",
+        "Output bed files of the merged intervals with a mappability of at least this value (independent of -fs and -fl), e.g., the regions to keep for masking. For each fasta file that was indexed a separate file is created. File type is .mask.bed.", ArgParseArgument::DOUBLE, "FLOAT"));
+    setMinValue(parser, "mask-bed", "0");
+    setMaxValue(parser, "mask-bed", "1");
+
+    addOption(parser, ArgParseOption("bn", "bins",
+        "Output binned summaries for a comma separated list of bin sizes (e.g., 1000,10000,100000), i.e., the mean, min and max value and the fraction of unique k-mers of each bin (k-mers containing an N are not counted). For each fasta file that was indexed and each bin size a separate tsv file is created. File type is .binsN.tsv.", ArgParseArgument::STRING, "LIST"));
+
+    addOption(parser, ArgParseOption("z", "compress",
+        "Compresses the txt, wig, bed, bedGraph, mask bed and bins files with BGZF (i.e., gzip compatible, file type is .gz) using all threads. For bed files a tabix index is created as well (.tbi, or .csi if a sequence is longer than 2^29)."));
+
+    addOption(parser, ArgParseOption("bw", "bigwig",
+        "Output bigWig files that can be loaded directly into genome browsers (no need to convert the wig file with wigToBigWig). For each fasta file that was indexed a separate bigWig file is created."));
+
     addOption(parser, ArgParseOption("d", "csv",
         "Output a detailed csv file reporting the locations of each k-mer (WARNING: This will produce large files and makes computing the mappability significantly slower)."));
 
+    addOption(parser, ArgParseOption("dl", "locations",
+        "Output a binary file reporting the locations of each k-mer, i.e., the same information as the csv file (--csv). It is significantly smaller and faster to write and can be converted to csv with 'genmap view'. File type is .loc."));
+
+    addOption(parser, ArgParseOption("dmin", "csv-min-frequency",
+        "Only reports the locations of k-mers with a frequency of at least this value in the csv file and locations file (--csv, --locations). Other k-mers are omitted and their locations are never computed.", ArgParseArgument::INT64, "INT"));
+    setMinValue(parser, "csv-min-frequency", "0");
+
+    addOption(parser, ArgParseOption("dmax", "csv-max-frequency",
+        "Only reports the locations of k-mers with a frequency of at most this value in the csv file and locations file (--csv, --locations). Other k-mers are omitted and their locations are never computed.", ArgParseArgument::INT64, "INT"));
+    setMinValue(parser, "csv-max-frequency", "0");
+
+    addOption(parser, ArgParseOption("cs", "chunk-size",
+        "Limits the memory of the frequency vector to approximately this many MB by computing and writing the mappability in chunks of consecutive sequences (each chunk contains at least one entire sequence, i.e., the memory is bounded by the length of the longest sequence). Frequencies of k-mers in subsequent chunks are stored temporarily in the output directory. Does not limit the memory of --csv and --locations. By default the entire fasta file is computed at once.", ArgParseArgument::INTEGER, "INT"));
+    setMinValue(parser, "chunk-size", "1");
+
+    addOption(parser, ArgParseOption("ss", "split-by-sequence",
+        "Writes the raw, raw container, txt, wig, bed, bedGraph, mask bed, bins and bigWig output into separate files for each sequence (named after the fasta id of the sequence) instead of one file per fasta file. The files are written in parallel. Does not apply to --csv, --locations and --statistics."));
+
+    addOption(parser, ArgParseOption("st", "statistics",
+        "Output a tsv file with statistics of each sequence (number of k-mers, unique k-mers, mean mappability and a histogram of the frequencies). It is computed while the frequencies are still in memory. For each fasta file that was indexed a separate file is created. File type is .stats.tsv."));
+
     addOption(parser, ArgParseOption("m", "memory-mapping",
         "Turns memory-mapping on, i.e. the index is not loaded into RAM but accessed directly from secondary-memory. This may increase the overall running time, but do NOT use it if the index lies on network storage."));
 
     addOption(parser, ArgParseOption("T", "threads", "Number of threads", ArgParseArgument::INTEGER, "INT"));
     setDefaultValue(parser, "threads", omp_get_max_threads());
 
+    addOption(parser, ArgParseOption("ob", "output-buffer-size",
+        "Size of each of the two output buffers of a file in MB. While one buffer is filled, the other one is written in the background.", ArgParseArgument::INTEGER, "INT"));
+    setMinValue(parser, "output-buffer-size", "1");
+    setDefaultValue(parser, "output-buffer-size", OUTPUT_BUFFER_SIZE >> 20);
+
+    addOption(parser, ArgParseOption("dio", "direct-io",
+        "Writes the output files with direct I/O (O_DIRECT), i.e., bypassing the page cache. This can increase the throughput on parallel file systems. Falls back to buffered I/O if not supported by the file system."));
+
     addOption(parser, ArgParseOption("v", "verbose", "Outputs some additional information."));
 
     addOption(parser, ArgParseOption("xo", "overlap", "Number of overlapping reads (xo + 1 Strings will be searched at once beginning with their overlap region). Default: K * (0.7^e * MIN(MAX(K,30),100) / 100)", ArgParseArgument::INTEGER, "INT"));
@@ -330,18 +680,133 @@ int mappabilityMain(int argc, char const ** argv, TLocations & locations)
     opt.mmap = isSet(parser, "memory-mapping");
     opt.indels = isSet(parser, "indels");
     opt.wigFile = isSet(parser, "wig");
+    opt.wigAdaptive = isSet(parser, "wig-adaptive");
     opt.bedFile = isSet(parser, "bed");
+    opt.bedGraphFile = isSet(parser, "bedgraph");
+    opt.maskBedFile = isSet(parser, "mask-bed");
+    opt.maskMinMappability = 0;
+    if (opt.maskBedFile)
+    {
+        double maskMinMappability;
+        getOptionValue(maskMinMappability, parser, "mask-bed");
+        opt.maskMinMappability = maskMinMappability;
+    }
     opt.rawFile = isSet(parser, "raw");
+    opt.rawMmap = isSet(parser, "raw-mmap");
+    opt.rawContainer = isSet(parser, "raw-container");
     opt.txtFile = isSet(parser, "txt");
+    opt.bigwigFile = isSet(parser, "bigwig");
+    opt.compress = isSet(parser, "compress");
     opt.csvFile = isSet(parser, "csv");
+    opt.locFile = isSet(parser, "locations");
+    opt.statisticsFile = isSet(parser, "statistics");
+    if (isSet(parser, "bins"))
+    {
+        std::string bins;
+        getOptionValue(bins, parser, "bins");
+        std::istringstream binStream(bins);
+        for (std::string binSize; std::getline(binStream, binSize, ',');)
+        {
+            if (binSize.empty() || binSize.find_first_not_of("0123456789") != std::string::npos || std::stoull(binSize) == 0)
+            {
+                std::cerr << "ERROR: --bins expects a comma separated list of positive bin sizes.\n";
+                return ArgumentParser::PARSE_ERROR;
+            }
+            opt.bins.push_back(std::stoull(binSize));
+        }
+        std::sort(opt.bins.begin(), opt.bins.end());
+        opt.bins.erase(std::unique(opt.bins.begin(), opt.bins.end()), opt.bins.end());
+    }
+    opt.splitBySequence = isSet(parser, "split-by-sequence");
     opt.verbose = isSet(parser, "verbose");
 
-    if (!opt.wigFile && !opt.bedFile && !opt.rawFile && !opt.txtFile && !opt.csvFile)
     {
-        std::cerr << "ERROR: Please choose at least one output format (i.e., --wig, --bed, --raw, --txt, --csv).\n";
+        unsigned outputBufferSizeMB;
+        getOptionValue(outputBufferSizeMB, parser, "output-buffer-size");
+        genmap::detail::OutputFileConfig::bufferSize = static_cast<uint64_t>(outputBufferSizeMB) << 20;
+        genmap::detail::OutputFileConfig::directIO = isSet(parser, "direct-io");
+    }
+
+    opt.chunkSize = 0;
+    if (isSet(parser, "chunk-size"))
+    {
+        unsigned chunkSizeMB;
+        getOptionValue(chunkSizeMB, parser, "chunk-size");
+        opt.chunkSize = static_cast<uint64_t>(chunkSizeMB) << 20;
+    }
+
+    if (!opt.wigFile && !opt.bedFile && !opt.bedGraphFile && !opt.maskBedFile && !opt.rawFile && !opt.rawContainer &&
+        !opt.txtFile && !opt.bigwigFile && !opt.csvFile && !opt.locFile && !opt.statisticsFile && opt.bins.empty())
+    {
+        std::cerr << "ERROR: Please choose at least one output format (i.e., --wig, --bed, --bedgraph, --mask-bed, --bins, --raw, --raw-container, --txt, --bigwig, --csv, --locations, --statistics).\n";
+        return ArgumentParser::PARSE_ERROR;
+    }
+
+    if (opt.wigAdaptive && !opt.wigFile)
+    {
+        std::cerr << "ERROR: --wig-adaptive can only be used with --wig.\n";
         return ArgumentParser::PARSE_ERROR;
     }
 
+    // with --split-by-sequence the files are never appended in the chunked mode
+    if (opt.rawContainer && opt.chunkSize > 0 && !opt.splitBySequence)
+    {
+        std::cerr << "ERROR: --raw-container cannot be combined with --chunk-size (unless --split-by-sequence is set). Please use --raw instead.\n";
+        return ArgumentParser::PARSE_ERROR;
+    }
+
+    if (opt.bigwigFile)
+    {
+#if !SEQAN_HAS_ZLIB
+        std::cerr << "ERROR: --bigwig requires zlib. Please build GenMap with zlib.\n";
+        return ArgumentParser::PARSE_ERROR;
+#endif
+        if (opt.chunkSize > 0 && !opt.splitBySequence)
+        {
+            std::cerr << "ERROR: --bigwig cannot be combined with --chunk-size (unless --split-by-sequence is set). Please use --wig instead.\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+    }
+
+    if (opt.compress)
+    {
+#if !SEQAN_HAS_ZLIB
+        std::cerr << "ERROR: --compress requires zlib. Please build GenMap with zlib.\n";
+        return ArgumentParser::PARSE_ERROR;
+#endif
+        if (!opt.txtFile && !opt.wigFile && !opt.bedFile && !opt.bedGraphFile && !opt.maskBedFile && opt.bins.empty())
+        {
+            std::cerr << "ERROR: --compress can only be used with --txt, --wig, --bed, --bedgraph, --mask-bed or --bins.\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+        if (opt.chunkSize > 0 && !opt.splitBySequence)
+        {
+            std::cerr << "ERROR: --compress cannot be combined with --chunk-size (unless --split-by-sequence is set).\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+    }
+
+    if (isSet(parser, "csv-min-frequency") || isSet(parser, "csv-max-frequency"))
+    {
+        if (!opt.csvFile && !opt.locFile)
+        {
+            std::cerr << "ERROR: --csv-min-frequency and --csv-max-frequency can only be used with --csv or --locations.\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+
+        int64_t csvMinFrequency = 0;
+        int64_t csvMaxFrequency = std::numeric_limits<int64_t>::max();
+        getOptionValue(csvMinFrequency, parser, "csv-min-frequency");
+        getOptionValue(csvMaxFrequency, parser, "csv-max-frequency");
+        if (csvMinFrequency > csvMaxFrequency)
+        {
+            std::cerr << "ERROR: --csv-min-frequency cannot be larger than --csv-max-frequency.\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+        searchParams.csvMinFrequency = csvMinFrequency;
+        searchParams.csvMaxFrequency = csvMaxFrequency;
+    }
+
     // store in temporary variables to avoid parsing arguments twice
     bool const isSetFS = isSet(parser, "frequency-small");
     bool const isSetFL = isSet(parser, "frequency-large");
@@ -359,6 +824,25 @@ int mappabilityMain(int argc, char const ** argv, TLocations & locations)
     else // default value
         opt.outputType = OutputType::mappability;
 
+    if (opt.rawMmap)
+    {
+        if (!opt.rawFile || opt.outputType == OutputType::mappability)
+        {
+            std::cerr << "ERROR: --raw-mmap can only be used with --raw and --frequency-small or --frequency-large.\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+        if (opt.splitBySequence)
+        {
+            std::cerr << "ERROR: --raw-mmap cannot be combined with --split-by-sequence.\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+        if (opt.chunkSize > 0)
+        {
+            std::cerr << "ERROR: --raw-mmap cannot be combined with --chunk-size.\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+    }
+
     getOptionValue(searchParams.length, parser, "length");
     getOptionValue(searchParams.threads, parser, "threads");
     searchParams.revCompl = isSet(parser, "reverse-complement");
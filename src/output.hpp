@@ -1,115 +1,293 @@
 #pragma once
 
-#include <vector>
-#include <string>
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bgzf.hpp"
+#include "frequencies.hpp"
+#include "outputfile.hpp"
 
-// TODO: investigate performance of buffer sizes (stack overflow might occur leading to a segmentation fault)
-#define     BUFFER_SIZE     32*1024 // 32 KB
+#define     RAW_BLOCK_SIZE      (1 << 20) // values converted and written at once by saveRaw
+#define     TEXT_BUFFER_SIZE    (1 << 20) // 1 MB, output buffer of the text writers
+#define     TEXT_BLOCK_SIZE     (1 << 18) // positions per block formatted (and compressed) at once by a thread (txt)
 
 using namespace seqan;
 
-template <bool mappability, typename T>
-void saveRaw(std::vector<T> const & c, std::string const & output_path)
+namespace genmap::detail
 {
-    char buffer[BUFFER_SIZE];
-    std::ofstream outfile(output_path, std::ios::out | std::ios::binary);
-    outfile.rdbuf()->pubsetbuf(buffer, BUFFER_SIZE);
 
-    SEQAN_IF_CONSTEXPR (mappability)
+// The text writers format numbers with std::to_chars into their own buffers, i.e., without the locale and the virtual
+// calls of std::ostream for every value. Floats are formatted in the general format with 6 significant digits which is
+// identical to the default formatting of std::ostream.
+template <typename TInteger>
+inline void appendInteger(std::string & buffer, TInteger const value)
+{
+    char chars[24];
+    buffer.append(chars, std::to_chars(chars, chars + sizeof(chars), value).ptr);
+}
+
+inline void appendFloat(std::string & buffer, float const value)
+{
+    char chars[32];
+#if __cpp_lib_to_chars >= 201611L
+    buffer.append(chars, std::to_chars(chars, chars + sizeof(chars), value, std::chars_format::general, 6).ptr);
+#else
+    buffer.append(chars, std::snprintf(chars, sizeof(chars), "%g", value));
+#endif
+}
+
+// Lookup table of the formatted mappability values 1/v (0 for v = 0) for all frequencies v of type T.
+template <typename T>
+inline std::vector<std::string> const & mappabilityStrings()
+{
+    static std::vector<std::string> const table = [] ()
     {
-        for (T const v : c)
-        {
-            float const f = (v != 0) ? 1.0f / static_cast<float>(v) : 0;
-            outfile.write(reinterpret_cast<const char*>(&f), sizeof(float));
-        }
+        std::vector<std::string> values(static_cast<uint64_t>(std::numeric_limits<T>::max()) + 1);
+        for (uint64_t v = 0; v < values.size(); ++v)
+            appendFloat(values[v], (v != 0) ? 1.0f / static_cast<float>(v) : 0);
+        return values;
+    }();
+    return table;
+}
+
+// Converts frequencies v to mappabilities 1/v (0 for v = 0). The loop is branch-free (0/1 for v = 0) such that the
+// compiler vectorizes it (a division is exact, unlike an approximated reciprocal).
+template <typename T>
+inline void toMappabilities(T const * __restrict__ values, uint64_t const n, float * __restrict__ mappabilities)
+{
+    for (uint64_t k = 0; k < n; ++k)
+    {
+        uint32_t const v = values[k];
+        mappabilities[k] = static_cast<float>(v != 0) / static_cast<float>(v + (v == 0));
     }
-    else
+}
+
+template <typename TName>
+inline std::string formatName(TName const & name)
+{
+    std::ostringstream stream;
+    stream << name;
+    return stream.str();
+}
+
+// Writes the values of [begin, begin + n) of c in the raw format. Values are decoded (and converted) block-wise and
+// each block is written at once, i.e., bypassing the stream buffer.
+template <bool mappability, typename TContainer>
+inline void writeRawValues(OutputFile & outfile, TContainer const & c, uint64_t const begin, uint64_t const n)
+{
+    typedef typename TContainer::value_type T;
+
+    uint64_t const blockSize = std::min<uint64_t>(n, RAW_BLOCK_SIZE);
+    std::vector<T> block(blockSize);
+    std::vector<float> converted(mappability ? blockSize : 0);
+    for (uint64_t i = begin; i < begin + n; i += blockSize)
     {
-        outfile.write((const char*) &c[0], c.size() * sizeof(T));
+        uint64_t const blockLength = std::min<uint64_t>(blockSize, begin + n - i);
+        getFrequencies(c, i, blockLength, block.data());
+
+        SEQAN_IF_CONSTEXPR (mappability)
+        {
+            toMappabilities(block.data(), blockLength, converted.data());
+            writeOutput(outfile, reinterpret_cast<const char*>(converted.data()), blockLength * sizeof(float));
+        }
+        else
+        {
+            writeOutput(outfile, reinterpret_cast<const char*>(block.data()), blockLength * sizeof(T));
+        }
     }
+}
 
-    outfile.close();
+} // namespace genmap::detail
+
+template <bool mappability, typename TContainer>
+void saveRaw(TContainer const & c, std::string const & output_path, bool const append = false)
+{
+    genmap::detail::OutputFile outfile;
+    genmap::detail::openOutputFile(outfile, output_path, append);
+    genmap::detail::writeRawValues<mappability>(outfile, c, 0, c.size());
+    genmap::detail::closeOutputFile(outfile);
 }
 
-template <bool mappability, typename T, typename TChromosomeNames, typename TChromosomeLengths>
-void saveTxt(std::vector<T> const & c, std::string const & output_path, TChromosomeNames const & chromNames, TChromosomeLengths const & chromLengths)
+template <bool mappability, typename TContainer, typename TChromosomeNames, typename TChromosomeLengths>
+void saveTxt(TContainer const & c, std::string const & output_path, TChromosomeNames const & chromNames, TChromosomeLengths const & chromLengths,
+             bool const append = false, unsigned const threads = 1, bool const compress = false)
 {
-    char buffer[BUFFER_SIZE];
-    std::ofstream outfile(output_path + ".txt", std::ios::out | std::ofstream::binary);
-    outfile.rdbuf()->pubsetbuf(buffer, BUFFER_SIZE);
+    using namespace genmap::detail;
+    typedef typename TContainer::value_type T;
+
+    TextFile outfile;
+    openTextFile(outfile, output_path + ".txt", append, compress, threads);
+    std::vector<std::string> const & mappabilityValues = mappabilityStrings<T>();
 
-    auto seqBegin = c.begin();
-    auto seqEnd = c.begin() + chromLengths[0];
+    std::vector<std::string> names(length(chromLengths));
+    std::vector<uint64_t> cumLengths(1, 0);
     for (uint64_t i = 0; i < length(chromLengths); ++i)
     {
-        outfile << '>' << chromNames[i] << '\n';
+        names[i] = formatName(chromNames[i]);
+        cumLengths.push_back(cumLengths.back() + chromLengths[i]);
+    }
 
-        SEQAN_IF_CONSTEXPR (mappability)
+    // the values are formatted (and compressed) in parallel in blocks of TEXT_BLOCK_SIZE positions (one buffer per
+    // thread) and written in order
+    std::vector<std::string> buffers(threads);
+    std::vector<BgzfBuffer> compressedBuffers(threads);
+    uint64_t const blocks = std::max<uint64_t>(1, (cumLengths.back() + TEXT_BLOCK_SIZE - 1) / TEXT_BLOCK_SIZE);
+    #pragma omp parallel for ordered schedule(dynamic, 1) num_threads(threads)
+    for (uint64_t b = 0; b < blocks; ++b)
+    {
+        std::string & buffer = buffers[omp_get_thread_num()];
+        buffer.clear();
+        uint64_t const blockBegin = b * TEXT_BLOCK_SIZE;
+        uint64_t const blockEnd = std::min<uint64_t>(blockBegin + TEXT_BLOCK_SIZE, cumLengths.back());
+
+        // empty sequences share their begin with the next sequence, a block starts with the first sequence that
+        // begins at blockBegin (if any)
+        uint64_t seqNo = std::lower_bound(cumLengths.begin(), cumLengths.end(), blockBegin) - cumLengths.begin();
+        if (cumLengths[seqNo] != blockBegin)
+            --seqNo;
+
+        // writes the headers of the sequences beginning at pos (empty sequences consist of their header and an empty line)
+        auto beginSequences = [&] (uint64_t const pos)
         {
-            for (auto it = seqBegin; it < seqEnd - 1; ++it)
+            for (; seqNo < names.size() && cumLengths[seqNo] == pos; ++seqNo)
             {
-                float const f = (*it != 0) ? 1.0f / static_cast<float>(*it) : 0;
-                outfile << f << ' ';
+                buffer += '>';
+                buffer += names[seqNo];
+                buffer += '\n';
+                if (cumLengths[seqNo + 1] != pos)
+                    break;
+                buffer += '\n';
             }
-            float const f = (*(seqEnd - 1) != 0) ? 1.0f / static_cast<float>(*(seqEnd - 1)) : 0;
-            outfile << f; // no space after last value
-        }
-        else
+        };
+
+        for (uint64_t pos = blockBegin; pos < blockEnd; ++pos)
         {
-            std::copy(seqBegin, seqEnd - 1, std::ostream_iterator<T>(outfile, " "));
-            outfile << *(seqEnd - 1); // no space after last value
+            beginSequences(pos);
+
+            T const v = getFrequency(c, pos);
+            SEQAN_IF_CONSTEXPR (mappability)
+                buffer += mappabilityValues[v];
+            else SEQAN_IF_CONSTEXPR (sizeof(T) == 1)
+                buffer += static_cast<char>(v); // std::ostream writes 8 bit values as characters
+            else
+                appendInteger(buffer, v);
+
+            if (pos + 1 == cumLengths[seqNo + 1])
+            {
+                buffer += '\n'; // no space after last value
+                ++seqNo;
+            }
+            else
+            {
+                buffer += ' ';
+            }
         }
-        outfile << '\n';
+        if (blockEnd == cumLengths.back())
+            beginSequences(blockEnd); // trailing empty sequences
 
-        if (i + 1 < length(chromLengths))
+        if (compress)
+            compressBgzf(compressedBuffers[omp_get_thread_num()], buffer, 1);
+
+        #pragma omp ordered
         {
-            seqBegin = seqEnd;
-            seqEnd += chromLengths[i + 1];
+            if (compress)
+                writeBgzf(outfile, compressedBuffers[omp_get_thread_num()]);
+            else
+                writeText(outfile, buffer);
         }
     }
-    outfile.close();
+    closeTextFile(outfile);
+}
+
+namespace genmap::detail
+{
+
+// .chrom.sizes file of the wig file (never compressed, wigToBigWig expects a plain text file)
+template <typename TChromosomeNames, typename TChromosomeLengths>
+inline void saveChromSizes(std::string const & output_path, TChromosomeNames const & chromNames,
+                           TChromosomeLengths const & chromLengths, bool const append)
+{
+    TextFile chromSizesFile;
+    openTextFile(chromSizesFile, output_path + ".chrom.sizes", append, false, 1);
+    std::string buffer;
+    for (uint64_t i = 0; i < length(chromLengths); ++i)
+    {
+        buffer += formatName(chromNames[i]);
+        buffer += '\t';
+        appendInteger(buffer, chromLengths[i]);
+        buffer += '\n';
+    }
+    writeText(chromSizesFile, buffer);
+    closeTextFile(chromSizesFile);
 }
 
-template <bool mappability, typename T, typename TChromosomeNames, typename TChromosomeLengths>
-void saveWig(std::vector<T> const & c, std::string const & output_path, TChromosomeNames const & chromNames, TChromosomeLengths const & chromLengths)
+} // namespace genmap::detail
+
+template <bool mappability, typename TContainer, typename TChromosomeNames, typename TChromosomeLengths>
+void saveWig(TContainer const & c, std::string const & output_path, TChromosomeNames const & chromNames, TChromosomeLengths const & chromLengths,
+             bool const append = false, unsigned const threads = 1, bool const compress = false)
 {
+    using namespace genmap::detail;
+    typedef typename TContainer::value_type T;
+
     uint64_t pos = 0;
     uint64_t begin_pos_string = 0;
     uint64_t end_pos_string = chromLengths[0];
 
-    char buffer[BUFFER_SIZE];
-
-    std::ofstream wigFile(output_path + ".wig");
-    wigFile.rdbuf()->pubsetbuf(buffer, BUFFER_SIZE);
+    TextFile wigFile;
+    openTextFile(wigFile, output_path + ".wig", append, compress, threads);
+    std::vector<std::string> const & mappabilityValues = mappabilityStrings<T>();
+    std::string buffer;
+    buffer.reserve(TEXT_BUFFER_SIZE);
 
     for (uint64_t i = 0; i < length(chromLengths); ++i)
     {
-        uint16_t current_val = c[pos];
+        std::string const chromName = formatName(chromNames[i]);
+        uint16_t current_val = getFrequency(c, pos);
         uint64_t occ = 0;
         uint64_t last_occ = 0;
 
         while (pos < end_pos_string + 1) // iterate once more to output the last line
         {
-            if (pos == end_pos_string || current_val != c[pos])
+            if (pos == end_pos_string || current_val != getFrequency(c, pos))
             {
                 if (last_occ != occ)
-                    wigFile << "variableStep chrom=" << chromNames[i] << " span=" << occ << '\n';
-                // TODO: document this behavior (mappability of 0)
-                SEQAN_IF_CONSTEXPR (mappability)
                 {
-                    float const value = (current_val != 0) ? 1.0f / static_cast<float>(current_val) : 0;
-                    wigFile << (pos - occ + 1 - begin_pos_string) << ' ' << value << '\n'; // pos in wig start at 1
+                    buffer += "variableStep chrom=";
+                    buffer += chromName;
+                    buffer += " span=";
+                    appendInteger(buffer, occ);
+                    buffer += '\n';
                 }
+                appendInteger(buffer, pos - occ + 1 - begin_pos_string); // pos in wig start at 1
+                buffer += ' ';
+                // TODO: document this behavior (mappability of 0)
+                SEQAN_IF_CONSTEXPR (mappability)
+                    buffer += mappabilityValues[current_val];
                 else
+                    appendInteger(buffer, current_val);
+                buffer += '\n';
+
+                if (buffer.size() >= TEXT_BUFFER_SIZE)
                 {
-                    wigFile << (pos - occ + 1 - begin_pos_string) << ' ' << current_val << '\n'; // pos in wig start at 1
+                    writeText(wigFile, buffer);
+                    buffer.clear();
                 }
 
                 last_occ = occ;
                 occ = 0;
                 if (pos < end_pos_string)
-                    current_val = c[pos];
+                    current_val = getFrequency(c, pos);
             }
 
             ++occ;
@@ -121,49 +299,98 @@ void saveWig(std::vector<T> const & c, std::string const & output_path, TChromos
         if (i + 1 < length(chromLengths))
             end_pos_string += chromLengths[i + 1];
     }
-    wigFile.close();
+    writeText(wigFile, buffer);
+    closeTextFile(wigFile);
 
-    // .chrom.sizes file
-    std::ofstream chromSizesFile(output_path + ".chrom.sizes");
-    for (uint64_t i = 0; i < length(chromLengths); ++i)
-        chromSizesFile << chromNames[i] << '\t' << chromLengths[i] << '\n';
-    chromSizesFile.close();
+    saveChromSizes(output_path, chromNames, chromLengths, append);
 }
 
-template <bool mappability, typename T, typename TChromosomeNames, typename TChromosomeLengths>
-void saveBed(std::vector<T> const & c, std::string const & output_path, TChromosomeNames const & chromNames, TChromosomeLengths const & chromLengths)
+// If compressed, the tabix index (.bed.gz.tbi or .bed.gz.csi) is created while writing the bed file.
+template <bool mappability, typename TContainer, typename TChromosomeNames, typename TChromosomeLengths>
+void saveBed(TContainer const & c, std::string const & output_path, TChromosomeNames const & chromNames, TChromosomeLengths const & chromLengths,
+             bool const append = false, unsigned const threads = 1, bool const compress = false)
 {
+    using namespace genmap::detail;
+    typedef typename TContainer::value_type T;
+
+    // record (sequence, begin, end as interpreted by tabix) and its uncompressed offsets in the file
+    struct TabixRecord
+    {
+        uint64_t seqNo, begin, end, offsetBegin, offsetEnd;
+    };
+
     uint64_t pos = 0;
     uint64_t begin_pos_string = 0;
     uint64_t end_pos_string = chromLengths[0];
 
-    char buffer[BUFFER_SIZE];
+    TextFile bedFile;
+    openTextFile(bedFile, output_path + ".bed", append, compress, threads);
+    std::vector<std::string> const & mappabilityValues = mappabilityStrings<T>();
+    std::string buffer;
+    buffer.reserve(TEXT_BUFFER_SIZE);
+
+    std::vector<std::string> names(length(chromLengths));
+    uint64_t maxLength = 0;
+    for (uint64_t i = 0; i < length(chromLengths); ++i)
+    {
+        names[i] = formatName(chromNames[i]);
+        maxLength = std::max<uint64_t>(maxLength, chromLengths[i]);
+    }
+
+    TabixIndex tabixIndex;
+    std::vector<TabixRecord> records; // records in buffer
+    if (compress)
+        initTabixIndex(tabixIndex, names, maxLength);
 
-    std::ofstream bedFile(output_path + ".bed");
-    bedFile.rdbuf()->pubsetbuf(buffer, BUFFER_SIZE);
+    auto flush = [&] ()
+    {
+        writeText(bedFile, buffer);
+        buffer.clear();
+        for (TabixRecord const & record : records)
+        {
+            addTabixRecord(tabixIndex, record.seqNo, record.begin, record.end,
+                           virtualOffset(bedFile, record.offsetBegin), virtualOffset(bedFile, record.offsetEnd));
+        }
+        records.clear();
+    };
 
     for (uint64_t i = 0; i < length(chromLengths); ++i)
     {
-        uint16_t current_val = c[pos];
+        uint16_t current_val = getFrequency(c, pos);
         uint64_t occ = 0;
 
         while (pos < end_pos_string + 1) // iterate once more to output the last line
         {
-            if (pos == end_pos_string || current_val != c[pos])
+            if (pos == end_pos_string || current_val != getFrequency(c, pos))
             {
-                bedFile << chromNames[i] << '\t'                    // chrom name
-                        << (pos - occ - begin_pos_string) << '\t'   // start pos (begins with 0)
-                        << (pos - begin_pos_string - 1) << '\t'     // end pos
-                        << '-' << '\t';                             // name
+                uint64_t const offsetBegin = bedFile.uncompressedOffset + buffer.size();
+
+                buffer += names[i];                                         // chrom name
+                buffer += '\t';
+                appendInteger(buffer, pos - occ - begin_pos_string);        // start pos (begins with 0)
+                buffer += '\t';
+                appendInteger(buffer, pos - begin_pos_string - 1);          // end pos
+                buffer += "\t-\t";                                          // name
 
                 SEQAN_IF_CONSTEXPR (mappability)
-                    bedFile << ((current_val != 0) ? 1.0f / static_cast<float>(current_val) : 0) << '\n';
+                    buffer += mappabilityValues[current_val];
                 else
-                    bedFile << current_val << '\n';
+                    appendInteger(buffer, current_val);
+                buffer += '\n';
+
+                if (compress) // tabix uses begin + 1 if the end column is not larger than the begin column
+                {
+                    uint64_t const begin = pos - occ - begin_pos_string;
+                    uint64_t const end = std::max(pos - begin_pos_string - 1, begin + 1);
+                    records.push_back({i, begin, end, offsetBegin, bedFile.uncompressedOffset + buffer.size()});
+                }
+
+                if (buffer.size() >= TEXT_BUFFER_SIZE)
+                    flush();
 
                 occ = 0;
                 if (pos < end_pos_string)
-                    current_val = c[pos];
+                    current_val = getFrequency(c, pos);
             }
 
             ++occ;
@@ -175,20 +402,494 @@ void saveBed(std::vector<T> const & c, std::string const & output_path, TChromos
         if (i + 1 < length(chromLengths))
             end_pos_string += chromLengths[i + 1];
     }
-    bedFile.close();
+    flush();
+    closeTextFile(bedFile);
+
+    if (compress)
+        saveTabixIndex(tabixIndex, output_path + ".bed.gz", threads);
+}
+
+namespace genmap::detail
+{
+
+// Writes the maximal runs of positions with equal keys key(v) of each sequence, e.g., for bedGraph files.
+// appendRun(buffer, seqNo, begin, end, key) formats a run [begin, end) (positions relative to the sequence). The
+// sequences are split into blocks of TEXT_BLOCK_SIZE positions that are formatted (and compressed) in parallel and
+// written in order. A block only outputs the runs starting in it, i.e., a run is merged across block boundaries by
+// scanning beyond the end of the block. finishBlock(buffer) is called after the last run of each block (e.g., for
+// writers that format all runs of a block at once).
+template <typename TContainer, typename TKey, typename TAppendRun, typename TFinishBlock>
+inline void writeRuns(TextFile & outfile, TContainer const & c, std::vector<uint64_t> const & chromLengths,
+                      unsigned const threads, bool const compress, TKey && key, TAppendRun && appendRun,
+                      TFinishBlock && finishBlock)
+{
+    struct Block
+    {
+        uint64_t seqNo, seqBegin, seqEnd, begin, end; // global positions
+    };
+
+    std::vector<Block> blocks;
+    uint64_t seqBegin = 0;
+    for (uint64_t i = 0; i < chromLengths.size(); ++i)
+    {
+        uint64_t const seqEnd = seqBegin + chromLengths[i];
+        for (uint64_t begin = seqBegin; begin < seqEnd; begin += TEXT_BLOCK_SIZE)
+            blocks.push_back({i, seqBegin, seqEnd, begin, std::min<uint64_t>(begin + TEXT_BLOCK_SIZE, seqEnd)});
+        seqBegin = seqEnd;
+    }
+
+    std::vector<std::string> buffers(threads);
+    std::vector<BgzfBuffer> compressedBuffers(threads);
+    #pragma omp parallel for ordered schedule(dynamic, 1) num_threads(threads)
+    for (uint64_t b = 0; b < blocks.size(); ++b)
+    {
+        Block const & block = blocks[b];
+        std::string & buffer = buffers[omp_get_thread_num()];
+        buffer.clear();
+
+        uint64_t pos = block.begin;
+        if (pos > block.seqBegin) // skip the run continued from the previous block
+        {
+            auto const prevKey = key(getFrequency(c, pos - 1));
+            while (pos < block.end && key(getFrequency(c, pos)) == prevKey)
+                ++pos;
+        }
+
+        while (pos < block.end)
+        {
+            uint64_t const runBegin = pos;
+            auto const runKey = key(getFrequency(c, pos));
+            while (++pos < block.seqEnd && key(getFrequency(c, pos)) == runKey)
+                ;
+            appendRun(buffer, block.seqNo, runBegin - block.seqBegin, pos - block.seqBegin, runKey);
+        }
+        finishBlock(buffer);
+
+        if (compress)
+            compressBgzf(compressedBuffers[omp_get_thread_num()], buffer, 1);
+
+        #pragma omp ordered
+        {
+            if (compress)
+                writeBgzf(outfile, compressedBuffers[omp_get_thread_num()]);
+            else
+                writeText(outfile, buffer);
+        }
+    }
+}
+
+template <typename TContainer, typename TKey, typename TAppendRun>
+inline void writeRuns(TextFile & outfile, TContainer const & c, std::vector<uint64_t> const & chromLengths,
+                      unsigned const threads, bool const compress, TKey && key, TAppendRun && appendRun)
+{
+    writeRuns(outfile, c, chromLengths, threads, compress, key, appendRun, [] (std::string & /*buffer*/) {});
+}
+
+inline uint64_t integerLength(uint64_t value)
+{
+    uint64_t length = 1;
+    for (; value >= 10; value /= 10)
+        ++length;
+    return length;
+}
+
+// Run of equal values of a sequence (0-based begin relative to the sequence) for the adaptive wig writer.
+struct WigRun
+{
+    uint64_t begin, length;
+    std::string const * value; // formatted value
+};
+
+// Formats consecutive runs of a sequence as wig. Each run is written either
+// - as a line of a variableStep section with span = run length (like saveWig()),
+// - as a single value of a fixedStep section with step = span = run length (consecutive runs of equal length), or
+// - as one value per position of a fixedStep section with step = span = 1 (consecutive short runs).
+// A run that cannot continue the section of the previous run starts a new section, i.e., costs a declaration line.
+// The modes of the runs are chosen by dynamic programming such that the encoding has the minimal number of bytes.
+inline void appendAdaptiveWig(std::string & buffer, std::string const & chromName, std::vector<WigRun> const & runs)
+{
+    enum WigMode : uint8_t { VARIABLE_STEP, FIXED_STEP, FIXED_STEP_1, WIG_MODES };
+
+    if (runs.empty())
+        return;
+
+    auto const step = [&runs] (uint64_t const i, unsigned const mode) -> uint64_t
+    {
+        return (mode == FIXED_STEP_1) ? 1 : runs[i].length;
+    };
+    // run i in mode continues the section of run i - 1 in prevMode (the runs are consecutive)
+    auto const continues = [&step] (uint64_t const i, unsigned const prevMode, unsigned const mode)
+    {
+        return (prevMode == VARIABLE_STEP) == (mode == VARIABLE_STEP) && step(i - 1, prevMode) == step(i, mode);
+    };
+    auto const declarationLength = [&] (uint64_t const i, unsigned const mode) -> uint64_t
+    {
+        uint64_t const stepLength = integerLength(step(i, mode));
+        if (mode == VARIABLE_STEP)
+            return sizeof("variableStep chrom= span=\n") - 1 + chromName.size() + stepLength;
+        return sizeof("fixedStep chrom= start= step= span=\n") - 1 + chromName.size() + integerLength(runs[i].begin + 1)
+             + 2 * stepLength;
+    };
+    auto const lineLength = [&runs] (uint64_t const i, unsigned const mode) -> uint64_t
+    {
+        uint64_t const valueLength = runs[i].value->size() + 1;
+        if (mode == VARIABLE_STEP)
+            return integerLength(runs[i].begin + 1) + 1 + valueLength;
+        return (mode == FIXED_STEP) ? valueLength : runs[i].length * valueLength;
+    };
+
+    // cost[mode]: minimal length of the runs [0, i] with run i in mode, prevModes[i][mode]: mode of run i - 1
+    std::vector<std::array<uint8_t, WIG_MODES> > prevModes(runs.size());
+    std::array<uint64_t, WIG_MODES> cost;
+    for (unsigned mode = 0; mode < WIG_MODES; ++mode)
+        cost[mode] = declarationLength(0, mode) + lineLength(0, mode);
+    for (uint64_t i = 1; i < runs.size(); ++i)
+    {
+        std::array<uint64_t, WIG_MODES> nextCost;
+        for (unsigned mode = 0; mode < WIG_MODES; ++mode)
+        {
+            uint64_t const declaration = declarationLength(i, mode);
+            nextCost[mode] = std::numeric_limits<uint64_t>::max();
+            for (unsigned prevMode = 0; prevMode < WIG_MODES; ++prevMode)
+            {
+                uint64_t const c = cost[prevMode] + (continues(i, prevMode, mode) ? 0 : declaration);
+                if (c < nextCost[mode])
+                {
+                    nextCost[mode] = c;
+                    prevModes[i][mode] = prevMode;
+                }
+            }
+            nextCost[mode] += lineLength(i, mode);
+        }
+        cost = nextCost;
+    }
+
+    std::vector<uint8_t> modes(runs.size());
+    modes.back() = std::min_element(cost.begin(), cost.end()) - cost.begin();
+    for (uint64_t i = runs.size() - 1; i > 0; --i)
+        modes[i - 1] = prevModes[i][modes[i]];
+
+    for (uint64_t i = 0; i < runs.size(); ++i)
+    {
+        unsigned const mode = modes[i];
+        if (i == 0 || !continues(i, modes[i - 1], mode))
+        {
+            if (mode == VARIABLE_STEP)
+            {
+                buffer += "variableStep chrom=";
+                buffer += chromName;
+            }
+            else
+            {
+                buffer += "fixedStep chrom=";
+                buffer += chromName;
+                buffer += " start=";
+                appendInteger(buffer, runs[i].begin + 1);
+                buffer += " step=";
+                appendInteger(buffer, step(i, mode));
+            }
+            buffer += " span=";
+            appendInteger(buffer, step(i, mode));
+            buffer += '\n';
+        }
+
+        if (mode == VARIABLE_STEP)
+        {
+            appendInteger(buffer, runs[i].begin + 1); // pos in wig start at 1
+            buffer += ' ';
+        }
+        for (uint64_t k = 0; k < ((mode == FIXED_STEP_1) ? runs[i].length : 1); ++k)
+        {
+            buffer += *runs[i].value;
+            buffer += '\n';
+        }
+    }
+}
+
+} // namespace genmap::detail
+
+// Wig file like saveWig(), but each block of TEXT_BLOCK_SIZE positions is encoded with variableStep and fixedStep
+// sections such that it has the minimal size (see appendAdaptiveWig()), e.g., fixedStep for regions where the values
+// change at almost every position. The blocks are formatted (and compressed) in parallel.
+template <bool mappability, typename TContainer, typename TChromosomeNames, typename TChromosomeLengths>
+void saveAdaptiveWig(TContainer const & c, std::string const & output_path, TChromosomeNames const & chromNames,
+                     TChromosomeLengths const & chromLengths, bool const append = false, unsigned const threads = 1,
+                     bool const compress = false)
+{
+    using namespace genmap::detail;
+    typedef typename TContainer::value_type T;
+
+    TextFile wigFile;
+    openTextFile(wigFile, output_path + ".wig", append, compress, threads);
+
+    std::vector<std::string> frequencyValues;
+    SEQAN_IF_CONSTEXPR (!mappability)
+    {
+        frequencyValues.resize(static_cast<uint64_t>(std::numeric_limits<T>::max()) + 1);
+        for (uint64_t v = 0; v < frequencyValues.size(); ++v)
+            appendInteger(frequencyValues[v], v);
+    }
+    std::vector<std::string> const & values = mappability ? mappabilityStrings<T>() : frequencyValues;
+
+    std::vector<std::string> names(length(chromLengths));
+    std::vector<uint64_t> lengths(length(chromLengths));
+    for (uint64_t i = 0; i < length(chromLengths); ++i)
+    {
+        names[i] = formatName(chromNames[i]);
+        lengths[i] = chromLengths[i];
+    }
+
+    // runs of the current block of each thread
+    std::vector<std::vector<WigRun> > runs(threads);
+    std::vector<uint64_t> runSeqNo(threads);
+    writeRuns(wigFile, c, lengths, threads, compress, [] (T const v) { return v; },
+              [&] (std::string & /*buffer*/, uint64_t const seqNo, uint64_t const begin, uint64_t const end, T const v)
+    {
+        runs[omp_get_thread_num()].push_back({begin, end - begin, &values[v]});
+        runSeqNo[omp_get_thread_num()] = seqNo;
+    },
+              [&] (std::string & buffer)
+    {
+        std::vector<WigRun> & blockRuns = runs[omp_get_thread_num()];
+        appendAdaptiveWig(buffer, names[runSeqNo[omp_get_thread_num()]], blockRuns);
+        blockRuns.clear();
+    });
+    closeTextFile(wigFile);
+
+    saveChromSizes(output_path, chromNames, chromLengths, append);
+}
+
+// bedGraph file with one line per run of equal values (0-based start, exclusive end).
+template <bool mappability, typename TContainer, typename TChromosomeNames, typename TChromosomeLengths>
+void saveBedGraph(TContainer const & c, std::string const & output_path, TChromosomeNames const & chromNames,
+                  TChromosomeLengths const & chromLengths, bool const append = false, unsigned const threads = 1,
+                  bool const compress = false)
+{
+    using namespace genmap::detail;
+    typedef typename TContainer::value_type T;
+
+    TextFile outfile;
+    openTextFile(outfile, output_path + ".bedgraph", append, compress, threads);
+    std::vector<std::string> const & mappabilityValues = mappabilityStrings<T>();
+
+    std::vector<std::string> names(length(chromLengths));
+    std::vector<uint64_t> lengths(length(chromLengths));
+    for (uint64_t i = 0; i < length(chromLengths); ++i)
+    {
+        names[i] = formatName(chromNames[i]);
+        lengths[i] = chromLengths[i];
+    }
+
+    writeRuns(outfile, c, lengths, threads, compress, [] (T const v) { return v; },
+              [&] (std::string & buffer, uint64_t const seqNo, uint64_t const begin, uint64_t const end, T const v)
+    {
+        buffer += names[seqNo];
+        buffer += '\t';
+        appendInteger(buffer, begin);
+        buffer += '\t';
+        appendInteger(buffer, end);
+        buffer += '\t';
+        SEQAN_IF_CONSTEXPR (mappability)
+            buffer += mappabilityValues[v];
+        else
+            appendInteger(buffer, v);
+        buffer += '\n';
+    });
+    closeTextFile(outfile);
+}
+
+// BED file (3 columns) of the merged intervals with a mappability of at least minMappability, i.e., the positions
+// to keep when masking by mappability. Positions with a frequency of 0 have a mappability of 0.
+template <typename TContainer, typename TChromosomeNames, typename TChromosomeLengths>
+void saveMaskBed(TContainer const & c, std::string const & output_path, TChromosomeNames const & chromNames,
+                 TChromosomeLengths const & chromLengths, float const minMappability, bool const append = false,
+                 unsigned const threads = 1, bool const compress = false)
+{
+    using namespace genmap::detail;
+    typedef typename TContainer::value_type T;
+
+    TextFile outfile;
+    openTextFile(outfile, output_path + ".mask.bed", append, compress, threads);
+
+    std::vector<std::string> names(length(chromLengths));
+    std::vector<uint64_t> lengths(length(chromLengths));
+    for (uint64_t i = 0; i < length(chromLengths); ++i)
+    {
+        names[i] = formatName(chromNames[i]);
+        lengths[i] = chromLengths[i];
+    }
+
+    // same float values as the mappability output
+    auto const keep = [minMappability] (T const v)
+    {
+        return ((v != 0) ? 1.0f / static_cast<float>(v) : 0.0f) >= minMappability;
+    };
+
+    writeRuns(outfile, c, lengths, threads, compress, keep,
+              [&] (std::string & buffer, uint64_t const seqNo, uint64_t const begin, uint64_t const end, bool const kept)
+    {
+        if (!kept)
+            return;
+        buffer += names[seqNo];
+        buffer += '\t';
+        appendInteger(buffer, begin);
+        buffer += '\t';
+        appendInteger(buffer, end);
+        buffer += '\n';
+    });
+    closeTextFile(outfile);
+}
+
+namespace genmap::detail
+{
+
+// Appends the summary of the values of a bin (mean, min, max and the fraction of k-mers with frequency 1). As in the
+// statistics (--statistics), positions with a frequency of 0 are not counted, i.e., k-mers containing an N and the last
+// k-1 positions of a sequence that do not start a k-mer. Bins without any of the remaining k-mers are summarized as 0.
+// The reductions are vectorized with OpenMP SIMD (the mappabilities are converted with toMappabilities beforehand).
+template <bool mappability, typename T>
+inline void appendBinSummary(std::string & buffer, T const * values, float const * mappabilities, uint64_t const n)
+{
+    uint64_t kmers = 0, unique = 0;
+    #pragma omp simd reduction(+:kmers, unique)
+    for (uint64_t k = 0; k < n; ++k)
+    {
+        kmers += (values[k] != 0);
+        unique += (values[k] == 1);
+    }
+
+    SEQAN_IF_CONSTEXPR (mappability)
+    {
+        // the mappability of a frequency of 0 is 0, i.e., it does not change the sum and the max
+        double sum = 0;
+        float minValue = std::numeric_limits<float>::max(), maxValue = 0;
+        #pragma omp simd reduction(+:sum) reduction(min:minValue) reduction(max:maxValue)
+        for (uint64_t k = 0; k < n; ++k)
+        {
+            sum += mappabilities[k];
+            minValue = std::min(minValue, (values[k] != 0) ? mappabilities[k] : std::numeric_limits<float>::max());
+            maxValue = std::max(maxValue, mappabilities[k]);
+        }
+        appendFloat(buffer, (kmers > 0) ? static_cast<float>(sum / kmers) : 0.0f);
+        buffer += '\t';
+        appendFloat(buffer, (kmers > 0) ? minValue : 0.0f);
+        buffer += '\t';
+        appendFloat(buffer, maxValue);
+    }
+    else
+    {
+        uint64_t sum = 0;
+        T minValue = std::numeric_limits<T>::max(), maxValue = 0;
+        #pragma omp simd reduction(+:sum) reduction(min:minValue) reduction(max:maxValue)
+        for (uint64_t k = 0; k < n; ++k)
+        {
+            sum += values[k];
+            minValue = std::min(minValue, (values[k] != 0) ? values[k] : std::numeric_limits<T>::max());
+            maxValue = std::max(maxValue, values[k]);
+        }
+        appendFloat(buffer, (kmers > 0) ? static_cast<float>(static_cast<double>(sum) / kmers) : 0.0f);
+        buffer += '\t';
+        appendInteger(buffer, (kmers > 0) ? minValue : T(0));
+        buffer += '\t';
+        appendInteger(buffer, maxValue);
+    }
+    buffer += '\t';
+    appendFloat(buffer, (kmers > 0) ? static_cast<float>(static_cast<double>(unique) / kmers) : 0.0f);
 }
 
-template <bool mappability, typename TLocations, typename TDirectoryInformation>
-void saveCsv(std::string const & output_path, TLocations const & locations,
-             SearchParams const & searchParams, TDirectoryInformation const & directoryInformation)
+} // namespace genmap::detail
+
+// Binned summary (--bins): one line per bin of binSize positions (the last bin of a sequence might be shorter) with
+// the mean, min and max value (mappability or frequency) and the fraction of unique k-mers. The sequences are split
+// into blocks of whole bins that are summarized (and compressed) in parallel and written in order.
+template <bool mappability, typename TContainer, typename TChromosomeNames, typename TChromosomeLengths>
+void saveBins(TContainer const & c, std::string const & output_path, TChromosomeNames const & chromNames,
+              TChromosomeLengths const & chromLengths, uint64_t const binSize, bool const append = false,
+              unsigned const threads = 1, bool const compress = false)
 {
-    char buffer[BUFFER_SIZE];
+    using namespace genmap::detail;
+    typedef typename TContainer::value_type T;
+
+    struct Block
+    {
+        uint64_t seqNo, seqBegin, begin, end; // global positions
+    };
+
+    TextFile outfile;
+    openTextFile(outfile, output_path + ".bins" + std::to_string(binSize) + ".tsv", append, compress, threads);
+    if (!append)
+        writeText(outfile, std::string("#chrom\tstart\tend\tmean\tmin\tmax\tunique_fraction\n"));
+
+    std::vector<std::string> names(length(chromLengths));
+    std::vector<Block> blocks;
+    uint64_t const blockSize = std::max<uint64_t>(1, TEXT_BLOCK_SIZE / binSize) * binSize;
+    uint64_t seqBegin = 0;
+    for (uint64_t i = 0; i < length(chromLengths); ++i)
+    {
+        names[i] = formatName(chromNames[i]);
+        uint64_t const seqEnd = seqBegin + chromLengths[i];
+        for (uint64_t begin = seqBegin; begin < seqEnd; begin += blockSize)
+            blocks.push_back({i, seqBegin, begin, std::min<uint64_t>(begin + blockSize, seqEnd)});
+        seqBegin = seqEnd;
+    }
+
+    std::vector<std::string> buffers(threads);
+    std::vector<BgzfBuffer> compressedBuffers(threads);
+    std::vector<std::vector<T> > values(threads);
+    std::vector<std::vector<float> > mappabilities(threads);
+    #pragma omp parallel for ordered schedule(dynamic, 1) num_threads(threads)
+    for (uint64_t b = 0; b < blocks.size(); ++b)
+    {
+        Block const & block = blocks[b];
+        unsigned const thread = omp_get_thread_num();
+        std::string & buffer = buffers[thread];
+        buffer.clear();
+
+        uint64_t const n = block.end - block.begin;
+        values[thread].resize(blockSize);
+        getFrequencies(c, block.begin, n, values[thread].data());
+        SEQAN_IF_CONSTEXPR (mappability)
+        {
+            mappabilities[thread].resize(blockSize);
+            toMappabilities(values[thread].data(), n, mappabilities[thread].data());
+        }
+
+        for (uint64_t bin = 0; bin < n; bin += binSize)
+        {
+            uint64_t const binLength = std::min<uint64_t>(binSize, n - bin);
+            buffer += names[block.seqNo];
+            buffer += '\t';
+            appendInteger(buffer, block.begin + bin - block.seqBegin);
+            buffer += '\t';
+            appendInteger(buffer, block.begin + bin + binLength - block.seqBegin);
+            buffer += '\t';
+            appendBinSummary<mappability>(buffer, values[thread].data() + bin,
+                                          mappability ? mappabilities[thread].data() + bin : nullptr, binLength);
+            buffer += '\n';
+        }
 
-    std::ofstream csvFile(output_path + ".csv");
-    csvFile.rdbuf()->pubsetbuf(buffer, BUFFER_SIZE);
+        if (compress)
+            compressBgzf(compressedBuffers[thread], buffer, 1);
 
+        #pragma omp ordered
+        {
+            if (compress)
+                writeBgzf(outfile, compressedBuffers[thread]);
+            else
+                writeText(outfile, buffer);
+        }
+    }
+    closeTextFile(outfile);
+}
+
+// fasta file, last chromosome (i.e., cumulative nbr. of chromosomes - 1)
+typedef std::vector<std::pair<std::string, uint64_t> > TFastaFiles;
+
+template <typename TDirectoryInformation>
+inline TFastaFiles getFastaFiles(TDirectoryInformation const & directoryInformation)
+{
     uint64_t chromosomeCount = 0;
-    std::vector<std::pair<std::string, uint64_t> > fastaFiles; // fasta file, cumulative nbr. of chromosomes
+    TFastaFiles fastaFiles;
     std::string lastFastaFile = std::get<0>(retrieveDirectoryInformationLine(directoryInformation[0]));
     for (auto const & row : directoryInformation)
     {
@@ -200,63 +901,532 @@ void saveCsv(std::string const & output_path, TLocations const & locations,
         }
         ++chromosomeCount;
     }
+    return fastaFiles;
+}
 
+template <typename TStream>
+inline void writeCsvHeader(TStream & csvFile, TFastaFiles const & fastaFiles, bool const revCompl)
+{
     csvFile << "\"k-mer\"";
     for (auto const & fastaFile : fastaFiles)
         csvFile << ";\"+ strand " << fastaFile.first << "\"";
-    if (searchParams.revCompl) // TODO: make it constexpr?
+    if (revCompl)
     {
         for (auto const & fastaFile : fastaFiles)
             csvFile << ";\"- strand " << fastaFile.first << "\"";
     }
     csvFile << '\n';
+}
 
-    for (auto const & kmerLocations : locations)
+template <typename TStream, typename TLocationString>
+inline void writeCsvColumns(TStream & csvFile, TLocationString const & strandLoc, TFastaFiles const & fastaFiles)
+{
+    uint64_t i = 0;
+    uint64_t nbrChromosomesInPreviousFastas = 0;
+    for (auto const & fastaFile : fastaFiles)
     {
-        auto const & kmerPos = kmerLocations.first;
-        auto const & plusStrandLoc = kmerLocations.second.first;
-        auto const & minusStrandLoc = kmerLocations.second.second;
+        csvFile << ';';
+        bool subsequentIterations = false;
+        while (i < strandLoc.size() && strandLoc[i].i1 <= fastaFile.second)
+        {
+            if (subsequentIterations)
+                csvFile << '|'; // separator for multiple locations in one column
+            csvFile << (strandLoc[i].i1 - nbrChromosomesInPreviousFastas) << ',' << strandLoc[i].i2;
+            subsequentIterations = true;
+            ++i;
+        }
+        nbrChromosomesInPreviousFastas = fastaFile.second + 1;
+    }
+}
+
+template <typename TStream, typename TLocation, typename TLocationString>
+inline void writeCsvRow(TStream & csvFile, TLocation const & kmerPos, TLocationString const & plusStrandLoc,
+                        TLocationString const & minusStrandLoc, TFastaFiles const & fastaFiles, bool const revCompl)
+{
+    csvFile << kmerPos.i1 << ',' << kmerPos.i2;
+    writeCsvColumns(csvFile, plusStrandLoc, fastaFiles);
+    if (revCompl)
+        writeCsvColumns(csvFile, minusStrandLoc, fastaFiles);
+    csvFile << '\n';
+}
+
+// Calls f(kmerPos, groupId) for each k-mer position in [first, last) in order. Positions that have never been searched
+// (the last k-1 positions of each sequence and all positions of sequences shorter than k) are not stored in the
+// locations, they are generated on the fly and refer to the empty group 0 (if reportUnsearched is set).
+template <typename TLocations, typename TChromosomeLengths, typename TLocation, typename TFunctor>
+inline void forEachKmerLocation(TLocations const & locations, TChromosomeLengths const & chromLengths,
+                                unsigned const kmerLength, bool const reportUnsearched,
+                                TLocation const & first, TLocation const & last, TFunctor && f)
+{
+    auto it = locations.positions.lower_bound(first);
+    auto const itEnd = locations.positions.lower_bound(last);
 
-        csvFile << kmerPos.i1 << ',' << kmerPos.i2;
+    for (uint64_t seqNo = first.i1; seqNo <= last.i1 && seqNo < length(chromLengths); ++seqNo)
+    {
+        for (; it != itEnd && it->first.i1 == seqNo; ++it)
+            f(it->first, it->second);
 
-        uint64_t i = 0;
-        uint64_t nbrChromosomesInPreviousFastas = 0;
-        for (auto const & fastaFile : fastaFiles)
+        if (reportUnsearched)
         {
-            csvFile << ';';
-            bool subsequentIterations = false;
-            while (i < plusStrandLoc.size() && plusStrandLoc[i].i1 <= fastaFile.second)
+            uint64_t const seqLength = chromLengths[seqNo];
+            uint64_t const unsearchedBegin = (seqLength >= kmerLength) ? seqLength - kmerLength + 1 : 0;
+            uint64_t const rangeBegin = (seqNo == first.i1) ? first.i2 : 0;
+            uint64_t const rangeEnd = (seqNo == last.i1) ? last.i2 : seqLength;
+
+            TLocation pos;
+            pos.i1 = seqNo;
+            for (uint64_t seqPos = std::max(unsearchedBegin, rangeBegin); seqPos < rangeEnd; ++seqPos)
             {
-                if (subsequentIterations)
-                    csvFile << '|'; // separator for multiple locations in one column
-                csvFile << (plusStrandLoc[i].i1 - nbrChromosomesInPreviousFastas) << ',' << plusStrandLoc[i].i2;
-                subsequentIterations = true;
-                ++i;
+                pos.i2 = seqPos;
+                f(pos, 0);
             }
-            nbrChromosomesInPreviousFastas = fastaFile.second + 1;
         }
+    }
+}
 
-        if (searchParams.revCompl)
-        {
-            uint64_t i = 0;
-            uint64_t nbrChromosomesInPreviousFastas = 0;
-            for (auto const & fastaFile : fastaFiles)
+template <bool mappability, typename TLocations, typename TChromosomeLengths, typename TDirectoryInformation>
+void saveCsv(std::string const & output_path, TLocations const & locations, SearchParams const & searchParams,
+             TChromosomeLengths const & chromLengths, TDirectoryInformation const & directoryInformation)
+{
+    using namespace genmap::detail;
+    using TLocation = typename TLocations::key_type;
+
+    OutputFile csvFile;
+    openOutputFile(csvFile, output_path + ".csv");
+
+    TFastaFiles const fastaFiles = getFastaFiles(directoryInformation);
+
+    {
+        std::ostringstream header;
+        writeCsvHeader(header, fastaFiles, searchParams.revCompl); // TODO: make it constexpr?
+        writeOutput(csvFile, header.str());
+    }
+
+    // The rows are formatted in parallel in chunks of about equal numbers of positions (at most 1M per chunk)
+    // and written in order.
+    SequenceLookup sequenceLookup;
+    {
+        std::vector<uint64_t> cumLengths(1, 0);
+        for (uint64_t i = 0; i < length(chromLengths); ++i)
+            cumLengths.push_back(cumLengths.back() + chromLengths[i]);
+        initSequenceLookup(sequenceLookup, cumLengths);
+    }
+    uint64_t const totalLength = sequenceLookup.limits.back();
+    uint64_t const chunks = std::max<uint64_t>(1, std::min<uint64_t>(totalLength,
+                                               std::max<uint64_t>(searchParams.threads * 16, totalLength >> 20)));
+    bool const reportUnsearched = searchParams.csvMinFrequency == 0;
+
+    #pragma omp parallel for ordered schedule(dynamic, 1) num_threads(searchParams.threads)
+    for (uint64_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        TLocation first(0, 0), last(length(chromLengths), 0);
+        if (chunk > 0)
+            myPosLocalize(first, totalLength * chunk / chunks, sequenceLookup);
+        if (chunk + 1 < chunks)
+            myPosLocalize(last, totalLength * (chunk + 1) / chunks, sequenceLookup);
+
+        std::ostringstream rows;
+        forEachKmerLocation(locations, chromLengths, searchParams.length, reportUnsearched, first, last,
+            [&] (TLocation const & kmerPos, uint64_t const groupId)
             {
-                csvFile << ';';
-                bool subsequentIterations = false;
-                while (i < minusStrandLoc.size() && minusStrandLoc[i].i1 <= fastaFile.second)
-                {
-                    if (subsequentIterations)
-                        csvFile << '|'; // separator for multiple locations in one column
-                    csvFile << (minusStrandLoc[i].i1 - nbrChromosomesInPreviousFastas) << ',' << minusStrandLoc[i].i2;
-                    subsequentIterations = true;
-                    ++i;
-                }
-                nbrChromosomesInPreviousFastas = fastaFile.second + 1;
-            }
+                auto const & group = locations.groups[groupId]; // exact copies of a k-mer share the same group
+                writeCsvRow(rows, kmerPos, group.first, group.second, fastaFiles, searchParams.revCompl);
+            });
+
+        #pragma omp ordered
+        {
+            writeOutput(csvFile, rows.str());
+        }
+    }
+
+    closeOutputFile(csvFile);
+}
+
+// ----------------------------------------------------------------------------
+// Binary locations file (.loc)
+// ----------------------------------------------------------------------------
+// Stores the same information as the csv file. The file starts with a LocationsFileHeader, followed by the list of
+// fasta files (uint64_t last chromosome, uint32_t length of the name, name) and the blocks of k-mer records. Each block
+// stores up to LOCATIONS_BLOCK_SIZE consecutive k-mers and can be decoded independently, the block index at the end of
+// the file stores the first k-mer position and the file offset of each block for random access.
+//
+// Every k-mer record consists of varints: its position (delta-encoded to the previous record in the block), a
+// back-reference r (if r > 0 the k-mer has the same occurrences as the r-th previous record in the block, i.e., it is
+// an exact copy) and otherwise the number of occurrences followed by the delta-encoded (seqNo, pos) pairs for the plus
+// strand (and the minus strand if the reverse complement was searched). A position is delta-encoded to the previous
+// one only if the sequence numbers are equal.
+//
+// The header, the list of fasta files and the block index are serialized field by field without padding, all
+// fixed-width numbers are stored in little-endian byte order (independent of the machine writing the file). The header
+// stores LOCATIONS_BYTE_ORDER to detect files that were not written this way.
+
+#define     LOCATIONS_BLOCK_SIZE        4096 // k-mers per block
+#define     LOCATIONS_VERSION           2
+#define     LOCATIONS_BYTE_ORDER        0x01020304
+#define     LOCATIONS_HEADER_SIZE       52   // serialized size of LocationsFileHeader
+#define     LOCATIONS_BLOCK_ENTRY_SIZE  32   // serialized size of LocationsBlockIndexEntry
+
+struct LocationsFileHeader
+{
+    char     magic[8];         // "GMLOC"
+    uint32_t version;
+    uint32_t byteOrder;        // LOCATIONS_BYTE_ORDER
+    uint32_t kmerLength;
+    uint32_t revCompl;
+    uint32_t fastaFiles;       // number of fasta files listed after the header
+    uint64_t kmers;            // number of k-mer records
+    uint64_t blocks;           // number of blocks
+    uint64_t blockIndexOffset; // file offset of the block index
+};
+
+struct LocationsBlockIndexEntry
+{
+    uint64_t seqNo;  // position of the first k-mer in the block
+    uint64_t seqPos;
+    uint64_t offset; // file offset of the block
+    uint64_t kmers;  // number of k-mers in the block
+};
+
+namespace genmap::detail
+{
+
+template <typename T>
+inline void appendFixed(std::string & buffer, T value)
+{
+    for (unsigned i = 0; i < sizeof(T); ++i)
+    {
+        buffer.push_back(static_cast<char>(value & 0xFF));
+        value >>= 8;
+    }
+}
+
+// Returns false if the number is truncated (it would read past end).
+template <typename T>
+inline bool readFixed(char const * & it, char const * const end, T & value)
+{
+    if (static_cast<uint64_t>(end - it) < sizeof(T))
+        return false;
+    value = 0;
+    for (unsigned i = 0; i < sizeof(T); ++i)
+        value |= static_cast<T>(static_cast<uint8_t>(*it++)) << (8 * i);
+    return true;
+}
+
+inline std::string serializeLocationsHeader(LocationsFileHeader const & header)
+{
+    std::string buffer(header.magic, sizeof(header.magic));
+    appendFixed(buffer, header.version);
+    appendFixed(buffer, header.byteOrder);
+    appendFixed(buffer, header.kmerLength);
+    appendFixed(buffer, header.revCompl);
+    appendFixed(buffer, header.fastaFiles);
+    appendFixed(buffer, header.kmers);
+    appendFixed(buffer, header.blocks);
+    appendFixed(buffer, header.blockIndexOffset);
+    return buffer;
+}
+
+inline bool readLocationsHeader(char const * it, char const * const end, LocationsFileHeader & header)
+{
+    if (static_cast<uint64_t>(end - it) < sizeof(header.magic))
+        return false;
+    memcpy(header.magic, it, sizeof(header.magic));
+    it += sizeof(header.magic);
+    return readFixed(it, end, header.version) && readFixed(it, end, header.byteOrder) &&
+           readFixed(it, end, header.kmerLength) && readFixed(it, end, header.revCompl) &&
+           readFixed(it, end, header.fastaFiles) && readFixed(it, end, header.kmers) &&
+           readFixed(it, end, header.blocks) && readFixed(it, end, header.blockIndexOffset);
+}
+
+inline void appendLocationsBlockIndexEntry(std::string & buffer, LocationsBlockIndexEntry const & entry)
+{
+    appendFixed(buffer, entry.seqNo);
+    appendFixed(buffer, entry.seqPos);
+    appendFixed(buffer, entry.offset);
+    appendFixed(buffer, entry.kmers);
+}
+
+inline bool readLocationsBlockIndexEntry(char const * & it, char const * const end, LocationsBlockIndexEntry & entry)
+{
+    return readFixed(it, end, entry.seqNo) && readFixed(it, end, entry.seqPos) && readFixed(it, end, entry.offset) &&
+           readFixed(it, end, entry.kmers);
+}
+
+inline void appendVarint(std::string & buffer, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<char>(value));
+}
+
+// The read functions return false if a varint is truncated (it would read past end) or longer than 64 bits.
+inline bool readVarint(char const * & it, char const * const end, uint64_t & value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && it != end; shift += 7)
+    {
+        uint8_t const byte = static_cast<uint8_t>(*it++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+template <typename TLocation>
+inline void appendLocationVarint(std::string & buffer, TLocation const & loc, TLocation const & prevLoc, bool const first)
+{
+    if (first)
+    {
+        appendVarint(buffer, loc.i1);
+        appendVarint(buffer, loc.i2);
+    }
+    else
+    {
+        appendVarint(buffer, loc.i1 - prevLoc.i1);
+        appendVarint(buffer, (loc.i1 == prevLoc.i1) ? loc.i2 - prevLoc.i2 : loc.i2);
+    }
+}
+
+template <typename TLocation>
+inline bool readLocationVarint(char const * & it, char const * const end, TLocation & loc, bool const first)
+{
+    uint64_t seqNo, seqPos;
+    if (!readVarint(it, end, seqNo) || !readVarint(it, end, seqPos))
+        return false;
+
+    if (first || seqNo != 0) // seqNo is the delta to the previous sequence number if !first
+    {
+        loc.i1 = first ? seqNo : loc.i1 + seqNo;
+        loc.i2 = seqPos;
+    }
+    else
+    {
+        loc.i2 += seqPos;
+    }
+    return true;
+}
+
+template <typename TLocationString>
+inline void appendLocationsVarint(std::string & buffer, TLocationString const & locs)
+{
+    appendVarint(buffer, locs.size());
+    for (uint64_t i = 0; i < locs.size(); ++i)
+        appendLocationVarint(buffer, locs[i], locs[i > 0 ? i - 1 : 0], i == 0);
+}
+
+template <typename TLocationString>
+inline bool readLocationsVarint(char const * & it, char const * const end, TLocationString & locs)
+{
+    uint64_t n;
+    // every location takes at least two bytes
+    if (!readVarint(it, end, n) || n > static_cast<uint64_t>(end - it) / 2)
+        return false;
+
+    locs.resize(n);
+    for (uint64_t i = 0; i < locs.size(); ++i)
+    {
+        if (i > 0)
+            locs[i] = locs[i - 1];
+        if (!readLocationVarint(it, end, locs[i], i == 0))
+            return false;
+    }
+    return true;
+}
+
+} // namespace genmap::detail
+
+template <typename TLocations, typename TChromosomeLengths, typename TDirectoryInformation>
+void saveLocations(std::string const & output_path, TLocations const & locations, SearchParams const & searchParams,
+                   TChromosomeLengths const & chromLengths, TDirectoryInformation const & directoryInformation)
+{
+    using namespace genmap::detail;
+    using TLocation = typename TLocations::key_type;
+
+    OutputFile locFile;
+    openOutputFile(locFile, output_path + ".loc");
+
+    TFastaFiles const fastaFiles = getFastaFiles(directoryInformation);
+
+    LocationsFileHeader header = {};
+    strncpy(header.magic, "GMLOC", sizeof(header.magic));
+    header.version = LOCATIONS_VERSION;
+    header.byteOrder = LOCATIONS_BYTE_ORDER;
+    header.kmerLength = searchParams.length;
+    header.revCompl = searchParams.revCompl;
+    header.fastaFiles = fastaFiles.size();
+    writeOutput(locFile, serializeLocationsHeader(header)); // rewritten at the end
+
+    std::string buffer;
+    for (auto const & fastaFile : fastaFiles)
+    {
+        appendFixed(buffer, static_cast<uint64_t>(fastaFile.second)); // last chromosome
+        appendFixed(buffer, static_cast<uint32_t>(fastaFile.first.size()));
+        buffer += fastaFile.first;
+    }
+    writeOutput(locFile, buffer);
+    buffer.clear();
+
+    std::vector<LocationsBlockIndexEntry> blockIndex;
+    std::unordered_map<uint64_t, uint64_t> groupRecords; // group id -> record index in the current block
+    uint64_t record = 0;
+    TLocation prevPos(0, 0);
+
+    auto flushBlock = [&]()
+    {
+        writeOutput(locFile, buffer.data(), buffer.size());
+        buffer.clear();
+        groupRecords.clear();
+        record = 0;
+    };
+
+    auto appendRecord = [&] (TLocation const & kmerPos, uint64_t const groupId)
+    {
+        if (record == 0)
+            blockIndex.push_back({kmerPos.i1, kmerPos.i2, tellOutput(locFile), 0});
+
+        appendLocationVarint(buffer, kmerPos, prevPos, record == 0);
+        prevPos = kmerPos;
+
+        // exact copies of a k-mer only refer to the previous record with the same group
+        auto const groupRecord = groupRecords.find(groupId);
+        if (groupRecord != groupRecords.end())
+        {
+            appendVarint(buffer, record - groupRecord->second);
+        }
+        else
+        {
+            auto const & group = locations.groups[groupId];
+            appendVarint(buffer, 0);
+            appendLocationsVarint(buffer, group.first);
+            if (searchParams.revCompl)
+                appendLocationsVarint(buffer, group.second);
+            groupRecords[groupId] = record;
         }
-        csvFile << '\n';
+
+        ++header.kmers;
+        ++blockIndex.back().kmers;
+        if (++record == LOCATIONS_BLOCK_SIZE)
+            flushBlock();
+    };
+
+    TLocation const first(0, 0), last(length(chromLengths), 0);
+    forEachKmerLocation(locations, chromLengths, searchParams.length, searchParams.csvMinFrequency == 0,
+                        first, last, appendRecord);
+    if (record > 0)
+        flushBlock();
+
+    header.blocks = blockIndex.size();
+    header.blockIndexOffset = tellOutput(locFile);
+    for (LocationsBlockIndexEntry const & entry : blockIndex)
+        appendLocationsBlockIndexEntry(buffer, entry);
+    writeOutput(locFile, buffer);
+    closeOutputFile(locFile);
+    std::string const serializedHeader = serializeLocationsHeader(header);
+    overwriteOutput(output_path + ".loc", 0, serializedHeader.data(), serializedHeader.size());
+}
+
+// ----------------------------------------------------------------------------
+// Raw container file (.gmr)
+// ----------------------------------------------------------------------------
+// Self-describing variant of the raw files that can be queried without any further information ('genmap query').
+// The file starts with a RawContainerHeader storing the parameters of the computation, followed by the chromosome
+// table (one RawContainerChromosome per sequence) and the chromosome names. The values of each sequence are stored in
+// the raw format (float, uint8_t or uint16_t depending on the value type) and start at a file offset that is a
+// multiple of RAW_CONTAINER_ALIGNMENT, i.e., a region of a sequence can be memory-mapped directly. All numbers are
+// stored in the byte order of the machine that wrote the file (identified by RAW_CONTAINER_BYTE_ORDER).
+
+#define     RAW_CONTAINER_ALIGNMENT     4096
+#define     RAW_CONTAINER_VERSION       2
+#define     RAW_CONTAINER_BYTE_ORDER    0x01020304
+
+struct RawContainerHeader
+{
+    char     magic[8];       // "GMRAW"
+    uint32_t version;
+    uint32_t byteOrder;      // RAW_CONTAINER_BYTE_ORDER
+    uint32_t kmerLength;
+    uint32_t errors;
+    uint32_t indels;
+    uint32_t revCompl;
+    uint32_t excludePseudo;
+    uint32_t valueType;      // OutputType
+    uint32_t valueSize;      // bytes per value
+    uint32_t padding;        // 0
+    uint64_t chromosomes;    // number of entries in the chromosome table
+    uint64_t fileSize;
+};
+
+struct RawContainerChromosome
+{
+    uint64_t offset;         // file offset of the first value (multiple of RAW_CONTAINER_ALIGNMENT)
+    uint64_t length;         // number of values
+    uint64_t nameOffset;     // file offset of the name
+    uint64_t nameLength;
+};
+
+template <bool mappability, typename TContainer, typename TChromosomeNames, typename TChromosomeLengths>
+void saveRawContainer(TContainer const & c, std::string const & output_path, TChromosomeNames const & chromNames,
+                      TChromosomeLengths const & chromLengths, SearchParams const & searchParams,
+                      unsigned const errors, bool const indels)
+{
+    using namespace genmap::detail;
+    typedef typename TContainer::value_type T;
+
+    RawContainerHeader header = {};
+    strncpy(header.magic, "GMRAW", sizeof(header.magic));
+    header.version = RAW_CONTAINER_VERSION;
+    header.byteOrder = RAW_CONTAINER_BYTE_ORDER;
+    header.kmerLength = searchParams.length;
+    header.errors = errors;
+    header.indels = indels;
+    header.revCompl = searchParams.revCompl;
+    header.excludePseudo = searchParams.excludePseudo;
+    header.valueType = mappability ? OutputType::mappability
+                                   : (sizeof(T) == 1 ? OutputType::frequency_small : OutputType::frequency_large);
+    header.valueSize = mappability ? sizeof(float) : sizeof(T);
+    header.chromosomes = length(chromLengths);
+
+    // the layout is computed in advance such that the file can be written sequentially
+    std::vector<std::string> names(length(chromLengths));
+    std::vector<RawContainerChromosome> table(length(chromLengths));
+    uint64_t offset = sizeof(header) + table.size() * sizeof(RawContainerChromosome);
+    for (uint64_t i = 0; i < table.size(); ++i)
+    {
+        names[i] = formatName(chromNames[i]);
+        table[i].nameOffset = offset;
+        table[i].nameLength = names[i].size();
+        offset += names[i].size();
+    }
+    uint64_t filePos = offset; // end of the names
+    for (uint64_t i = 0; i < table.size(); ++i)
+    {
+        offset = (offset + RAW_CONTAINER_ALIGNMENT - 1) / RAW_CONTAINER_ALIGNMENT * RAW_CONTAINER_ALIGNMENT;
+        table[i].offset = offset;
+        table[i].length = chromLengths[i];
+        offset += table[i].length * header.valueSize;
+    }
+    header.fileSize = offset;
+
+    OutputFile outfile;
+    openOutputFile(outfile, output_path + ".gmr");
+    writeOutput(outfile, reinterpret_cast<char const *>(&header), sizeof(header));
+    writeOutput(outfile, reinterpret_cast<char const *>(table.data()), table.size() * sizeof(RawContainerChromosome));
+    for (std::string const & name : names)
+        writeOutput(outfile, name.data(), name.size());
+
+    std::vector<char> const padding(RAW_CONTAINER_ALIGNMENT, 0);
+    uint64_t pos = 0;
+    for (uint64_t i = 0; i < table.size(); ++i)
+    {
+        writeOutput(outfile, padding.data(), table[i].offset - filePos);
+        writeRawValues<mappability>(outfile, c, pos, table[i].length);
+        pos += table[i].length;
+        filePos = table[i].offset + table[i].length * header.valueSize;
     }
 
-    csvFile.close();
+    closeOutputFile(outfile);
 }
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <streambuf>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------
+// Output files
+// ----------------------------------------------------------------------------
+// All output files are written through an OutputFile. Data is collected in two large heap buffers aligned to
+// OUTPUT_ALIGNMENT: while one buffer is filled, the other one is written asynchronously with pwrite() by a background
+// thread (double buffering). With direct I/O (--direct-io) the file is opened with O_DIRECT, i.e., the buffers are
+// written bypassing the page cache. The last buffer is padded to OUTPUT_ALIGNMENT and the file is truncated to its
+// actual size afterwards. Direct I/O falls back to buffered I/O if the file system does not support O_DIRECT, if a
+// file is appended at an unaligned offset or if the file system rejects the direct writes (EINVAL). Files that are not
+// closed explicitly are flushed and closed by the destructor.
+
+#define     OUTPUT_BUFFER_SIZE  (8 << 20) // 8 MB, default size of each of the two buffers (--output-buffer-size)
+#define     OUTPUT_ALIGNMENT    4096
+
+namespace genmap::detail
+{
+
+// Set once by the command line parser before any file is written.
+struct OutputFileConfig
+{
+    static inline uint64_t bufferSize = OUTPUT_BUFFER_SIZE;
+    static inline bool directIO = false;
+};
+
+struct OutputFile
+{
+    std::string path;
+    int fd = -1;
+    bool directIO = false;
+    uint64_t bufferSize = 0;
+    char * buffers[2] = {nullptr, nullptr};
+    unsigned current = 0;     // buffer that is filled
+    uint64_t fill = 0;        // bytes in the current buffer
+    uint64_t fileOffset = 0;  // file offset of the current buffer
+    std::future<bool> pending; // write of the other buffer
+
+    OutputFile() = default;
+    OutputFile(OutputFile const &) = delete;
+    OutputFile & operator=(OutputFile const &) = delete;
+
+    ~OutputFile();
+};
+
+inline bool pwriteAll(int const fd, char const * data, uint64_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t const written = pwrite(fd, data, size, offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+// Some file systems accept O_DIRECT when the file is opened but reject the writes with EINVAL. O_DIRECT is cleared in
+// this case and the write is repeated (the padding of the buffers is kept, it is truncated when the file is closed).
+inline bool pwriteOutput(int const fd, char const * data, uint64_t const size, uint64_t const offset, bool const directIO)
+{
+    if (pwriteAll(fd, data, size, offset))
+        return true;
+#ifdef O_DIRECT
+    if (directIO && errno == EINVAL && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT) == 0)
+        return pwriteAll(fd, data, size, offset);
+#endif
+    return false;
+}
+
+inline void waitOutput(OutputFile & file)
+{
+    if (file.pending.valid() && !file.pending.get())
+    {
+        std::cerr << "ERROR: Could not write " << file.path << ".\n";
+        exit(1);
+    }
+}
+
+// Writes the current buffer asynchronously (padded to OUTPUT_ALIGNMENT with direct I/O) and switches the buffers.
+inline void flushOutput(OutputFile & file)
+{
+    waitOutput(file);
+
+    uint64_t size = file.fill;
+    if (file.directIO)
+    {
+        uint64_t const padded = (size + OUTPUT_ALIGNMENT - 1) / OUTPUT_ALIGNMENT * OUTPUT_ALIGNMENT;
+        memset(file.buffers[file.current] + size, 0, padded - size);
+        size = padded;
+    }
+
+    file.pending = std::async(std::launch::async, pwriteOutput, file.fd, file.buffers[file.current], size, file.fileOffset,
+                              file.directIO);
+    file.fileOffset += file.fill;
+    file.current ^= 1;
+    file.fill = 0;
+}
+
+inline void openOutputFile(OutputFile & file, std::string const & path, bool const append = false)
+{
+    file.path = path;
+    file.fd = ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+    if (file.fd == -1)
+    {
+        std::cerr << "ERROR: Could not create " << path << ".\n";
+        exit(1);
+    }
+    file.fileOffset = append ? lseek(file.fd, 0, SEEK_END) : 0;
+
+    file.directIO = false;
+#ifdef O_DIRECT
+    if (OutputFileConfig::directIO && file.fileOffset % OUTPUT_ALIGNMENT == 0)
+        file.directIO = fcntl(file.fd, F_SETFL, fcntl(file.fd, F_GETFL) | O_DIRECT) == 0;
+#endif
+
+    file.bufferSize = std::max<uint64_t>(1, (OutputFileConfig::bufferSize + OUTPUT_ALIGNMENT - 1) / OUTPUT_ALIGNMENT)
+                    * OUTPUT_ALIGNMENT;
+    for (char * & buffer : file.buffers)
+    {
+        if (posix_memalign(reinterpret_cast<void **>(&buffer), OUTPUT_ALIGNMENT, file.bufferSize) != 0)
+        {
+            std::cerr << "ERROR: Could not allocate the output buffer of " << path << ".\n";
+            exit(1);
+        }
+    }
+    file.current = 0;
+    file.fill = 0;
+}
+
+inline void writeOutput(OutputFile & file, char const * data, uint64_t size)
+{
+    while (size > 0)
+    {
+        uint64_t const n = std::min<uint64_t>(size, file.bufferSize - file.fill);
+        memcpy(file.buffers[file.current] + file.fill, data, n);
+        file.fill += n;
+        data += n;
+        size -= n;
+        if (file.fill == file.bufferSize)
+            flushOutput(file);
+    }
+}
+
+inline void writeOutput(OutputFile & file, std::string const & data)
+{
+    writeOutput(file, data.data(), data.size());
+}
+
+// Number of bytes in the file (including the buffered ones).
+inline uint64_t tellOutput(OutputFile const & file)
+{
+    return file.fileOffset + file.fill;
+}
+
+inline void closeOutputFile(OutputFile & file)
+{
+    if (file.fill > 0)
+        flushOutput(file);
+    waitOutput(file);
+
+    if ((file.directIO && ftruncate(file.fd, file.fileOffset) != 0) || ::close(file.fd) != 0)
+    {
+        std::cerr << "ERROR: Could not write " << file.path << ".\n";
+        exit(1);
+    }
+    file.fd = -1;
+}
+
+inline OutputFile::~OutputFile()
+{
+    if (fd != -1)
+        closeOutputFile(*this);
+    else if (pending.valid())
+        pending.wait();
+    free(buffers[0]);
+    free(buffers[1]);
+}
+
+// Overwrites data of a closed file, e.g., a header that is only known at the end.
+inline void overwriteOutput(std::string const & path, uint64_t const offset, char const * data, uint64_t const size)
+{
+    int const fd = ::open(path.c_str(), O_WRONLY);
+    if (fd == -1 || !pwriteAll(fd, data, size, offset) || ::close(fd) != 0)
+    {
+        std::cerr << "ERROR: Could not write " << path << ".\n";
+        exit(1);
+    }
+}
+
+// std::ostream interface of an OutputFile for writers that format with operator<<.
+class OutputStreamBuffer : public std::streambuf
+{
+public:
+    explicit OutputStreamBuffer(OutputFile & file) : file(file)
+    {}
+
+protected:
+    int_type overflow(int_type const c) override
+    {
+        if (c != traits_type::eof())
+        {
+            char const ch = traits_type::to_char_type(c);
+            writeOutput(file, &ch, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(char const * s, std::streamsize const n) override
+    {
+        writeOutput(file, s, n);
+        return n;
+    }
+
+private:
+    OutputFile & file;
+};
+
+} // namespace genmap::detail
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <seqan/arg_parse.h>
+
+#include "common.hpp"
+#include "genmap_helper.hpp"
+#include "output.hpp"
+
+using namespace seqan;
+
+// Raw container file (.gmr) opened for queries. Only the header and the chromosome table are read, the values are
+// memory-mapped for each queried region.
+struct RawContainer
+{
+    std::string path;
+    int fd = -1;
+    RawContainerHeader header;
+    std::vector<RawContainerChromosome> chromosomes;
+    std::vector<std::string> names;
+
+    RawContainer() = default;
+    RawContainer(RawContainer const &) = delete;
+    RawContainer & operator=(RawContainer const &) = delete;
+
+    ~RawContainer()
+    {
+        if (fd != -1)
+            ::close(fd);
+    }
+};
+
+inline bool openRawContainer(RawContainer & rc, std::string const & path)
+{
+    rc.path = path;
+    rc.fd = ::open(path.c_str(), O_RDONLY);
+    if (rc.fd == -1)
+    {
+        std::cerr << "ERROR: Could not open " << path << ".\n";
+        return false;
+    }
+
+    if (pread(rc.fd, &rc.header, sizeof(rc.header), 0) != sizeof(rc.header) ||
+        std::string(rc.header.magic, strnlen(rc.header.magic, sizeof(rc.header.magic))) != "GMRAW")
+    {
+        std::cerr << "ERROR: " << path << " is not a GenMap raw container file.\n";
+        return false;
+    }
+    if (rc.header.byteOrder == __builtin_bswap32(RAW_CONTAINER_BYTE_ORDER))
+    {
+        std::cerr << "ERROR: " << path << " was written on a machine with a different byte order.\n";
+        return false;
+    }
+    if (rc.header.version != RAW_CONTAINER_VERSION)
+    {
+        std::cerr << "ERROR: " << path << " has version " << rc.header.version << ", but only version "
+                  << RAW_CONTAINER_VERSION << " is supported.\n";
+        return false;
+    }
+    if (rc.header.byteOrder != RAW_CONTAINER_BYTE_ORDER)
+    {
+        std::cerr << "ERROR: " << path << " is corrupt.\n";
+        return false;
+    }
+    uint32_t const valueSizes[] = {sizeof(float), sizeof(uint16_t), sizeof(uint8_t)};
+    if (rc.header.valueType > OutputType::frequency_small || rc.header.valueSize != valueSizes[rc.header.valueType])
+    {
+        std::cerr << "ERROR: " << path << " has an unknown value type.\n";
+        return false;
+    }
+
+    // all offsets are checked against the file size, i.e., queries never map pages beyond the end of the file
+    struct stat fileStat;
+    uint64_t const fileSize = rc.header.fileSize;
+    if (fstat(rc.fd, &fileStat) != 0 || static_cast<uint64_t>(fileStat.st_size) < fileSize ||
+        rc.header.chromosomes > (fileSize - std::min<uint64_t>(fileSize, sizeof(rc.header))) / sizeof(RawContainerChromosome))
+    {
+        std::cerr << "ERROR: " << path << " is truncated.\n";
+        return false;
+    }
+
+    rc.chromosomes.resize(rc.header.chromosomes);
+    uint64_t const tableSize = rc.chromosomes.size() * sizeof(RawContainerChromosome);
+    if (pread(rc.fd, rc.chromosomes.data(), tableSize, sizeof(rc.header)) != static_cast<ssize_t>(tableSize))
+    {
+        std::cerr << "ERROR: " << path << " is truncated.\n";
+        return false;
+    }
+
+    rc.names.resize(rc.chromosomes.size());
+    for (uint64_t i = 0; i < rc.chromosomes.size(); ++i)
+    {
+        RawContainerChromosome const & chromosome = rc.chromosomes[i];
+        if (chromosome.nameOffset > fileSize || chromosome.nameLength > fileSize - chromosome.nameOffset ||
+            chromosome.offset > fileSize || chromosome.length > (fileSize - chromosome.offset) / rc.header.valueSize)
+        {
+            std::cerr << "ERROR: " << path << " is corrupt.\n";
+            return false;
+        }
+
+        rc.names[i].resize(chromosome.nameLength);
+        if (pread(rc.fd, &rc.names[i][0], rc.names[i].size(), chromosome.nameOffset) !=
+            static_cast<ssize_t>(rc.names[i].size()))
+        {
+            std::cerr << "ERROR: " << path << " is truncated.\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Looks up a sequence by its name. Fasta ids match as well, i.e., the name up to the first whitespace.
+inline bool findRawContainerChromosome(RawContainer const & rc, std::string const & name, uint64_t & id)
+{
+    for (id = 0; id < rc.names.size(); ++id)
+        if (rc.names[id] == name)
+            return true;
+    for (id = 0; id < rc.names.size(); ++id)
+        if (rc.names[id].substr(0, rc.names[id].find_first_of(" \t")) == name)
+            return true;
+    return false;
+}
+
+// Parses a region "chr", "chr:start" or "chr:start-end" (1-based, end inclusive) into the 0-based half-open interval
+// [begin, end). The end is not checked against the sequence length.
+inline bool parseRegion(std::string const & region, std::string & name, uint64_t & begin, uint64_t & end)
+{
+    size_t const colon = region.find_last_of(':');
+    name = region.substr(0, colon);
+    begin = 0;
+    end = std::numeric_limits<uint64_t>::max();
+    if (colon == std::string::npos)
+        return !name.empty();
+
+    std::string const range = region.substr(colon + 1);
+    size_t const dash = range.find('-');
+    std::string const first = range.substr(0, dash);
+    std::string const last = (dash == std::string::npos) ? "" : range.substr(dash + 1);
+    if (first.empty() || first.find_first_not_of("0123456789") != std::string::npos ||
+        last.find_first_not_of("0123456789") != std::string::npos || (dash != std::string::npos && last.empty()))
+    {
+        return false;
+    }
+
+    begin = std::stoull(first);
+    if (dash != std::string::npos)
+        end = std::stoull(last);
+    if (begin == 0 || begin > end)
+        return false;
+    --begin;
+    return !name.empty();
+}
+
+// Writes the values of [begin, end) of a sequence (one line per position: name, 1-based position, value). Only the
+// pages of the region are memory-mapped.
+template <typename TStream>
+inline bool queryRegion(TStream & out, RawContainer const & rc, uint64_t const id, uint64_t begin, uint64_t end)
+{
+    using namespace genmap::detail;
+
+    RawContainerChromosome const & chromosome = rc.chromosomes[id];
+    end = std::min<uint64_t>(end, chromosome.length);
+    if (begin >= end)
+        return true;
+
+    uint64_t const pageSize = sysconf(_SC_PAGESIZE);
+    uint64_t const byteBegin = chromosome.offset + begin * rc.header.valueSize;
+    uint64_t const byteEnd = chromosome.offset + end * rc.header.valueSize;
+    uint64_t const mapBegin = byteBegin / pageSize * pageSize;
+    uint64_t const mapLength = byteEnd - mapBegin;
+
+    // accessing pages beyond the end of the file raises SIGBUS, i.e., the file must not have been truncated since it
+    // was opened
+    struct stat fileStat;
+    if (fstat(rc.fd, &fileStat) != 0 || static_cast<uint64_t>(fileStat.st_size) < byteEnd)
+    {
+        std::cerr << "ERROR: " << rc.path << " is truncated.\n";
+        return false;
+    }
+
+    void * const mapped = mmap(nullptr, mapLength, PROT_READ, MAP_PRIVATE, rc.fd, mapBegin);
+    if (mapped == MAP_FAILED)
+    {
+        std::cerr << "ERROR: Could not memory-map " << rc.path << ".\n";
+        return false;
+    }
+    char const * const values = static_cast<char const *>(mapped) + (byteBegin - mapBegin);
+
+    std::string buffer;
+    buffer.reserve(TEXT_BUFFER_SIZE);
+    for (uint64_t pos = begin; pos < end; ++pos)
+    {
+        buffer += rc.names[id];
+        buffer += '\t';
+        appendInteger(buffer, pos + 1);
+        buffer += '\t';
+        char const * const value = values + (pos - begin) * rc.header.valueSize;
+        if (rc.header.valueType == OutputType::mappability)
+        {
+            float v;
+            memcpy(&v, value, sizeof(v));
+            appendFloat(buffer, v);
+        }
+        else if (rc.header.valueType == OutputType::frequency_small)
+        {
+            appendInteger(buffer, static_cast<uint8_t>(*value));
+        }
+        else
+        {
+            uint16_t v;
+            memcpy(&v, value, sizeof(v));
+            appendInteger(buffer, v);
+        }
+        buffer += '\n';
+
+        if (buffer.size() >= TEXT_BUFFER_SIZE)
+        {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+    out.write(buffer.data(), buffer.size());
+
+    munmap(mapped, mapLength);
+    return true;
+}
+
+int queryMain(int argc, char const ** argv)
+{
+    // Argument parser
+    ArgumentParser parser("GenMap query");
+    sharedSetup(parser);
+    addDescription(parser,
+        "Tool for retrieving the mappability/frequency values of regions from a raw container file (.gmr) of 'genmap map --raw-container'. "
+        "Outputs one line per position (sequence name, 1-based position, value).");
+
+    addOption(parser, ArgParseOption("I", "input", "Path to the raw container file", ArgParseArgument::INPUT_FILE, "IN"));
+    setRequired(parser, "input");
+    setValidValues(parser, "input", "gmr");
+
+    addOption(parser, ArgParseOption("R", "region", "Region chr:start-end (1-based, end inclusive), chr:start or chr. "
+        "The sequence can be given by its name or fasta id. Can be given multiple times. If not set, all values are output.",
+        ArgParseArgument::STRING, "STR", true));
+
+    addOption(parser, ArgParseOption("O", "output", "Path to the output file. If not set, the values are written to stdout.", ArgParseArgument::OUTPUT_FILE, "OUT"));
+
+    addOption(parser, ArgParseOption("H", "header", "Outputs the parameters of the computation and the sequences of the file instead of values."));
+
+    ArgumentParser::ParseResult res = parse(parser, argc, argv);
+    if (res != ArgumentParser::PARSE_OK)
+        return res == ArgumentParser::PARSE_ERROR;
+
+    CharString inputPath, outputPath;
+    getOptionValue(inputPath, parser, "input");
+    getOptionValue(outputPath, parser, "output");
+
+    RawContainer rc;
+    if (!openRawContainer(rc, toCString(inputPath)))
+        return 1;
+
+    // resolve all regions before writing any output
+    std::vector<std::tuple<uint64_t, uint64_t, uint64_t> > regions; // (sequence, begin, end)
+    for (uint64_t i = 0; i < getOptionValueCount(parser, "region"); ++i)
+    {
+        std::string region, name;
+        uint64_t id, begin, end;
+        getOptionValue(region, parser, "region", i);
+        if (findRawContainerChromosome(rc, region, id)) // sequence names can contain colons
+        {
+            regions.emplace_back(id, 0, rc.chromosomes[id].length);
+            continue;
+        }
+        if (!parseRegion(region, name, begin, end))
+        {
+            std::cerr << "ERROR: Invalid region " << region << ". Please use chr:start-end (1-based, end inclusive).\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+        if (!findRawContainerChromosome(rc, name, id))
+        {
+            std::cerr << "ERROR: The sequence " << name << " does not exist in " << inputPath << ".\n";
+            return ArgumentParser::PARSE_ERROR;
+        }
+        regions.emplace_back(id, begin, end);
+    }
+    if (!isSet(parser, "region"))
+    {
+        for (uint64_t id = 0; id < rc.chromosomes.size(); ++id)
+            regions.emplace_back(id, 0, rc.chromosomes[id].length);
+    }
+
+    std::ofstream outputFile;
+    if (isSet(parser, "output"))
+        outputFile.open(toCString(outputPath));
+    std::ostream & out = isSet(parser, "output") ? outputFile : std::cout;
+
+    if (isSet(parser, "header"))
+    {
+        char const * const valueTypes[] = {"mappability", "frequency-large", "frequency-small"};
+        out << "length\t" << rc.header.kmerLength << '\n'
+            << "errors\t" << rc.header.errors << '\n'
+            << "indels\t" << rc.header.indels << '\n'
+            << "reverse-complement\t" << rc.header.revCompl << '\n'
+            << "exclude-pseudo\t" << rc.header.excludePseudo << '\n'
+            << "values\t" << valueTypes[rc.header.valueType] << '\n';
+        for (uint64_t id = 0; id < rc.chromosomes.size(); ++id)
+            out << "sequence\t" << rc.names[id] << '\t' << rc.chromosomes[id].length << '\n';
+        return 0;
+    }
+
+    for (auto const & region : regions)
+        if (!queryRegion(out, rc, std::get<0>(region), std::get<1>(region), std::get<2>(region)))
+            return 1;
+
+    return 0;
+}
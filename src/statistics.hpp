@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "frequencies.hpp"
+#include "outputfile.hpp"
+
+// ----------------------------------------------------------------------------
+// Statistics file (--statistics)
+// ----------------------------------------------------------------------------
+// Summary of the frequencies of each sequence, computed from the frequency vector right after the computation (i.e.,
+// while it is still in memory and without reading any output file). Only the k-mers that lie entirely within a
+// sequence are counted, the last k-1 positions of a sequence are never searched. K-mers with a frequency of 0 contain
+// an N and are only counted in the number of k-mers and the histogram (i.e., not in the unique fraction and the mean
+// mappability, as in the bins). The histogram bins are 0, 1, 2, 3-4, 5-8, ..., 32769-65536.
+
+#define     STATISTICS_BINS         18
+#define     STATISTICS_BLOCK_SIZE   (1 << 20) // positions decoded and counted at once by a thread
+
+struct SequenceStatistics
+{
+    uint64_t length = 0;
+    uint64_t kmers = 0;
+    double mappabilitySum = 0; // sum of the mappabilities of all k-mers (without N)
+    std::array<uint64_t, STATISTICS_BINS> histogram{};
+};
+
+namespace genmap::detail
+{
+
+inline unsigned statisticsBin(uint64_t const frequency)
+{
+    if (frequency <= 1)
+        return frequency;
+    return std::min<unsigned>(65 - __builtin_clzll(frequency - 1), STATISTICS_BINS - 1);
+}
+
+inline std::string statisticsBinName(unsigned const bin)
+{
+    if (bin <= 2)
+        return std::to_string(bin);
+    return std::to_string((1ull << (bin - 2)) + 1) + '-' + std::to_string(1ull << (bin - 1));
+}
+
+inline void addStatistics(SequenceStatistics & stats, SequenceStatistics const & other)
+{
+    stats.length += other.length;
+    stats.kmers += other.kmers;
+    stats.mappabilitySum += other.mappabilitySum;
+    for (unsigned b = 0; b < STATISTICS_BINS; ++b)
+        stats.histogram[b] += other.histogram[b];
+}
+
+} // namespace genmap::detail
+
+// Appends the statistics of the sequences [firstSeq, lastSeq) to stats. c covers exactly these sequences. The blocks
+// of the sequences are counted in parallel (one accumulator per block) and merged into the statistics of their
+// sequence.
+template <typename TContainer, typename TChromosomeLengths>
+void computeStatistics(std::vector<SequenceStatistics> & stats, TContainer const & c, TChromosomeLengths const & chromLengths,
+                       uint64_t const firstSeq, uint64_t const lastSeq, uint64_t const kmerLength, unsigned const threads)
+{
+    using namespace genmap::detail;
+    typedef typename TContainer::value_type T;
+
+    struct Block
+    {
+        uint64_t seqNo, begin, end; // positions in c
+    };
+
+    std::vector<Block> blocks;
+    uint64_t seqBegin = 0;
+    for (uint64_t i = firstSeq; i < lastSeq; ++i)
+    {
+        uint64_t const kmers = (chromLengths[i] >= kmerLength) ? chromLengths[i] - kmerLength + 1 : 0;
+        for (uint64_t begin = seqBegin; begin < seqBegin + kmers; begin += STATISTICS_BLOCK_SIZE)
+            blocks.push_back({stats.size(), begin, std::min<uint64_t>(begin + STATISTICS_BLOCK_SIZE, seqBegin + kmers)});
+
+        stats.emplace_back();
+        stats.back().length = chromLengths[i];
+        stats.back().kmers = kmers;
+        seqBegin += chromLengths[i];
+    }
+
+    std::vector<std::vector<T> > values(threads, std::vector<T>(STATISTICS_BLOCK_SIZE));
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+    for (uint64_t b = 0; b < blocks.size(); ++b)
+    {
+        std::vector<T> & blockValues = values[omp_get_thread_num()];
+        uint64_t const n = blocks[b].end - blocks[b].begin;
+        getFrequencies(c, blocks[b].begin, n, blockValues.data());
+
+        SequenceStatistics blockStats;
+        for (uint64_t k = 0; k < n; ++k)
+        {
+            T const v = blockValues[k];
+            ++blockStats.histogram[statisticsBin(v)];
+            if (v != 0)
+                blockStats.mappabilitySum += 1.0 / v;
+        }
+
+        #pragma omp critical
+        addStatistics(stats[blocks[b].seqNo], blockStats);
+    }
+}
+
+// Writes the statistics as a tsv file (one row per sequence and a total row).
+template <typename TChromosomeNames>
+void saveStatistics(std::vector<SequenceStatistics> const & stats, std::string const & output_path,
+                    TChromosomeNames const & chromNames)
+{
+    using namespace genmap::detail;
+
+    OutputFile file;
+    openOutputFile(file, output_path + ".stats.tsv");
+    OutputStreamBuffer streamBuffer(file);
+    std::ostream outfile(&streamBuffer);
+    outfile << "sequence\tlength\tkmers\tunique\tunique_fraction\tmean_mappability";
+    for (unsigned b = 0; b < STATISTICS_BINS; ++b)
+        outfile << "\tfrequency_" << statisticsBinName(b);
+    outfile << '\n';
+
+    auto writeRow = [&outfile] (auto const & name, SequenceStatistics const & row)
+    {
+        uint64_t const searchable = row.kmers - row.histogram[0]; // k-mers without N
+        outfile << name << '\t' << row.length << '\t' << row.kmers << '\t' << row.histogram[1] << '\t'
+                << ((searchable > 0) ? static_cast<double>(row.histogram[1]) / searchable : 0.0) << '\t'
+                << ((searchable > 0) ? row.mappabilitySum / searchable : 0.0);
+        for (unsigned b = 0; b < STATISTICS_BINS; ++b)
+            outfile << '\t' << row.histogram[b];
+        outfile << '\n';
+    };
+
+    SequenceStatistics total;
+    for (uint64_t i = 0; i < stats.size(); ++i)
+    {
+        writeRow(chromNames[i], stats[i]);
+        addStatistics(total, stats[i]);
+    }
+    writeRow("total", total);
+
+    outfile.flush();
+    closeOutputFile(file);
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <seqan/arg_parse.h>
+
+#include "common.hpp"
+#include "genmap_helper.hpp"
+#include "output.hpp"
+
+using namespace seqan;
+
+template <typename TStream>
+inline bool viewLocations(TStream & csvFile, std::string const & locPath, bool const filterSequence, uint64_t const sequence)
+{
+    using namespace genmap::detail;
+    using TLocation = Pair<uint64_t, uint64_t>;
+
+    std::ifstream locFile(locPath, std::ios::in | std::ios::binary);
+    if (!locFile.good())
+    {
+        std::cerr << "ERROR: Could not open " << locPath << ".\n";
+        return false;
+    }
+
+    LocationsFileHeader header;
+    char headerData[LOCATIONS_HEADER_SIZE];
+    locFile.read(headerData, sizeof(headerData));
+    if (!locFile.good() || !readLocationsHeader(headerData, headerData + sizeof(headerData), header) ||
+        std::string(header.magic, strnlen(header.magic, sizeof(header.magic))) != "GMLOC")
+    {
+        std::cerr << "ERROR: " << locPath << " is not a GenMap locations file.\n";
+        return false;
+    }
+    if (header.version != LOCATIONS_VERSION)
+    {
+        std::cerr << "ERROR: " << locPath << " has version " << header.version << ", but only version "
+                  << LOCATIONS_VERSION << " is supported.\n";
+        return false;
+    }
+    if (header.byteOrder != LOCATIONS_BYTE_ORDER)
+    {
+        std::cerr << "ERROR: " << locPath << " has an unknown byte order.\n";
+        return false;
+    }
+
+    // all offsets and sizes are checked against the file size, i.e., a truncated or corrupt file is never read past
+    // its end (or past the end of a block)
+    auto corrupt = [&locPath] ()
+    {
+        std::cerr << "ERROR: " << locPath << " is truncated or corrupt.\n";
+        return false;
+    };
+    locFile.seekg(0, std::ios::end);
+    uint64_t const fileSize = locFile.tellg();
+    locFile.seekg(LOCATIONS_HEADER_SIZE);
+    if (header.blockIndexOffset > fileSize || header.fastaFiles > header.blockIndexOffset ||
+        header.blocks > (fileSize - header.blockIndexOffset) / LOCATIONS_BLOCK_ENTRY_SIZE)
+    {
+        return corrupt();
+    }
+
+    TFastaFiles fastaFiles(header.fastaFiles);
+    for (auto & fastaFile : fastaFiles)
+    {
+        // last chromosome (uint64_t) and length of the name (uint32_t)
+        char fastaFileData[12];
+        locFile.read(fastaFileData, sizeof(fastaFileData));
+        char const * it = fastaFileData;
+        uint64_t lastChromosome;
+        uint32_t nameLength;
+        if (!locFile.good() || !readFixed(it, fastaFileData + sizeof(fastaFileData), lastChromosome) ||
+            !readFixed(it, fastaFileData + sizeof(fastaFileData), nameLength) || nameLength > header.blockIndexOffset)
+        {
+            return corrupt();
+        }
+        fastaFile.second = lastChromosome;
+        fastaFile.first.resize(nameLength);
+        locFile.read(&fastaFile.first[0], nameLength);
+    }
+    uint64_t const blocksBegin = locFile.tellg();
+    if (!locFile.good() || blocksBegin > header.blockIndexOffset)
+        return corrupt();
+
+    std::vector<LocationsBlockIndexEntry> blockIndex(header.blocks);
+    {
+        std::string blockIndexData(header.blocks * LOCATIONS_BLOCK_ENTRY_SIZE, '\0');
+        locFile.seekg(header.blockIndexOffset);
+        locFile.read(&blockIndexData[0], blockIndexData.size());
+        char const * it = blockIndexData.data();
+        for (LocationsBlockIndexEntry & entry : blockIndex)
+            if (!locFile.good() || !readLocationsBlockIndexEntry(it, blockIndexData.data() + blockIndexData.size(), entry))
+                return corrupt();
+    }
+    for (uint64_t b = 0; b < blockIndex.size(); ++b)
+    {
+        uint64_t const blockEnd = (b + 1 < blockIndex.size()) ? blockIndex[b + 1].offset : header.blockIndexOffset;
+        if (blockIndex[b].offset < blocksBegin || blockIndex[b].offset > blockEnd ||
+            blockIndex[b].kmers > LOCATIONS_BLOCK_SIZE)
+        {
+            return corrupt();
+        }
+    }
+
+    // use the block index to only decode blocks that can contain k-mers of the requested sequence
+    uint64_t firstBlock = 0;
+    if (filterSequence)
+    {
+        firstBlock = std::lower_bound(blockIndex.begin(), blockIndex.end(), sequence,
+                                      [] (LocationsBlockIndexEntry const & entry, uint64_t const seqNo)
+                                      {
+                                          return entry.seqNo < seqNo;
+                                      }) - blockIndex.begin();
+        if (firstBlock > 0)
+            --firstBlock;
+    }
+
+    writeCsvHeader(csvFile, fastaFiles, header.revCompl);
+
+    std::string buffer;
+    std::vector<std::pair<std::vector<TLocation>, std::vector<TLocation> > > records;
+    for (uint64_t b = firstBlock; b < blockIndex.size(); ++b)
+    {
+        if (filterSequence && blockIndex[b].seqNo > sequence)
+            break;
+
+        uint64_t const blockEnd = (b + 1 < blockIndex.size()) ? blockIndex[b + 1].offset : header.blockIndexOffset;
+        buffer.resize(blockEnd - blockIndex[b].offset);
+        locFile.seekg(blockIndex[b].offset);
+        locFile.read(&buffer[0], buffer.size());
+        if (!locFile.good())
+            return corrupt();
+
+        char const * it = buffer.data();
+        char const * const end = buffer.data() + buffer.size();
+        TLocation kmerPos(0, 0);
+        records.resize(blockIndex[b].kmers);
+        for (uint64_t record = 0; record < blockIndex[b].kmers; ++record)
+        {
+            uint64_t backReference;
+            if (!readLocationVarint(it, end, kmerPos, record == 0) || !readVarint(it, end, backReference) ||
+                backReference > record)
+            {
+                return corrupt();
+            }
+
+            if (backReference > 0)
+            {
+                records[record] = records[record - backReference];
+            }
+            else
+            {
+                if (!readLocationsVarint(it, end, records[record].first))
+                    return corrupt();
+                if (!header.revCompl)
+                    records[record].second.clear();
+                else if (!readLocationsVarint(it, end, records[record].second))
+                    return corrupt();
+            }
+
+            if (!filterSequence || kmerPos.i1 == sequence)
+                writeCsvRow(csvFile, kmerPos, records[record].first, records[record].second, fastaFiles, header.revCompl);
+        }
+    }
+
+    return true;
+}
+
+int viewMain(int argc, char const ** argv)
+{
+    // Argument parser
+    ArgumentParser parser("GenMap view");
+    sharedSetup(parser);
+    addDescription(parser,
+        "Tool for converting the binary locations file (.loc) of 'genmap map --locations' into the csv format of 'genmap map --csv'.");
+
+    addOption(parser, ArgParseOption("I", "input", "Path to the locations file", ArgParseArgument::INPUT_FILE, "IN"));
+    setRequired(parser, "input");
+    setValidValues(parser, "input", "loc");
+
+    addOption(parser, ArgParseOption("O", "output", "Path to the csv file. If not set, the csv file is written to stdout.", ArgParseArgument::OUTPUT_FILE, "OUT"));
+    setValidValues(parser, "output", "csv");
+
+    addOption(parser, ArgParseOption("s", "sequence", "Only outputs the k-mers of a single sequence (0-based number of the sequence among all indexed fasta files, i.e., the first number of the k-mer column).", ArgParseArgument::INT64, "INT"));
+
+    ArgumentParser::ParseResult res = parse(parser, argc, argv);
+    if (res != ArgumentParser::PARSE_OK)
+        return res == ArgumentParser::PARSE_ERROR;
+
+    CharString inputPath, outputPath;
+    int64_t sequence = 0;
+    getOptionValue(inputPath, parser, "input");
+    getOptionValue(outputPath, parser, "output");
+    getOptionValue(sequence, parser, "sequence");
+    bool const filterSequence = isSet(parser, "sequence");
+
+    if (sequence < 0)
+    {
+        std::cerr << "ERROR: The sequence number cannot be negative.\n";
+        return ArgumentParser::PARSE_ERROR;
+    }
+
+    bool success;
+    if (isSet(parser, "output"))
+    {
+        genmap::detail::OutputFile file;
+        genmap::detail::openOutputFile(file, toCString(outputPath));
+        genmap::detail::OutputStreamBuffer streamBuffer(file);
+        std::ostream csvFile(&streamBuffer);
+        success = viewLocations(csvFile, toCString(inputPath), filterSequence, sequence);
+        csvFile.flush();
+        genmap::detail::closeOutputFile(file);
+    }
+    else
+    {
+        success = viewLocations(std::cout, toCString(inputPath), filterSequence, sequence);
+    }
+
+    return success ? 0 : 1;
+}
@@ -1,6 +1,13 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+
+#include <malloc.h>
+#include <unistd.h>
 
 #include <seqan/arg_parse.h>
 #include <seqan/seq_io.h>
@@ -10,14 +17,118 @@ static constexpr bool outputProgress = false;
 
 #include "../src/common.hpp"
 #include "../src/algo.hpp"
+#include "../src/bgzf.hpp"
+#include "../src/bigwig.hpp"
+#include "../src/genmap_helper.hpp"
+#include "../src/mappability.hpp"
+#include "../src/query.hpp"
+#include "../src/statistics.hpp"
+#include "../src/view.hpp"
+
+#include "../include/lambda/src/mkindex_algo.hpp"
 
 using namespace seqan;
 
 std::mt19937_64 rng;
 
+// Heap usage of the test binary (all allocations go through the global operator new), e.g., to check the peak memory
+// of the index construction.
+std::atomic<uint64_t> heapUsage{0};
+std::atomic<uint64_t> heapPeak{0};
+
+void * operator new(std::size_t size)
+{
+    void * ptr = std::malloc(std::max<std::size_t>(size, 1));
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    uint64_t const usage = heapUsage += malloc_usable_size(ptr);
+    uint64_t peak = heapPeak;
+    while (usage > peak && !heapPeak.compare_exchange_weak(peak, usage))
+        ;
+    return ptr;
+}
+
+void operator delete(void * ptr) noexcept
+{
+    if (ptr != nullptr)
+        heapUsage -= malloc_usable_size(ptr);
+    std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+template <typename TResult, typename TPosition, typename TLimits>
+inline void myPosLocalizeBinarySearch(TResult & result, TPosition const & pos, TLimits const & limits)
+{
+    auto const upper = std::upper_bound(limits.begin(), limits.end(), pos) - 1;
+    result.i1 = upper - limits.begin();
+    result.i2 = pos - *upper;
+}
+
 template <typename TSpec, typename TLengthSum, unsigned LEVELS, unsigned WORDS_PER_BLOCK>
 unsigned GemMapFastFMIndexConfig<TSpec, TLengthSum, LEVELS, WORDS_PER_BLOCK>::SAMPLING = 10;
 
+// Temporary directory that is unique to the running test and process, i.e., the tests can run concurrently.
+inline std::filesystem::path testDirectory()
+{
+    ::testing::TestInfo const * info = ::testing::UnitTest::GetInstance()->current_test_info();
+    std::filesystem::path const dir = std::filesystem::temp_directory_path() /
+        ("genmap_test_" + std::string(info->test_case_name()) + "_" + info->name() + "_" + std::to_string(getpid()));
+    std::filesystem::create_directories(dir);
+    return dir;
+}
+
+inline std::string readFile(std::string const & path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// Saves the given fibres of an index to a new directory and returns the contents of the written files by file name,
+// e.g., to compare the fibres of indices that were built differently byte by byte.
+template <typename... TFibres>
+inline std::map<std::string, std::string> saveFibres(std::filesystem::path const & dir, TFibres const & ... fibres)
+{
+    std::filesystem::create_directories(dir);
+    unsigned fibreNo = 0;
+    (save(fibres, (dir / ("fibre" + std::to_string(fibreNo++))).c_str()), ...);
+
+    std::map<std::string, std::string> files;
+    for (auto const & file : std::filesystem::directory_iterator(dir))
+        files[file.path().filename().string()] = readFile(file.path().string());
+    return files;
+}
+
+// Output tests write to the prefix path in a temporary directory which is removed afterwards.
+class GenMapOutput : public ::testing::Test
+{
+protected:
+    std::filesystem::path dir;
+    std::string path;
+    StringSet<CharString> chromNames;
+    StringSet<uint64_t> chromLengths;
+
+    void SetUp() override
+    {
+        dir = testDirectory();
+        path = (dir / "genmap_test").string();
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    void addSequence(std::string const & name, uint64_t const length)
+    {
+        appendValue(chromNames, name);
+        appendValue(chromLengths, length);
+    }
+};
+
 template <typename TChar, typename TSpec, typename TRng>
 void randomText(String<TChar, TSpec> & string, TRng & rng, uint64_t const length)
 {
@@ -135,6 +246,7 @@ void test(uint64_t const nbrChromosomes, uint64_t const lengthChromosomes, uint6
 {
     using TIndexConfig = TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t>>;
 
+    std::filesystem::path const dir = testDirectory();
     for (uint64_t it = 0; it < iterations; ++it)
     {
         typedef StringSet<String<TChar>, Owner<ConcatDirect<> > > TGenome;
@@ -179,13 +291,36 @@ void test(uint64_t const nbrChromosomes, uint64_t const lengthChromosomes, uint6
                 // std::cout << "E: " << errors << ", K: " << k << ", O: " << overlap << std::endl;
 
                 using TLocation = Pair<uint16_t, uint32_t>;
-                std::map<TLocation, std::pair<std::vector<TLocation>, std::vector<TLocation> > > locations;
-                std::vector<uint16_t> mappingSeqIdFile(0);
+                KmerLocations<TLocation> locations;
+                FastaFileIds fileIds;
 
                 // TODO: TDistance
                 frequencyGenMap.assign(totalLength, 0);
-                computeMappability<errors, false>(index, text, frequencyGenMap, searchParams, false /*dir*/, chromLengths, locations, mappingSeqIdFile);
+                computeMappability<errors, false, false>(index, text, frequencyGenMap, searchParams, false /*dir*/, chromLengths, locations, fileIds);
 
+                EXPECT_EQ(frequencyTrivial, frequencyGenMap);
+
+                // chunked mode with one sequence per chunk
+                SpillFiles spill;
+                spill.chunkBegins.push_back(0);
+                for (uint64_t ss = 0; ss < nbrChromosomes; ++ss)
+                    spill.chunkBegins.push_back(spill.chunkBegins.back() + chromLengths[ss]);
+                createSpillFiles(spill, (dir / "genmap_test").string());
+
+                frequencyGenMap.clear();
+                for (uint64_t ss = 0; ss < nbrChromosomes; ++ss)
+                {
+                    FrequencyChunk chunk;
+                    chunk.firstSeq = ss;
+                    chunk.lastSeq = ss + 1;
+                    chunk.id = ss;
+                    chunk.spill = &spill;
+
+                    std::vector<uint8_t> frequencyChunk(chromLengths[ss], 0);
+                    loadSpill(spill, ss, frequencyChunk);
+                    computeMappability<errors, false, false>(index, text, frequencyChunk, searchParams, false /*dir*/, chromLengths, locations, fileIds, chunk);
+                    frequencyGenMap.insert(frequencyGenMap.end(), frequencyChunk.begin(), frequencyChunk.end());
+                }
                 EXPECT_EQ(frequencyTrivial, frequencyGenMap);
                 // if (frequencyTrivial != frequencyGenMap)
                 // {
@@ -201,6 +336,7 @@ void test(uint64_t const nbrChromosomes, uint64_t const lengthChromosomes, uint6
             }
         }
     }
+    std::filesystem::remove_all(dir);
 }
 
 TEST(GenMapAlgo, exact_dna4)
@@ -253,6 +389,1143 @@ TEST(GenMapAlgo, hamming_4_dna5)
     test<Dna5, HammingDistance, 4>(3, 1000, 1);
 }
 
+// Exact copies are located in batches. The frequencies have to be the same for every batch size, in particular when
+// the exact copies are written after every window (locateBatchSize = 1).
+template <unsigned errors>
+void testBatchedLocate()
+{
+    using TIndexConfig = TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t>>;
+    typedef StringSet<String<Dna>, Owner<ConcatDirect<> > > TGenome;
+
+    // repeats with a few mutations, i.e., most k-mers have many exact copies (also on the other sequences)
+    String<Dna> unit;
+    randomText(unit, rng, 300);
+    TGenome genome;
+    StringSet<uint64_t> chromLengths;
+    for (uint64_t ss = 0; ss < 3; ++ss)
+    {
+        String<Dna> chr;
+        for (uint64_t r = 0; r < 10 + ss; ++r)
+            append(chr, unit);
+        for (uint64_t m = 0; m < 30; ++m)
+            chr[rng() % length(chr)] = Dna(rng() % 4);
+        appendValue(genome, chr);
+        appendValue(chromLengths, length(chr));
+    }
+
+    Index<TGenome, TIndexConfig> index(genome);
+    indexCreate(index, FibreSALF());
+    auto const & text = indexText(index).concat;
+
+    for (uint64_t k : {12, 30})
+    {
+        SearchParams searchParams;
+        searchParams.length = k;
+        searchParams.overlap = k / 2;
+        searchParams.threads = 4;
+        searchParams.revCompl = true;
+        searchParams.excludePseudo = false;
+
+        std::vector<uint16_t> frequencyTrivial(length(text), 0);
+        computeMappabilityTrivial<HammingDistance, Dna>(index, frequencyTrivial, searchParams, errors);
+
+        for (uint64_t batchSize : {1, 100, 1 << 12})
+        {
+            searchParams.locateBatchSize = batchSize;
+            KmerLocations<Pair<uint16_t, uint32_t> > locations;
+            FastaFileIds fileIds;
+            std::vector<uint16_t> frequencyGenMap(length(text), 0);
+            computeMappability<errors, false, false>(index, text, frequencyGenMap, searchParams, false /*dir*/, chromLengths, locations, fileIds);
+            EXPECT_EQ(frequencyTrivial, frequencyGenMap);
+        }
+    }
+}
+
+TEST(GenMapAlgo, batched_locate)
+{
+    testBatchedLocate<0>();
+    testBatchedLocate<1>();
+}
+
+TEST(GenMapAlgo, csv_frequency_filter)
+{
+    using TIndexConfig = TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t>>;
+    typedef StringSet<String<Dna>, Owner<ConcatDirect<> > > TGenome;
+    using TLocation = Pair<uint16_t, uint32_t>;
+
+    // the k-mers of unit 0 occur about 280 times and the k-mers of unit 1 about 320 times, i.e., the frequencies of both
+    // exceed the maximum of uint8_t and only the former are in the range [2, 300]
+    String<Dna> units[2];
+    randomText(units[0], rng, 40);
+    randomText(units[1], rng, 40);
+    TGenome genome;
+    StringSet<uint64_t> chromLengths;
+    std::vector<std::array<uint64_t, 2> > const unitRepeats = {{200, 200}, {80, 0}, {0, 120}};
+    for (auto const & repeats : unitRepeats)
+    {
+        String<Dna> chr;
+        for (unsigned u = 0; u < 2; ++u)
+            for (uint64_t r = 0; r < repeats[u]; ++r)
+                append(chr, units[u]);
+        appendValue(genome, chr);
+        appendValue(chromLengths, length(chr));
+    }
+
+    Index<TGenome, TIndexConfig> index(genome);
+    indexCreate(index, FibreSALF());
+    auto const & text = indexText(index).concat;
+
+    SearchParams searchParams;
+    searchParams.length = 10;
+    searchParams.overlap = 5;
+    searchParams.threads = 2;
+    searchParams.revCompl = false;
+    searchParams.excludePseudo = false;
+    searchParams.csvMinFrequency = 2;
+    searchParams.csvMaxFrequency = 300;
+
+    std::vector<uint64_t> frequencies(length(text), 0);
+    computeMappabilityTrivial<HammingDistance, Dna>(index, frequencies, searchParams, 0);
+
+    KmerLocations<TLocation> locations;
+    FastaFileIds fileIds;
+    std::vector<uint8_t> c(length(text), 0);
+    computeMappability<0, true, false>(index, text, c, searchParams, false /*dir*/, chromLengths, locations, fileIds);
+
+    uint64_t pos = 0, located = 0;
+    for (uint64_t i = 0; i < length(chromLengths); ++i)
+    {
+        for (uint64_t seqPos = 0; seqPos + searchParams.length <= chromLengths[i]; ++seqPos)
+        {
+            uint64_t const frequency = frequencies[pos + seqPos];
+            bool const inRange = frequency >= 2 && frequency <= 300;
+            auto const it = locations.positions.find(TLocation(i, seqPos));
+            ASSERT_EQ(it != locations.positions.end(), inRange) << "frequency " << frequency;
+            if (inRange)
+            {
+                EXPECT_EQ(locations.groups[it->second].first.size(), frequency);
+                ++located;
+            }
+        }
+        pos += chromLengths[i];
+    }
+    EXPECT_EQ(locations.positions.size(), located);
+    EXPECT_GT(located, 0u);
+    EXPECT_GT(std::count(frequencies.begin(), frequencies.end(), 280), 0);
+    EXPECT_GT(std::count(frequencies.begin(), frequencies.end(), 320), 0);
+}
+
+// exact copies of a k-mer refer to the same group, even if they are searched at the same time by different threads
+TEST(GenMapAlgo, csv_exact_copies)
+{
+    using TIndexConfig = TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t>>;
+    typedef StringSet<String<Dna>, Owner<ConcatDirect<> > > TGenome;
+    using TLocation = Pair<uint16_t, uint32_t>;
+
+    // repeats of a unit with a few mutations
+    String<Dna> unit;
+    randomText(unit, rng, 50);
+    TGenome genome;
+    StringSet<uint64_t> chromLengths;
+    for (uint64_t i = 0; i < 3; ++i)
+    {
+        String<Dna> chr;
+        for (uint64_t r = 0; r < 60; ++r)
+            append(chr, unit);
+        for (uint64_t m = 0; m < 20; ++m)
+            chr[rng() % length(chr)] = Dna(rng() % 4);
+        appendValue(genome, chr);
+        appendValue(chromLengths, length(chr));
+    }
+
+    Index<TGenome, TIndexConfig> index(genome);
+    indexCreate(index, FibreSALF());
+    auto const & text = indexText(index).concat;
+
+    SearchParams searchParams;
+    searchParams.length = 10;
+    searchParams.threads = 4;
+    searchParams.revCompl = false;
+    searchParams.excludePseudo = false;
+
+    for (unsigned const overlap : {5, 9})
+    {
+        searchParams.overlap = overlap;
+        KmerLocations<TLocation> locations;
+        FastaFileIds fileIds;
+        std::vector<uint16_t> c(length(text), 0);
+        computeMappability<0, true, false>(index, text, c, searchParams, false /*dir*/, chromLengths, locations, fileIds);
+
+        // every group (except for the empty group 0) is referred to by a k-mer and no group is stored twice
+        std::vector<bool> referenced(locations.groups.size(), false);
+        for (auto const & position : locations.positions)
+            referenced[position.second] = true;
+        EXPECT_EQ(std::count(referenced.begin() + 1, referenced.end(), false), 0) << "overlap " << overlap;
+
+        auto groups = locations.groups;
+        std::sort(groups.begin(), groups.end());
+        EXPECT_EQ(std::adjacent_find(groups.begin(), groups.end()), groups.end()) << "overlap " << overlap;
+
+        // the frequency of every k-mer is the size of its group
+        uint64_t pos = 0;
+        for (uint64_t i = 0; i < length(chromLengths); ++i)
+        {
+            for (uint64_t seqPos = 0; seqPos + searchParams.length <= chromLengths[i]; ++seqPos)
+            {
+                auto const & group = locations.groups[locations.positions.at(TLocation(i, seqPos))];
+                EXPECT_EQ(c[pos + seqPos], group.first.size());
+            }
+            pos += chromLengths[i];
+        }
+    }
+}
+
+// sequences shorter than k (including a sequence of length 1) contain no k-mer, neither do k-mers spanning sequences
+TEST(GenMapAlgo, short_sequences)
+{
+    using TIndexConfig = TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t>>;
+    typedef StringSet<String<Dna>, Owner<ConcatDirect<> > > TGenome;
+
+    TGenome genome;
+    StringSet<uint64_t> chromLengths;
+    for (char const * sequence : {"ACGTAC", "CGT", "G", "TACGT"})
+    {
+        appendValue(genome, String<Dna>(sequence));
+        appendValue(chromLengths, length(back(genome)));
+    }
+
+    Index<TGenome, TIndexConfig> index(genome);
+    indexCreate(index, FibreSALF());
+    auto const & text = indexText(index).concat;
+
+    SearchParams searchParams;
+    searchParams.length = 4;
+    searchParams.revCompl = false;
+    searchParams.excludePseudo = false;
+
+    // ACGT occurs twice (0,0 and 3,1), all other k-mers once
+    std::vector<uint8_t> const expected = {2, 1, 1, 0, 0, 0,  0, 0, 0,  0,  1, 2, 0, 0, 0};
+    for (unsigned threads : {1, 3})
+    {
+        for (unsigned overlap : {1, 2, 3})
+        {
+            searchParams.threads = threads;
+            searchParams.overlap = overlap;
+
+            KmerLocations<Pair<uint16_t, uint32_t> > locations;
+            FastaFileIds fileIds;
+            std::vector<uint8_t> c(length(text), 0);
+            computeMappability<0, false, false>(index, text, c, searchParams, false /*dir*/, chromLengths, locations, fileIds);
+            EXPECT_EQ(c, expected) << "threads " << threads << ", overlap " << overlap;
+        }
+    }
+}
+
+// the csv file has a row for every position, k-mers spanning two sequences and positions of sequences shorter than k
+// have no occurrences
+TEST(GenMapAlgo, csv_spanning_kmers)
+{
+    using TIndexConfig = TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t>>;
+    typedef StringSet<String<Dna>, Owner<ConcatDirect<> > > TGenome;
+    using TLocation = Pair<uint16_t, uint32_t>;
+
+    TGenome genome;
+    StringSet<uint64_t> chromLengths;
+    StringSet<CharString> directoryInformation;
+    for (char const * sequence : {"ACGTAC", "CGT", "G", "TACGT"})
+    {
+        appendValue(genome, String<Dna>(sequence));
+        appendValue(chromLengths, length(back(genome)));
+        std::string const row = "a.fa;" + std::to_string(length(back(genome))) + ";seq" + std::to_string(length(genome) - 1);
+        appendValue(directoryInformation, CharString(row.c_str()));
+    }
+    appendValue(directoryInformation, "dummy.entry;0;chromosomename");
+
+    Index<TGenome, TIndexConfig> index(genome);
+    indexCreate(index, FibreSALF());
+    auto const & text = indexText(index).concat;
+
+    SearchParams searchParams;
+    searchParams.length = 4;
+    searchParams.overlap = 2;
+    searchParams.threads = 2;
+    searchParams.revCompl = false;
+    searchParams.excludePseudo = false;
+
+    KmerLocations<TLocation> locations;
+    FastaFileIds fileIds;
+    std::vector<uint8_t> c(length(text), 0);
+    computeMappability<0, true, false>(index, text, c, searchParams, false /*dir*/, chromLengths, locations, fileIds);
+
+    // the spanning k-mers (e.g. TAC|C, AC|CG, C|CGT) and the short sequences 1 and 2 are never searched
+    for (auto const & position : locations.positions)
+    {
+        EXPECT_TRUE((position.first.i1 == 0 && position.first.i2 < 3) || (position.first.i1 == 3 && position.first.i2 < 2))
+            << position.first.i1 << ',' << position.first.i2;
+    }
+
+    std::filesystem::path const dir = testDirectory();
+    std::string const path = (dir / "genmap_test").string();
+    saveCsv<false>(path, locations, searchParams, chromLengths, directoryInformation);
+    EXPECT_EQ(readFile(path + ".csv"), "\"k-mer\";\"+ strand a.fa\"\n"
+                                       "0,0;0,0|3,1\n"
+                                       "0,1;0,1\n"
+                                       "0,2;0,2\n"
+                                       "0,3;\n"
+                                       "0,4;\n"
+                                       "0,5;\n"
+                                       "1,0;\n"
+                                       "1,1;\n"
+                                       "1,2;\n"
+                                       "2,0;\n"
+                                       "3,0;3,0\n"
+                                       "3,1;0,0|3,1\n"
+                                       "3,2;\n"
+                                       "3,3;\n"
+                                       "3,4;\n");
+    std::filesystem::remove_all(dir);
+}
+
+TEST(GenMapAlgo, spill_files)
+{
+    std::filesystem::path const dir = testDirectory();
+    std::string const prefix = (dir / "genmap_test").string();
+
+    // a leftover of a previous run with the old naming scheme is not read
+    std::vector<std::pair<uint64_t, uint8_t> > const stale = {{150, 7}, {160, 7}};
+    std::ofstream(prefix + ".spill1", std::ios::binary).write(reinterpret_cast<char const *>(stale.data()),
+                                                              stale.size() * sizeof(stale[0]));
+    {
+        SpillFiles spill;
+        spill.chunkBegins = {0, 100, 200, 300};
+        createSpillFiles(spill, prefix);
+        ASSERT_EQ(spill.paths.size(), 3u);
+
+        std::vector<std::pair<uint64_t, uint8_t> > const entries = {{120, 1}, {250, 2}, {299, 3}};
+        appendSpill(spill, 1, entries.begin(), entries.end());
+
+        std::vector<uint8_t> c(100, 0);
+        loadSpill(spill, 1, c);
+        for (uint64_t i = 0; i < c.size(); ++i)
+            EXPECT_EQ(c[i], (i == 20) ? 1 : 0);
+    }
+
+    // the remaining files are removed by the destructor
+    uint64_t files = 0;
+    for (auto const & entry : std::filesystem::directory_iterator(dir))
+        files += (entry.path() != prefix + ".spill1");
+    EXPECT_EQ(files, 0u);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(GenMapAlgo, compact_frequencies)
+{
+    using TIndexConfig = TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t>>;
+    typedef StringSet<String<Dna>, Owner<ConcatDirect<> > > TGenome;
+
+    TGenome genome;
+    StringSet<uint64_t> chromLengths;
+    for (uint64_t ss = 0; ss < 3; ++ss)
+    {
+        String<Dna> chr;
+        randomText(chr, rng, 1000);
+        appendValue(genome, chr);
+        appendValue(chromLengths, 1000);
+    }
+
+    Index<TGenome, TIndexConfig> index(genome);
+    indexCreate(index, FibreSALF());
+    auto const & text = indexText(index).concat;
+
+    // short k-mers have frequencies >= 255, i.e., they are stored in the escape table
+    for (uint64_t k = 2; k <= 6; ++k)
+    {
+        SearchParams searchParams;
+        searchParams.length = k;
+        searchParams.overlap = k - 1;
+        searchParams.threads = 2;
+        searchParams.revCompl = true;
+        searchParams.excludePseudo = false;
+
+        KmerLocations<Pair<uint16_t, uint32_t> > locations;
+        FastaFileIds fileIds;
+
+        std::vector<uint16_t> frequencies;
+        CompactFrequencies<uint16_t> compactFrequencies;
+        MappedFrequencies<uint16_t> mappedFrequencies;
+        mappedFrequencies.path = testDirectory() / "genmap_test.freq16";
+        initFrequencies(frequencies, length(text), searchParams.threads);
+        initFrequencies(compactFrequencies, length(text), searchParams.threads);
+        initFrequencies(mappedFrequencies, length(text), searchParams.threads);
+        computeMappability<0, false, false>(index, text, frequencies, searchParams, false /*dir*/, chromLengths, locations, fileIds);
+        computeMappability<0, false, false>(index, text, compactFrequencies, searchParams, false /*dir*/, chromLengths, locations, fileIds);
+        computeMappability<0, false, false>(index, text, mappedFrequencies, searchParams, false /*dir*/, chromLengths, locations, fileIds);
+
+        for (uint64_t i = 0; i < length(text); ++i)
+        {
+            EXPECT_EQ(frequencies[i], getFrequency(compactFrequencies, i));
+            EXPECT_EQ(frequencies[i], getFrequency(mappedFrequencies, i));
+        }
+        EXPECT_EQ(std::filesystem::file_size(mappedFrequencies.path), length(text) * sizeof(uint16_t));
+        std::filesystem::remove_all(mappedFrequencies.path.parent_path());
+
+        // almost all 2-mers are escaped, i.e., a plain vector takes less memory than the escape table
+        EXPECT_EQ(compactFrequencies.plain, k == 2);
+
+        // block-wise decoding
+        std::vector<uint16_t> block(1000);
+        getFrequencies(compactFrequencies, 1000, block.size(), block.data());
+        EXPECT_TRUE(std::equal(block.begin(), block.end(), frequencies.begin() + 1000));
+
+        // a slice of a slice refers to the frequency vector
+        auto const slice = sliceFrequencies(sliceFrequencies(compactFrequencies, 1000, 2000), 500, 1000);
+        EXPECT_EQ(slice.size(), 1000u);
+        EXPECT_EQ(getFrequency(slice, 10), frequencies[1510]);
+        getFrequencies(slice, 0, block.size(), block.data());
+        EXPECT_TRUE(std::equal(block.begin(), block.end(), frequencies.begin() + 1500));
+    }
+}
+
+TEST(GenMapAlgo, compact_frequencies_escapes)
+{
+    // a few escaped values spread over multiple blocks and set multiple times by different threads
+    uint64_t const size = 5 * (1ull << COMPACT_FREQUENCIES_BLOCK_BITS) + 123;
+    std::vector<uint32_t> expected(size, 0);
+    for (uint64_t i = 0; i < size; i += 997)
+        expected[i] = (i % 3 == 0) ? 1000 + i : i % 255;
+
+    CompactFrequencies<uint32_t> c;
+    initFrequencies(c, size, 4);
+    #pragma omp parallel for num_threads(4) schedule(static, 1)
+    for (uint64_t i = 0; i < 4 * size; i += 997)
+        if (expected[i % size] != 0)
+            setFrequency(c, i % size, expected[i % size]);
+    finalizeFrequencies(c);
+
+    EXPECT_FALSE(c.plain);
+    EXPECT_EQ(c.escapeOffsets.size(), static_cast<uint64_t>(std::count_if(expected.begin(), expected.end(),
+                                                                           [] (uint32_t v) { return v >= 255; })));
+    for (uint64_t i = 0; i < size; ++i)
+        EXPECT_EQ(getFrequency(c, i), expected[i]);
+
+    // ranges spanning block boundaries
+    std::vector<uint32_t> block(3 * (1ull << COMPACT_FREQUENCIES_BLOCK_BITS));
+    getFrequencies(c, 12345, block.size(), block.data());
+    EXPECT_TRUE(std::equal(block.begin(), block.end(), expected.begin() + 12345));
+    getFrequencies(c, size - 10, 10, block.data());
+    EXPECT_TRUE(std::equal(block.begin(), block.begin() + 10, expected.end() - 10));
+
+    // three out of four positions escaped: the escape table (6 bytes per escape) takes more memory than it saves
+    initFrequencies(c, size, 4);
+    for (uint64_t i = 0; i < size; ++i)
+        setFrequency(c, i, (i % 4 != 0) ? 300 + i : 1 + i % 254);
+    finalizeFrequencies(c);
+    EXPECT_TRUE(c.plain);
+    EXPECT_TRUE(c.codes.empty());
+    for (uint64_t i = 0; i < size; ++i)
+        EXPECT_EQ(getFrequency(c, i), (i % 4 != 0) ? 300 + i : 1 + i % 254);
+}
+
+TEST(GenMapAlgo, fasta_file_ids)
+{
+    using TIndexConfig = TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t>>;
+    typedef StringSet<String<Dna>, Owner<ConcatDirect<> > > TGenome;
+
+    TGenome genome;
+    std::vector<uint16_t> mappingSeqIdFile{0, 0, 1, 2, 2};
+    for (uint64_t ss = 0; ss < mappingSeqIdFile.size(); ++ss)
+    {
+        String<Dna> chr;
+        randomText(chr, rng, 100 + ss);
+        appendValue(genome, chr);
+    }
+
+    Index<TGenome, TIndexConfig> index(genome);
+    indexCreate(index, FibreSALF());
+
+    FastaFileIds fileIds;
+    computeFastaFileIds(fileIds, index, mappingSeqIdFile, 2);
+    EXPECT_EQ(fileIds.files, 3u);
+    EXPECT_EQ(fileIds.bits, 2u);
+
+    // every row of a 1-mer's SA interval has to be assigned to the fasta file of its occurrence
+    for (unsigned c = 0; c < ValueSize<Dna>::VALUE; ++c)
+    {
+        Iter<Index<TGenome, TIndexConfig>, VSTree<TopDown<> > > it(index);
+        ASSERT_TRUE(goDown(it, Dna(c)));
+        auto const & occs = getOccurrences(it.fwdIter);
+        for (uint64_t i = 0; i < length(occs); ++i)
+            EXPECT_EQ(getFastaFileId(fileIds, it.fwdIter.vDesc.range.i1 + i), mappingSeqIdFile[getSeqNo(occs[i])]);
+    }
+}
+
+TEST(GenMapAlgo, fasta_file_ids_packing)
+{
+    // ids of 0, 1, 3, 10 and 17 bits, some of them span two words
+    for (uint32_t const files : {1u, 2u, 5u, 1000u, 70000u})
+    {
+        FastaFileIds fileIds;
+        initFastaFileIds(fileIds, 1000, files);
+        EXPECT_EQ(fileIds.words.size(), (1000 * fileIds.bits + 63) / 64);
+
+        std::vector<uint32_t> expected(1000);
+        for (uint32_t & fileId : expected)
+            fileId = rng() % files;
+        #pragma omp parallel for num_threads(4)
+        for (uint64_t row = 0; row < expected.size(); ++row)
+            setFastaFileId(fileIds, row, expected[row]);
+        for (uint64_t row = 0; row < expected.size(); ++row)
+            EXPECT_EQ(getFastaFileId(fileIds, row), expected[row]) << files << " files, row " << row;
+    }
+}
+
+TEST(GenMapAlgo, concurrent_index_construction)
+{
+    typedef StringSet<String<Dna5>, Owner<ConcatDirect<> > > TGenome;
+    typedef Index<TGenome, TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t> > > TIndex;
+
+    TGenome genome;
+    for (uint64_t const sequenceLength : {5000, 1, 20000, 37})
+    {
+        String<Dna5> sequence;
+        randomText(sequence, rng, sequenceLength);
+        appendValue(genome, sequence);
+    }
+
+    // the memory budget decides whether the full forward suffix array is kept for deriving the reverse index
+    // (concurrently to the SA sampling) or the suffixes are located through the sampled suffix array
+    unsigned const threads = omp_get_max_threads();
+    omp_set_num_threads(std::max(2u, threads));
+    TIndex sequential(genome), concurrent(genome);
+    indexCreateProgress(sequential, FibreSALF(), 0);
+    indexCreateProgress(concurrent, FibreSALF(), std::numeric_limits<uint64_t>::max());
+    EXPECT_EQ(omp_get_max_threads(), static_cast<int>(std::max(2u, threads))); // restored after the construction
+    omp_set_num_threads(threads);
+
+    // the fibres that are written by 'genmap index'
+    auto const saveIndexFibres = [] (TIndex & index, std::filesystem::path const & dir)
+    {
+        return saveFibres(dir, getFibre(index.fwd, FibreSA()), getFibre(index.fwd, FibreLF()),
+                          getFibre(index.rev, FibreLF()));
+    };
+    std::filesystem::path const dir = testDirectory();
+    EXPECT_EQ(saveIndexFibres(sequential, dir / "sequential"), saveIndexFibres(concurrent, dir / "concurrent"));
+    EXPECT_EQ(sparseSuffixArrayLength(sequential.rev.sa), sparseSuffixArrayLength(concurrent.rev.sa));
+    std::filesystem::remove_all(dir);
+
+    EXPECT_GT(indexCreateMemoryBudget(), 0u);
+}
+
+TEST(GenMapAlgo, external_index_construction)
+{
+    typedef StringSet<String<Dna5>, Owner<ConcatDirect<> > > TGenome;
+    typedef Index<TGenome, FMIndex<void, TGemMapFastFMIndexConfig<uint32_t> > > TIndex;
+
+    // sequences shorter than the bucket prefix (6 characters for Dna5) are included
+    TGenome genome;
+    for (uint64_t const sequenceLength : {3000, 1, 2, 5, 8000, 6, 3, 500})
+    {
+        String<Dna5> sequence;
+        randomText(sequence, rng, sequenceLength);
+        appendValue(genome, sequence);
+    }
+
+    std::filesystem::path const dir = testDirectory();
+    IndexCreateTimes times;
+    TIndex expected(genome);
+    indexCreateProgress(expected, FibreSALF(), times, false);
+    auto const expectedFibres = saveFibres(dir / "expected", getFibre(expected, FibreSA()), getFibre(expected, FibreLF()));
+
+    unsigned const threads = omp_get_max_threads();
+    for (unsigned const t : {1u, 2u, std::max(3u, threads)})
+    {
+        omp_set_num_threads(t);
+        // a few suffixes per group, i.e., many groups are distributed through the temporary file
+        TIndex index(genome);
+        indexCreateExternalProgress(index, FibreSALF(), 1024, times, false);
+        EXPECT_EQ(saveFibres(dir / std::to_string(t), getFibre(index, FibreSA()), getFibre(index, FibreLF())),
+                  expectedFibres);
+        EXPECT_EQ(length(getFibre(index, FibreSA())), length(getFibre(expected, FibreSA())));
+    }
+    omp_set_num_threads(threads);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(GenMapAlgo, reverse_index_construction)
+{
+    typedef StringSet<String<Dna5>, Owner<ConcatDirect<> > > TGenome;
+    typedef Index<TGenome, TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t> > > TIndex;
+
+    TGenome genome;
+    for (uint64_t const sequenceLength : {2000, 1, 3, 700, 5000})
+    {
+        String<Dna5> sequence;
+        randomText(sequence, rng, sequenceLength);
+        appendValue(genome, sequence);
+    }
+
+    std::filesystem::path const dir = testDirectory();
+    // bwt, sentinels and sums of the reverse index
+    TIndex expected(genome);
+    indexCreate(expected.rev, FibreSALF());
+    auto const expectedLF = saveFibres(dir / "expected", getFibre(expected.rev, FibreLF()));
+
+    unsigned const threads = omp_get_max_threads();
+    omp_set_num_threads(std::max(2u, threads));
+    TIndex sequential(genome), concurrent(genome), external(genome);
+    indexCreateProgress(sequential, FibreSALF(), 0);
+    indexCreateProgress(concurrent, FibreSALF(), std::numeric_limits<uint64_t>::max());
+    indexCreateExternalProgress(external, FibreSALF(), 1024);
+    omp_set_num_threads(threads);
+
+    std::vector<std::pair<std::string, TIndex *> > const indices{{"sequential", &sequential},
+                                                                 {"concurrent", &concurrent},
+                                                                 {"external", &external}};
+    for (auto const & [name, index] : indices)
+    {
+        EXPECT_EQ(saveFibres(dir / name, getFibre(index->rev, FibreLF())), expectedLF) << name;
+        EXPECT_EQ(sparseSuffixArrayLength(index->rev.sa), length(getFibre(expected.rev, FibreSA()))) << name;
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST(GenMapAlgo, reverse_index_memory)
+{
+    typedef StringSet<String<Dna5>, Owner<ConcatDirect<> > > TGenome;
+    typedef Index<TGenome, TBiIndexConfig<TGemMapFastFMIndexConfig<uint32_t> > > TIndex;
+    typedef Fibre<Index<TGenome, FMIndex<void, TGemMapFastFMIndexConfig<uint32_t> > >, FibreTempSA>::Type TTempSA;
+
+    TGenome genome;
+    for (uint64_t const sequenceLength : {600000, 3, 400000})
+    {
+        String<Dna5> sequence;
+        randomText(sequence, rng, sequenceLength);
+        appendValue(genome, sequence);
+    }
+    uint64_t const saMemory = lengthSum(genome) * sizeof(Value<TTempSA>::Type);
+
+    std::filesystem::path const dir = testDirectory();
+    TIndex expected(genome);
+    indexCreate(expected.rev, FibreSALF());
+    auto const expectedLF = saveFibres(dir / "expected", getFibre(expected.rev, FibreLF()));
+
+    TIndex index(genome);
+    IndexCreateTimes fwdTimes, revTimes;
+    indexCreateProgress(index.fwd, FibreSALF(), fwdTimes, false);
+
+    // the reverse LF table (and a temporary byte per character) is derived without sorting the reversed suffixes
+    uint64_t const usage = heapUsage;
+    heapPeak = usage;
+    indexCreateReverse(index, revTimes, [&index] (uint64_t const row) { return locateSuffix(index.fwd, row); });
+    EXPECT_LT(heapPeak - usage, saMemory / 2);
+    EXPECT_EQ(revTimes.saca, 0.0);
+    EXPECT_EQ(revTimes.sampling, 0.0);
+
+    EXPECT_EQ(saveFibres(dir / "derived", getFibre(index.rev, FibreLF())), expectedLF);
+    EXPECT_EQ(sparseSuffixArrayLength(index.rev.sa), length(getFibre(expected.rev, FibreSA())));
+    std::filesystem::remove_all(dir);
+}
+
+TEST(GenMapAlgo, sequence_lookup)
+{
+    for (uint64_t it = 0; it < 100; ++it)
+    {
+        // cumulative lengths of short and long (and some empty) sequences
+        StringSet<uint64_t> cumLengths;
+        appendValue(cumLengths, 0);
+        uint64_t const sequences = 1 + rng() % 50;
+        for (uint64_t i = 0; i < sequences; ++i)
+            appendValue(cumLengths, back(cumLengths) + ((rng() % 4 == 0) ? 0 : rng() % ((rng() % 2) ? 5 : 1000)));
+        if (back(cumLengths) == 0)
+            continue;
+
+        SequenceLookup lookup;
+        initSequenceLookup(lookup, cumLengths);
+        for (uint64_t pos = 0; pos < back(cumLengths); ++pos)
+        {
+            Pair<uint64_t, uint64_t> expected, result;
+            myPosLocalizeBinarySearch(expected, pos, lookup.limits);
+            myPosLocalize(result, pos, lookup);
+            EXPECT_EQ(expected, result);
+        }
+    }
+}
+
+#if SEQAN_HAS_ZLIB
+TEST_F(GenMapOutput, bigwig)
+{
+    std::vector<uint16_t> c;
+    for (uint64_t i = 0; i < 3; ++i)
+    {
+        addSequence("chr" + std::to_string(i), 2000 + i);
+        for (uint64_t pos = 0; pos < back(chromLengths); ++pos)
+            c.push_back((rng() % 8 == 0) ? rng() % 3 : 1 + pos / 100 % 2);
+    }
+
+    saveBigWig<true>(c, path, chromNames, chromLengths, 2);
+    std::string const data = readFile(path + ".bw");
+
+    auto read = [&data] (auto & value, uint64_t const offset) { memcpy(&value, data.data() + offset, sizeof(value)); };
+    uint32_t magic;
+    uint64_t fullIndexOffset;
+    read(magic, 0);
+    read(fullIndexOffset, 24);
+    ASSERT_EQ(magic, genmap::detail::BIGWIG_MAGIC);
+
+    // few sections, i.e., the root of the R-tree is a leaf
+    uint16_t sections;
+    read(sections, fullIndexOffset + 48 + 2);
+    uint64_t pos = 0;
+    for (uint64_t s = 0; s < sections; ++s)
+    {
+        uint64_t const entry = fullIndexOffset + 48 + 4 + s * 32;
+        uint64_t offset, size;
+        read(offset, entry + 16);
+        read(size, entry + 24);
+
+        std::string section(1 << 16, '\0');
+        uLongf sectionSize = section.size();
+        ASSERT_EQ(uncompress(reinterpret_cast<Bytef *>(&section[0]), &sectionSize,
+                             reinterpret_cast<Bytef const *>(data.data() + offset), size), Z_OK);
+
+        uint16_t items;
+        memcpy(&items, section.data() + 22, sizeof(items));
+        for (uint64_t i = 0; i < items; ++i)
+        {
+            uint32_t start, end;
+            float value;
+            memcpy(&start, section.data() + 24 + 12 * i, sizeof(start));
+            memcpy(&end, section.data() + 28 + 12 * i, sizeof(end));
+            memcpy(&value, section.data() + 32 + 12 * i, sizeof(value));
+            for (uint64_t k = start; k < end; ++k, ++pos)
+                EXPECT_EQ(value, (c[pos] != 0) ? 1.0f / c[pos] : 0.0f);
+        }
+    }
+    EXPECT_EQ(pos, c.size());
+}
+
+TEST_F(GenMapOutput, bgzf)
+{
+    using namespace genmap::detail;
+
+    std::string text;
+    for (uint64_t i = 0; i < 200000; ++i)
+        text += std::to_string(rng() % 1000) + ((i % 10 == 9) ? '\n' : ' ');
+
+    TextFile textFile;
+    openTextFile(textFile, path + ".txt", false, true, 2);
+    writeText(textFile, text);
+    std::vector<uint64_t> virtualOffsets;
+    for (uint64_t offset = 0; offset <= text.size(); offset += 10007)
+        virtualOffsets.push_back(virtualOffset(textFile, offset));
+    closeTextFile(textFile);
+
+    std::string const data = readFile(path + ".txt.gz");
+
+    // decompress the blocks and check the virtual offsets
+    std::string decompressed;
+    std::map<uint64_t, uint64_t> blockBegins; // file offset -> uncompressed offset
+    for (uint64_t offset = 0; offset < data.size();)
+    {
+        uint16_t blockSize;
+        memcpy(&blockSize, data.data() + offset + 16, sizeof(blockSize));
+        blockBegins[offset] = decompressed.size();
+
+        std::string block(BGZF_BLOCK_SIZE, '\0');
+        z_stream stream{};
+        inflateInit2(&stream, 16 + MAX_WBITS);
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data() + offset));
+        stream.avail_in = blockSize + 1;
+        stream.next_out = reinterpret_cast<Bytef *>(&block[0]);
+        stream.avail_out = block.size();
+        ASSERT_EQ(inflate(&stream, Z_FINISH), Z_STREAM_END);
+        decompressed.append(block.data(), stream.total_out);
+        inflateEnd(&stream);
+
+        offset += blockSize + 1;
+    }
+    EXPECT_EQ(decompressed, text);
+    for (uint64_t i = 0; i < virtualOffsets.size(); ++i)
+        EXPECT_EQ(blockBegins[virtualOffsets[i] >> 16] + (virtualOffsets[i] & 0xFFFF), i * 10007);
+
+    // bins of the default tabix scheme
+    EXPECT_EQ(tabixBin(0, 1, 14, 5), 4681u);
+    EXPECT_EQ(tabixBin(16384, 16385, 14, 5), 4682u);
+    EXPECT_EQ(tabixBin(0, 16385, 14, 5), 585u);
+    EXPECT_EQ(tabixBin(0, 1 << 29, 14, 5), 0u);
+}
+#endif
+
+TEST_F(GenMapOutput, bedgraph)
+{
+    // runs cross the blocks of TEXT_BLOCK_SIZE positions
+    std::vector<uint16_t> c;
+    for (uint64_t i = 0; i < 2; ++i)
+    {
+        addSequence("chr" + std::to_string(i), 3 * TEXT_BLOCK_SIZE + i);
+        for (uint64_t pos = 0; pos < back(chromLengths); ++pos)
+            c.push_back(1 + (pos + i) / 100000 % 3);
+    }
+
+    saveBedGraph<false>(c, path, chromNames, chromLengths, false, 4);
+    saveMaskBed(c, path, chromNames, chromLengths, 0.5, false, 4);
+
+    std::string expectedBedGraph, expectedMask;
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < 2; ++i)
+    {
+        for (uint64_t begin = 0, end; begin < chromLengths[i]; begin = end)
+        {
+            for (end = begin; end < chromLengths[i] && c[offset + end] == c[offset + begin]; ++end)
+                ;
+            std::string const run = "chr" + std::to_string(i) + '\t' + std::to_string(begin) + '\t' + std::to_string(end);
+            expectedBedGraph += run + '\t' + std::to_string(c[offset + begin]) + '\n';
+        }
+        for (uint64_t begin = 0, end; begin < chromLengths[i]; begin = end)
+        {
+            for (end = begin; end < chromLengths[i] && (c[offset + end] <= 2) == (c[offset + begin] <= 2); ++end)
+                ;
+            if (c[offset + begin] <= 2)
+                expectedMask += "chr" + std::to_string(i) + '\t' + std::to_string(begin) + '\t' + std::to_string(end) + '\n';
+        }
+        offset += chromLengths[i];
+    }
+
+    EXPECT_EQ(readFile(path + ".bedgraph"), expectedBedGraph);
+    EXPECT_EQ(readFile(path + ".mask.bed"), expectedMask);
+}
+
+TEST_F(GenMapOutput, txt_empty_sequences)
+{
+    // empty sequences at the beginning of a block, at the border of two blocks and at the end of the text
+    for (auto const & [name, sequenceLength] : std::vector<std::pair<std::string, uint64_t>>{{"a", 3}, {"b", 0},
+         {"c", 0}, {"d", TEXT_BLOCK_SIZE - 3}, {"e", 0}, {"f", 2}, {"g", 0}})
+    {
+        addSequence(name, sequenceLength);
+    }
+
+    std::vector<uint16_t> c;
+    std::string expected;
+    for (uint64_t i = 0; i < length(chromNames); ++i)
+    {
+        expected += '>' + std::string(toCString(chromNames[i])) + '\n';
+        for (uint64_t pos = 0; pos < chromLengths[i]; ++pos)
+        {
+            c.push_back(pos % 7);
+            expected += std::to_string(pos % 7) + ((pos + 1 == chromLengths[i]) ? '\n' : ' ');
+        }
+        if (chromLengths[i] == 0)
+            expected += '\n';
+    }
+
+    saveTxt<false>(c, path, chromNames, chromLengths, false, 2);
+    EXPECT_EQ(readFile(path + ".txt"), expected);
+
+    // only empty sequences
+    clear(chromNames);
+    clear(chromLengths);
+    addSequence("x", 0);
+    addSequence("y", 0);
+    saveTxt<false>(std::vector<uint16_t>{}, path, chromNames, chromLengths, false, 2);
+    EXPECT_EQ(readFile(path + ".txt"), ">x\n\n>y\n\n");
+}
+
+TEST_F(GenMapOutput, sequence_output_paths)
+{
+    // ids that are not unique get the number of the sequence appended, which must not collide with other ids
+    for (std::string const name : {"x description", "y", "x", "x_2", "a|b", "a_b"})
+        addSequence(name, 1);
+
+    std::vector<std::string> const paths = getSequenceOutputPaths(path, chromNames);
+    EXPECT_EQ(paths, (std::vector<std::string>{path + ".x_0", path + ".y", path + ".x_2_2", path + ".x_2",
+                                               path + ".a_b_4", path + ".a_b_5"}));
+}
+
+TEST_F(GenMapOutput, bins)
+{
+    // the last k-1 = 9 positions of each sequence and the k-mers with an N (chr0:1000-1100) have a frequency of 0 and
+    // are not counted
+    addSequence("chr0", 2500);
+    addSequence("chr1", 999);
+    addSequence("chr2", 5);
+    std::vector<uint16_t> c;
+    for (uint64_t i = 0; i < length(chromLengths); ++i)
+        for (uint64_t pos = 0; pos < chromLengths[i]; ++pos)
+            c.push_back((pos + 9 >= chromLengths[i] || (i == 0 && pos >= 1000 && pos < 1100)) ? 0 : 1 + pos % 4);
+
+    saveBins<false>(c, path, chromNames, chromLengths, 1000, false, 2);
+    EXPECT_EQ(readFile(path + ".bins1000.tsv"), "#chrom\tstart\tend\tmean\tmin\tmax\tunique_fraction\n"
+                    "chr0\t0\t1000\t2.5\t1\t4\t0.25\n"
+                    "chr0\t1000\t2000\t2.5\t1\t4\t0.25\n"
+                    "chr0\t2000\t2500\t2.49694\t1\t4\t0.250509\n"
+                    "chr1\t0\t999\t2.49798\t1\t4\t0.250505\n"
+                    "chr2\t0\t5\t0\t0\t0\t0\n");
+
+    saveBins<true>(c, path, chromNames, chromLengths, 1000, false, 2);
+    EXPECT_EQ(readFile(path + ".bins1000.tsv"), "#chrom\tstart\tend\tmean\tmin\tmax\tunique_fraction\n"
+                    "chr0\t0\t1000\t0.520833\t0.25\t1\t0.25\n"
+                    "chr0\t1000\t2000\t0.520833\t0.25\t1\t0.25\n"
+                    "chr0\t2000\t2500\t0.521385\t0.25\t1\t0.250509\n"
+                    "chr1\t0\t999\t0.521296\t0.25\t1\t0.250505\n"
+                    "chr2\t0\t5\t0\t0\t0\t0\n");
+}
+
+TEST_F(GenMapOutput, wig_adaptive)
+{
+    addSequence("chr1", 112);
+    addSequence("chr2", 200);
+    std::vector<uint16_t> c;
+    for (uint64_t pos = 0; pos < 12; ++pos) // short runs: fixedStep with step 1
+        c.push_back(1 + pos % 2);
+    c.resize(112, 3);                       // a single long run: variableStep
+    for (uint64_t pos = 0; pos < 200; ++pos) // runs of equal length: fixedStep with step 10
+        c.push_back(4 + pos / 10 % 2);
+
+    saveAdaptiveWig<false>(c, path, chromNames, chromLengths, false, 2);
+
+    std::string expected = "fixedStep chrom=chr1 start=1 step=1 span=1\n";
+    for (uint64_t pos = 0; pos < 12; ++pos)
+        expected += std::to_string(c[pos]) + '\n';
+    expected += "variableStep chrom=chr1 span=100\n13 3\n";
+    expected += "fixedStep chrom=chr2 start=1 step=10 span=10\n";
+    for (uint64_t run = 0; run < 20; ++run)
+        expected += std::to_string(4 + run % 2) + '\n';
+    EXPECT_EQ(readFile(path + ".wig"), expected);
+}
+
+TEST_F(GenMapOutput, statistics)
+{
+    std::vector<uint64_t> chromLengths = {5000, 3, 1000};
+    std::vector<uint16_t> c;
+    for (uint64_t i = 0; i < chromLengths.size(); ++i)
+        for (uint64_t pos = 0; pos < chromLengths[i]; ++pos)
+            c.push_back((pos + 10 < chromLengths[i]) ? rng() % 1000 : 0);
+
+    // statistics of a chunk are appended
+    std::vector<SequenceStatistics> stats;
+    computeStatistics(stats, std::vector<uint16_t>(c.begin(), c.begin() + 5003), chromLengths, 0, 2, 10, 2);
+    computeStatistics(stats, std::vector<uint16_t>(c.begin() + 5003, c.end()), chromLengths, 2, 3, 10, 2);
+    ASSERT_EQ(stats.size(), 3u);
+
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < chromLengths.size(); ++i)
+    {
+        uint64_t const kmers = (chromLengths[i] >= 10) ? chromLengths[i] - 9 : 0;
+        std::array<uint64_t, STATISTICS_BINS> histogram{};
+        for (uint64_t pos = 0; pos < kmers; ++pos)
+            ++histogram[genmap::detail::statisticsBin(c[offset + pos])];
+        EXPECT_EQ(stats[i].length, chromLengths[i]);
+        EXPECT_EQ(stats[i].kmers, kmers);
+        EXPECT_EQ(stats[i].histogram, histogram);
+        offset += chromLengths[i];
+    }
+
+    EXPECT_EQ(genmap::detail::statisticsBin(1), 1u);
+    EXPECT_EQ(genmap::detail::statisticsBin(4), 3u);
+    EXPECT_EQ(genmap::detail::statisticsBin(5), 4u);
+    EXPECT_EQ(genmap::detail::statisticsBin(65535), STATISTICS_BINS - 1u);
+}
+
+TEST_F(GenMapOutput, raw_container)
+{
+    std::vector<uint16_t> c;
+    for (uint64_t i = 0; i < 3; ++i)
+    {
+        addSequence("chr" + std::to_string(i) + " description", 3000 + i);
+        for (uint64_t pos = 0; pos < back(chromLengths); ++pos)
+            c.push_back(rng() % 300);
+    }
+
+    SearchParams searchParams;
+    searchParams.length = 30;
+    searchParams.revCompl = true;
+    searchParams.excludePseudo = false;
+    saveRawContainer<false>(c, path, chromNames, chromLengths, searchParams, 2, false);
+
+    RawContainer rc;
+    ASSERT_TRUE(openRawContainer(rc, path + ".gmr"));
+    EXPECT_EQ(rc.header.kmerLength, 30u);
+    EXPECT_EQ(rc.header.errors, 2u);
+    EXPECT_EQ(rc.header.revCompl, 1u);
+    EXPECT_EQ(rc.header.valueType, OutputType::frequency_large);
+    ASSERT_EQ(rc.chromosomes.size(), 3u);
+
+    uint64_t id;
+    std::string name;
+    uint64_t begin, end;
+    ASSERT_TRUE(parseRegion("chr1:2001-2010", name, begin, end));
+    ASSERT_TRUE(findRawContainerChromosome(rc, name, id));
+    EXPECT_EQ(id, 1u);
+    EXPECT_EQ(rc.chromosomes[id].offset % RAW_CONTAINER_ALIGNMENT, 0u);
+    EXPECT_FALSE(parseRegion("chr1:0-10", name, begin, end));
+    EXPECT_FALSE(parseRegion("chr1:10-9", name, begin, end));
+
+    std::ostringstream values;
+    ASSERT_TRUE(queryRegion(values, rc, id, begin, end));
+    std::ostringstream expected;
+    for (uint64_t pos = 2000; pos < 2010; ++pos)
+        expected << "chr1 description\t" << (pos + 1) << '\t' << c[3000 + pos] << '\n';
+    EXPECT_EQ(values.str(), expected.str());
+
+    // the file is truncated after it has been opened: regions beyond the end of the file are not memory-mapped
+    ASSERT_EQ(truncate((path + ".gmr").c_str(), rc.chromosomes[1].offset + 100), 0);
+    EXPECT_FALSE(queryRegion(values, rc, 1, 0, 3001));
+    EXPECT_TRUE(queryRegion(values, rc, 1, 0, 10));
+    RawContainer truncated;
+    EXPECT_FALSE(openRawContainer(truncated, path + ".gmr"));
+
+    // the file was written on a machine with a different byte order
+    saveRawContainer<false>(c, path, chromNames, chromLengths, searchParams, 2, false);
+    {
+        std::fstream file(path + ".gmr", std::ios::in | std::ios::out | std::ios::binary);
+        uint32_t const swapped[2] = {__builtin_bswap32(RAW_CONTAINER_VERSION), __builtin_bswap32(RAW_CONTAINER_BYTE_ORDER)};
+        file.seekp(offsetof(RawContainerHeader, version));
+        file.write(reinterpret_cast<char const *>(swapped), sizeof(swapped));
+    }
+    RawContainer swapped;
+    EXPECT_FALSE(openRawContainer(swapped, path + ".gmr"));
+}
+
+TEST_F(GenMapOutput, locations)
+{
+    using TLocation = Pair<uint16_t, uint32_t>;
+
+    // more k-mers than LOCATIONS_BLOCK_SIZE, exact copies (back-references) and occurrences on multiple sequences
+    addSequence("chr0", 3000);
+    addSequence("chr1", 50);
+    addSequence("chr2", 2000);
+    StringSet<CharString> directoryInformation;
+    appendValue(directoryInformation, "a.fa;3000;chr0");
+    appendValue(directoryInformation, "a.fa;50;chr1");
+    appendValue(directoryInformation, "b.fa;2000;chr2");
+    appendValue(directoryInformation, "dummy.entry;0;chromosomename");
+
+    SearchParams searchParams;
+    searchParams.length = 10;
+    searchParams.threads = 2;
+    searchParams.revCompl = true;
+    searchParams.excludePseudo = false;
+
+    KmerLocations<TLocation> locations;
+    for (uint64_t i = 0; i < length(chromLengths); ++i)
+    {
+        for (uint64_t pos = 0; pos + searchParams.length <= chromLengths[i]; ++pos)
+        {
+            if (locations.groups.size() > 1 && rng() % 3 == 0)
+            {
+                locations.positions[TLocation(i, pos)] = 1 + rng() % (locations.groups.size() - 1);
+                continue;
+            }
+
+            locations.positions[TLocation(i, pos)] = locations.groups.size();
+            locations.groups.emplace_back();
+            for (auto * strandLoc : {&locations.groups.back().first, &locations.groups.back().second})
+            {
+                for (uint64_t occ = rng() % 6; occ > 0; --occ)
+                {
+                    uint64_t const seqNo = rng() % length(chromLengths);
+                    strandLoc->emplace_back(seqNo, rng() % chromLengths[seqNo]);
+                }
+                std::sort(strandLoc->begin(), strandLoc->end());
+                strandLoc->erase(std::unique(strandLoc->begin(), strandLoc->end()), strandLoc->end());
+            }
+        }
+    }
+
+    saveCsv<false>(path, locations, searchParams, chromLengths, directoryInformation);
+    saveLocations(path, locations, searchParams, chromLengths, directoryInformation);
+    std::string const csv = readFile(path + ".csv");
+
+    std::ostringstream view;
+    ASSERT_TRUE(viewLocations(view, path + ".loc", false, 0));
+    EXPECT_EQ(view.str(), csv);
+
+    std::ostringstream viewSequence, expectedSequence;
+    ASSERT_TRUE(viewLocations(viewSequence, path + ".loc", true, 2));
+    std::istringstream csvRows(csv);
+    for (std::string row; std::getline(csvRows, row);)
+        if (row[0] == '"' || row.compare(0, 2, "2,") == 0)
+            expectedSequence << row << '\n';
+    EXPECT_EQ(viewSequence.str(), expectedSequence.str());
+
+    // truncated and corrupt files are rejected without reading past the end of the file or a block
+    std::string const data = readFile(path + ".loc");
+    LocationsFileHeader header;
+    LocationsBlockIndexEntry blockIndex[2];
+    ASSERT_TRUE(genmap::detail::readLocationsHeader(data.data(), data.data() + data.size(), header));
+    ASSERT_EQ(header.blocks, 2u);
+    char const * it = data.data() + header.blockIndexOffset;
+    for (LocationsBlockIndexEntry & entry : blockIndex)
+        ASSERT_TRUE(genmap::detail::readLocationsBlockIndexEntry(it, data.data() + data.size(), entry));
+    EXPECT_EQ(it, data.data() + data.size());
+
+    // the fixed-width fields are stored in little-endian byte order without padding
+    EXPECT_EQ(data.substr(8, 8), std::string("\x02\0\0\0\x04\x03\x02\x01", 8)); // version and byte order
+    EXPECT_EQ(data.substr(LOCATIONS_HEADER_SIZE, 16), std::string("\x01\0\0\0\0\0\0\0\x04\0\0\0a.fa", 16)); // a.fa ends with chr1
+
+    std::string corrupt = data;
+    std::fill(corrupt.begin() + blockIndex[0].offset, corrupt.begin() + blockIndex[1].offset, '\xFF');
+    std::string swapped = data;
+    std::reverse(swapped.begin() + 12, swapped.begin() + 16);
+    for (std::string const & file : {data.substr(0, 60), data.substr(0, data.size() / 2), data.substr(0, data.size() - 1),
+                                     corrupt, swapped})
+    {
+        std::ofstream(path + ".corrupt.loc", std::ios::binary) << file;
+        std::ostringstream corruptView;
+        EXPECT_FALSE(viewLocations(corruptView, path + ".corrupt.loc", false, 0));
+    }
+}
+
+TEST_F(GenMapOutput, output_file)
+{
+    using namespace genmap::detail;
+
+    std::string data;
+    for (uint64_t i = 0; i < 100000; ++i)
+        data += static_cast<char>('a' + rng() % 26);
+
+    for (bool const directIO : {false, true})
+    {
+        // small buffers such that both buffers are written multiple times
+        OutputFileConfig::bufferSize = 10000;
+        OutputFileConfig::directIO = directIO;
+
+        OutputFile file;
+        openOutputFile(file, path);
+        writeOutput(file, data.data(), 12345);
+        EXPECT_EQ(tellOutput(file), 12345u);
+        closeOutputFile(file);
+
+        OutputFile appendFile; // unaligned offset
+        openOutputFile(appendFile, path, true);
+        writeOutput(appendFile, data.data() + 12345, data.size() - 12345);
+        closeOutputFile(appendFile);
+        overwriteOutput(path, 0, "XYZ", 3);
+
+        EXPECT_EQ(readFile(path), "XYZ" + data.substr(3));
+
+        // the buffered data of a file that is not closed explicitly is written by the destructor
+        {
+            OutputFile unclosedFile;
+            openOutputFile(unclosedFile, path);
+            writeOutput(unclosedFile, data.data(), 23456);
+        }
+        EXPECT_EQ(readFile(path), data.substr(0, 23456));
+    }
+    OutputFileConfig::bufferSize = OUTPUT_BUFFER_SIZE;
+    OutputFileConfig::directIO = false;
+
+#ifdef O_DIRECT
+    // unaligned writes are rejected (EINVAL) by file systems supporting direct I/O and repeated without O_DIRECT
+    int const fd = ::open(path.c_str(), O_WRONLY | O_TRUNC);
+    ASSERT_NE(fd, -1);
+    bool const directIO = fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) == 0;
+    EXPECT_TRUE(pwriteOutput(fd, data.data() + 1, 1000, 0, directIO));
+    EXPECT_EQ(::close(fd), 0);
+    EXPECT_EQ(readFile(path), data.substr(1, 1000));
+#endif
+}
+
 // TEST(GenMapAlgo, edit_1_dna4)
 // {
 //     test<Dna, EditDistance, 1>(5, 1000, 1);